@@ -1,12 +1,16 @@
 #include <iostream>
-#include <fstream>
+#include <cstdio>
 #include <string>
+#include <string_view>
+
+#include "../common/SourceFile.h"
+
 using namespace std;
 
 int main(int argc, char *argv[]) {
     // Check if a file name is provided
     if (argc < 2) {
-        cerr << "Usage: " << argv[0] << " <filename>" << endl;
+        cerr << "Usage: " << argv[0] << " <filename | ->" << endl;
         return 1;
     }
 
@@ -14,22 +18,19 @@ int main(int argc, char *argv[]) {
     string filename = argv[1];
     
     // Open the file
-    ifstream file(filename);
+    SourceFile file;
 
     // Check if the file was opened successfully
-    if (!file) {
+    if (!file.open(filename)) {
         cerr << "Error: Could not open file " << filename << endl;
         return 1;
     }
 
-    // Read and display the file content line by line
-    string line;
-    while (getline(file, line)) {
-        cout << line << endl;
-    }
-
-    // Close the file
-    file.close();
+    // Display the file content, ending with a newline like line-by-line echo did
+    string_view text = file.text();
+    fwrite(text.data(), 1, text.size(), stdout);
+    if (!text.empty() && text.back() != '\n')
+        fputc('\n', stdout);
 
     return 0;
 }
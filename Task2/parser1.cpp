@@ -1,11 +1,16 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cstdint>
+#include <array>
 #include <cctype>
 
+#include "../common/Keywords.h"
+
 using namespace std;
 
-enum TokenType {
+enum TokenType : uint8_t {
     T_INT,T_ID,T_NUM,T_IF,
     T_ELSE,T_RETURN,T_ASSIGN,
     T_PLUS,T_MINUS,T_MUL,T_DIV,
@@ -13,12 +18,24 @@ enum TokenType {
     T_RBRACE,T_SEMICOLON,T_GT,T_EOF
 };
 
+// A token does not own its text: value is a view into the source buffer
+// held by the caller of Lexer, so producing a token never allocates.
 struct Token {
+    string_view value;
+    uint32_t line;  // Add line number
     TokenType type;
-    string value;
-    int line;  // Add line number
+
+    Token() : line(0), type(T_EOF) {}
+    Token(TokenType type, string_view value, uint32_t line) : value(value), line(line), type(type) {}
 };
 
+// Token type of each shared keyword; the ones this language does not reserve are identifiers
+static constexpr TokenType keywordTokens[NOT_KEYWORD + 1] = {
+    T_INT, T_ID, T_ID, T_ID, T_ID, T_ID, T_IF, T_ELSE, T_RETURN, T_ID, T_ID, T_ID};
+
+// Returns the keyword's token type, or T_ID for any other (non-empty) word
+inline TokenType lookupKeyword(string_view word) { return keywordTokens[findKeyword(word)]; }
+
 class Parser {
 private:
     vector<Token> tokens;
@@ -112,7 +129,7 @@ public:
         if (tokens[pos].type == type) {
             pos++;
         } else {
-            cout << "Syntax error: expected " << type << " but found " 
+            cout << "Syntax error: expected " << int(type) << " but found " 
                  << tokens[pos].value << " on line " << tokens[pos].line << endl;
             exit(1);
         }
@@ -121,23 +138,23 @@ public:
 
 class Lexer {
 private:
-    string src;
+    string_view src; // Not a copy: the caller keeps the source alive while tokens are in use
     size_t pos;
 
 public:
-    Lexer(const string &src) {
+    Lexer(string_view src) {
         this->src = src;
         this->pos = 0;
     }
 
-    string consumeNumber() {
+    string_view consumeNumber() {
         size_t start = pos;
         while (pos < src.size() && isdigit(src[pos]))
             pos++;
         return src.substr(start, pos - start);
     }
 
-    string consumeWord() {
+    string_view consumeWord() {
         size_t start = pos;
         while (pos < src.size() && isalnum(src[pos]))
             pos++;
@@ -146,7 +163,7 @@ public:
 
     vector<Token> tokenize() {
         vector<Token> tokens;
-        int line = 0; // Start with line number 1
+        uint32_t line = 0; // Start with line number 1
         while (pos < src.size()) {
             char current = src[pos];
             if (isspace(current)) {
@@ -158,13 +175,8 @@ public:
                 tokens.push_back(Token{T_NUM, consumeNumber(), line});
                 continue;
             } else if (isalpha(current)) {
-                string word = consumeWord();
-                TokenType type;
-                if (word == "int") type = T_INT;
-                else if (word == "if") type = T_IF;
-                else if (word == "else") type = T_ELSE;
-                else if (word == "return") type = T_RETURN;
-                else type = T_ID;
+                string_view word = consumeWord();
+                TokenType type = lookupKeyword(word);
                 tokens.push_back(Token{type, word, line});
                 continue;
             }
@@ -1,477 +1,317 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
-#include <vector>
+#include <memory>
+#include <ostream>
 #include <string>
-#include <cctype>
-#include <unordered_map>
-#include <iomanip>
-
-using namespace std;
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
 
-enum TokenType
-{
-    T_INT,
-    T_FLOAT,
-    T_STRING,
-    T_BOOL,
-    T_ID,
-    T_NUM,
-    T_IF,
-    T_ELSE,
-    T_RETURN,
-    T_ASSIGN,
-    T_PLUS,
-    T_MINUS,
-    T_MUL,
-    T_DIV,
-    T_LPAREN,
-    T_RPAREN,
-    T_LBRACE,
-    T_RBRACE,
-    T_SEMICOLON,
-    T_GT,
-    T_LT,
-    T_EQ,
-    T_NEQ,
-    T_LOGICAL_AND,
-    T_LOGICAL_OR,
-    T_WHILE,
-    T_FOR,
-    T_EOF
-};
+#include "compiler/TimeReport.h"
+#include "compiler/Compile.h"
+#include "compiler/IncrementalSession.h"
+#include "compiler/CompileCache.h"
+#include "compiler/Benchmarks.h"
+#include "compiler/Generators.h"
+#include "compiler/CompileServer.h"
 
-struct Token
-{
-    TokenType type;
-    string value;
-    int line;
-};
+using namespace std;
 
-class Parser
+int main(int argc, char *argv[])
 {
-private:
-    vector<Token> tokens;
-    size_t pos;
-    unordered_map<string, string> symbolTable;
-
-public:
-    Parser(const vector<Token> &tokens) : tokens(tokens), pos(0) {}
-
-    void parseProgram()
+    // Options come first. One file named after them ("-" for stdin) replaces
+    // the built-in sample; several files or a directory are compiled in parallel.
+    CompileOptions options;
+    size_t threads = max(thread::hardware_concurrency(), 1u);
+    struct Edit
     {
-        while (tokens[pos].type != T_EOF)
-            parseStatement();
-        cout << "Parsing completed successfully! No Syntax Error" << endl;
-        displaySymbolTable();
-    }
-
-    void parseStatement()
+        size_t offset, deleted;
+        string inserted;
+    };
+    vector<Edit> edits; // Applied one by one through an IncrementalSession
+    string cacheDirectory;
+    size_t cacheMegabytes = 64;
+    bool cacheStatistics = false;
+    bool timeTable = false;
+    string tracePath;
+    int arg = 1;
+    string serverSocket; // With --connect, the request goes to a --serve process there
+    string request = "compile";
+    vector<string> forwarded; // Compile options, as the server is sent them
+    for (; arg < argc && argv[arg][0] == '-' && argv[arg][1] == '-'; arg++)
     {
-        if (tokens[pos].type == T_INT || tokens[pos].type == T_FLOAT || tokens[pos].type == T_STRING ||
-            tokens[pos].type == T_BOOL)
-        {
-            parseDeclaration();
-        }
-        else if (tokens[pos].type == T_ID)
-        {
-            parseAssignment();
-        }
-        else if (tokens[pos].type == T_IF)
+        int first = arg;
+        if (parseCompileOption(argc, argv, arg, options))
         {
-            parseIfStatement();
+            forwarded.insert(forwarded.end(), argv + first, argv + arg + 1);
+            continue;
         }
-        else if (tokens[pos].type == T_WHILE)
+        string option = argv[arg];
+        if (option == "--serve" && arg + 1 < argc)
+            return serve(argv[arg + 1]);
+        else if (option == "--connect" && arg + 1 < argc)
+            serverSocket = argv[++arg];
+        else if (option == "--check")
+            request = "check";
+        else if (option == "--symbols")
+            request = "symbols";
+        else if (option == "--server-stats")
+            request = "stats";
+        else if (option == "--stop-server")
+            request = "stop";
+        else if (option == "--bench")
+            return runBenchmarks(cout);
+        else if (option == "--check-native" && arg + 1 < argc)
         {
-            parseWhileLoop();
+            size_t programs = 0;
+            if (!parseCount(argv[arg + 1], programs))
+            {
+                cerr << "Error: --check-native expects a number of programs" << endl;
+                return 1;
+            }
+            return checkNative(programs, cout) > 0 ? 1 : 0;
         }
-        else if (tokens[pos].type == T_FOR)
+        else if (option == "--check-edits" && arg + 1 < argc)
         {
-            parseForLoop();
+            size_t programs = 0;
+            if (!parseCount(argv[arg + 1], programs))
+            {
+                cerr << "Error: --check-edits expects a number of programs" << endl;
+                return 1;
+            }
+            return checkEdits(programs, cout) > 0 ? 1 : 0;
         }
-        else if (tokens[pos].type == T_RETURN)
+        else if (option == "--check-lex-threads" && arg + 1 < argc)
         {
-            parseReturnStatement();
+            size_t sources = 0;
+            if (!parseCount(argv[arg + 1], sources))
+            {
+                cerr << "Error: --check-lex-threads expects a number of sources" << endl;
+                return 1;
+            }
+            return checkParallelLexer(sources, cout) > 0 ? 1 : 0;
         }
-        else if (tokens[pos].type == T_LBRACE)
+        else if (option == "--check-tokens" && arg + 1 < argc)
         {
-            parseBlock();
+            size_t sources = 0;
+            if (!parseCount(argv[arg + 1], sources))
+            {
+                cerr << "Error: --check-tokens expects a number of sources" << endl;
+                return 1;
+            }
+            return checkTokenBuffer(sources, cout) > 0 ? 1 : 0;
         }
-        else
+        else if (option == "--scale-bench" && arg + 1 < argc)
         {
-            cout << "Syntax error: unexpected token " << tokens[pos].value
-                 << " on line " << tokens[pos].line << endl;
-            exit(1);
+            uint64_t bytes = 0;
+            if (!parseSize(argv[arg + 1], bytes))
+            {
+                cerr << "Error: --scale-bench expects a size such as 64M" << endl;
+                return 1;
+            }
+            return runScaleBenchmark(bytes, cout);
         }
-    }
-
-    void parseBlock()
-    {
-        expect(T_LBRACE);
-        while (tokens[pos].type != T_RBRACE && tokens[pos].type != T_EOF)
-            parseStatement();
-        expect(T_RBRACE);
-    }
-
-    void addToSymbolTable(string varName, string type)
-    {
-        symbolTable[varName] = type;
-    }
-
-    void parseDeclaration()
-    {
-        string dataType = tokens[pos].value; // Get the data type
-        pos++;                               // Move to the next token
-
-        if (tokens[pos].type == T_ID)
+        else if (option == "--generate" && arg + 2 < argc)
         {
-            string varName = tokens[pos].value;
-            pos++; // Move to the next token
-
-            // Check for duplicate declaration
-            if (symbolTable.find(varName) != symbolTable.end())
+            uint64_t bytes = 0;
+            if (!parseSize(argv[arg + 1], bytes))
             {
-                cout << "Error: Variable '" << varName
-                     << "' is already declared on line " << tokens[pos].line << endl;
-                exit(1);
+                cerr << "Error: --generate expects a size such as 1G" << endl;
+                return 1;
             }
-
-            // Add the variable to the symbol table
-            addToSymbolTable(varName, dataType);
-
-            // Check if there's an assignment during declaration
-            if (tokens[pos].type == T_ASSIGN)
+            if (!writeGeneratedSource(argv[arg + 2], bytes))
             {
-                pos++;
-                parseExpression(); // Handle assignment
+                cerr << "Error: Could not write file " << argv[arg + 2] << endl;
+                return 1;
             }
-
-            expect(T_SEMICOLON); // Ensure semicolon is present
-        }
-        else
-        {
-            cout << "Syntax error: Expected variable name on line "
-                 << tokens[pos].line << endl;
-            exit(1);
+            return 0;
         }
-    }
-
-    void displaySymbolTable()
-    {
-        cout << "\nSymbol Table:\n";
-        cout << "-----------------------------------\n";
-        cout << "| Variable Name |    Data Type   |\n";
-        cout << "-----------------------------------\n";
-        for (const auto &entry : symbolTable)
+        else if (option == "--cache" && arg + 1 < argc)
+            cacheDirectory = argv[++arg];
+        else if (option == "--cache-size" && arg + 1 < argc && parseCount(argv[arg + 1], cacheMegabytes))
+            arg++;
+        else if (option == "--cache-stats")
+            cacheStatistics = true;
+        else if (option == "--time-report")
+            timeTable = true;
+        else if (option == "--trace" && arg + 1 < argc)
+            tracePath = argv[++arg];
+        else if (option == "--jobs" && arg + 1 < argc && parseCount(argv[arg + 1], threads) && threads > 0)
+            arg++;
+        else if (option == "--edit" && arg + 1 < argc)
         {
-            cout << "| " << setw(14) << left << entry.first
-                 << "| " << setw(15) << left << entry.second << "|\n";
-        }
-        cout << "-----------------------------------\n";
-    }
-
-    void parseAssignment()
-    {
-        string varName = tokens[pos].value;
-        pos++;
-
-        if (symbolTable.find(varName) == symbolTable.end())
-        {
-            cout << "Error: Variable '" << varName
-                 << "' is not declared on line " << tokens[pos].line << endl;
-            exit(1);
+            // OFFSET:LENGTH:TEXT replaces LENGTH bytes at OFFSET with TEXT
+            string spec = argv[++arg];
+            size_t first = spec.find(':'), second = spec.find(':', first + 1);
+            Edit edit{0, 0, ""};
+            if (second == string::npos ||
+                !parseCount(string_view(spec).substr(0, first), edit.offset) ||
+                !parseCount(string_view(spec).substr(first + 1, second - first - 1), edit.deleted))
+            {
+                cerr << "Error: --edit expects OFFSET:LENGTH:TEXT" << endl;
+                return 1;
+            }
+            edit.inserted = spec.substr(second + 1);
+            edits.push_back(edit);
         }
-
-        expect(T_ASSIGN);
-        parseExpression(); // Parse the right-hand side of the assignment
-        expect(T_SEMICOLON);
-    }
-
-    void parseIfStatement()
-    {
-        expect(T_IF);
-        expect(T_LPAREN);
-        parseExpression();
-        expect(T_RPAREN);
-        parseStatement();
-        if (tokens[pos].type == T_ELSE)
+        else
         {
-            expect(T_ELSE);
-            parseStatement();
+            cerr << "Usage: " << argv[0] << " [--dump-ast] [--dump-ir] [--dump-bytecode] [--optimize] [--emit-asm FILE] [--run] [--jit] [--engine tree|vm|jit] [--bench] [--check-native N] [--check-edits N] [--check-lex-threads N] [--check-tokens N] [--scale-bench SIZE] [--generate SIZE FILE] [--max-errors N] [--jobs N] [--lex-threads N] "
+                 << "[--cache DIR] [--cache-size MB] [--cache-stats] [--time-report] [--trace FILE] "
+                 << "[--edit OFFSET:LENGTH:TEXT]... [--serve SOCKET] "
+                 << "[--connect SOCKET [--check | --symbols | --server-stats | --stop-server]] "
+                 << "[filename | - | file... | directory...]" << endl;
+            return 1;
         }
     }
 
-    void parseWhileLoop()
-    {
-        expect(T_WHILE);
-        expect(T_LPAREN);
-        parseExpression();
-        expect(T_RPAREN);
-        parseStatement();
-    }
-
-    void parseForLoop()
-    {
-        expect(T_FOR);
-        expect(T_LPAREN);
-        // For now, we'll only support a simple for loop structure: for (init; condition; increment)
-        expect(T_ID); // Assume init is a variable declaration for simplicity
-        expect(T_ASSIGN);
-        parseExpression();
-        expect(T_SEMICOLON);
-        parseExpression(); // condition
-        expect(T_SEMICOLON);
-        expect(T_ID); // Assume increment is a variable name
-        expect(T_ASSIGN);
-        parseExpression();
-        expect(T_RPAREN);
-        parseStatement();
-    }
-
-    void parseReturnStatement()
+    if (!serverSocket.empty())
     {
-        expect(T_RETURN);
-        parseExpression();
-        expect(T_SEMICOLON);
-    }
-
-    void parseExpression()
-    {
-        parseTerm();
-        while (tokens[pos].type == T_PLUS || tokens[pos].type == T_MINUS)
+        bool needsFile = request != "stats" && request != "stop";
+        if (!edits.empty() || !cacheDirectory.empty() || timeTable || !tracePath.empty())
         {
-            pos++;
-            parseTerm();
+            cerr << "Error: --edit, --cache, --time-report and --trace do not work with --connect" << endl;
+            return 1;
         }
-        // Handle logical expressions
-        while (tokens[pos].type == T_LOGICAL_AND || tokens[pos].type == T_LOGICAL_OR)
+        if (argc - arg != (needsFile ? 1 : 0) || (needsFile && string(argv[arg]) == "-"))
         {
-            pos++;
-            parseTerm();
+            cerr << "Error: --connect " << (needsFile ? "takes one file" : "takes no file") << endl;
+            return 1;
         }
+        if (needsFile)
+            forwarded.push_back(argv[arg]);
+        return askServer(serverSocket, request, forwarded, cout);
     }
-
-    void parseTerm()
+    if (request != "compile")
     {
-        parseFactor();
-        while (tokens[pos].type == T_MUL || tokens[pos].type == T_DIV)
-        {
-            pos++;
-            parseFactor();
-        }
+        cerr << "Error: --check, --symbols, --server-stats and --stop-server need --connect" << endl;
+        return 1;
     }
 
-    void parseFactor()
-    {
-        if (tokens[pos].type == T_NUM || tokens[pos].type == T_ID)
-        {
-            pos++;
-        }
-        else if (tokens[pos].type == T_LPAREN)
-        {
-            expect(T_LPAREN);
-            parseExpression();
-            expect(T_RPAREN);
-        }
-        else
-        {
-            cout << "Syntax error: unexpected token " << tokens[pos].value
-                 << " on line " << tokens[pos].line << endl;
-            exit(1);
-        }
-    }
+#ifndef NO_TIME_REPORT
+    if (timeTable || !tracePath.empty())
+        timeReport.start();
+#else
+    if (timeTable || !tracePath.empty())
+        cerr << "Warning: built with NO_TIME_REPORT, so there are no timings to report" << endl;
+#endif
 
-    void expect(TokenType type)
+    unique_ptr<CompileCache> cache;
+    if (!cacheDirectory.empty() && cacheMegabytes > 0) // --cache-size 0 turns the cache off
     {
-        if (tokens[pos].type == type)
-        {
-            pos++;
-        }
-        else
+        cache = make_unique<CompileCache>(cacheDirectory, uint64_t(cacheMegabytes) << 20);
+        if (!cache->open())
         {
-            cout << "Syntax error: expected " << type << " but found "
-                 << tokens[pos].value << " on line " << tokens[pos].line << endl;
-            exit(1);
+            cerr << "Error: Could not create cache directory " << cacheDirectory << endl;
+            return 1;
         }
+        options.cache = cache.get();
     }
-};
-
-class Lexer
-{
-private:
-    string src;
-    size_t pos;
-
-public:
-    Lexer(const string &src) : src(src), pos(0) {}
-
-    string consumeNumber()
-    {
-        size_t start = pos;
-        bool hasDecimal = false;
-
-        while (pos < src.size() && (isdigit(src[pos]) || src[pos] == '.'))
+    auto finish = [&](bool succeeded) {
+        if (cache)
+            cache->saveStatistics(cacheStatistics ? &cerr : nullptr);
+#ifndef NO_TIME_REPORT
+        if (timeTable)
+            timeReport.printTable(cerr);
+        if (!tracePath.empty())
         {
-            if (src[pos] == '.')
+            ofstream trace(tracePath);
+            timeReport.writeTrace(trace);
+            if (!trace)
             {
-                if (hasDecimal)
-                    break;
-                hasDecimal = true;
+                cerr << "Error: Could not write file " << tracePath << endl;
+                return 1;
             }
-            pos++;
         }
-
-        return src.substr(start, pos - start);
-    }
-
-    string consumeWord()
+#endif
+        return succeeded ? 0 : 1;
+    };
+
+    // Directories are searched recursively and their files taken in path order
+    vector<string> paths;
+    bool hasDirectory = false;
+    for (int i = arg; i < argc; i++)
     {
-        size_t start = pos;
-
-        while (pos < src.size() && (isalnum(src[pos]) || src[pos] == '_'))
-            pos++;
-
-        return src.substr(start, pos - start);
-    }
-
-    string consumeString()
-    {
-        size_t start = ++pos; // Skip the opening quote (")
-        while (pos < src.size() && src[pos] != '"')
+        error_code error;
+        if (!filesystem::is_directory(argv[i], error))
         {
-            if (src[pos] == '\\' && pos + 1 < src.size())
-            {             // Handle escape sequences
-                pos += 2; // Skip the escape character and the next character
-                continue;
-            }
-            pos++; // Consume the character
+            paths.push_back(argv[i]);
+            continue;
+        }
+        hasDirectory = true;
+        vector<string> found;
+        for (const filesystem::directory_entry &entry : filesystem::recursive_directory_iterator(argv[i], error))
+        {
+            if (entry.is_regular_file(error))
+                found.push_back(entry.path().string());
         }
-        return src.substr(start, pos++ - start - 1); // Skip the closing quote
+        sort(found.begin(), found.end());
+        paths.insert(paths.end(), found.begin(), found.end());
     }
-
-    Token nextToken()
+    if (paths.size() > 1 || hasDirectory)
     {
-        while (pos < src.size() && isspace(src[pos]))
-            pos++;
-
-        if (pos == src.size())
-            return {T_EOF, "", 0};
-
-        char current = src[pos];
-
-        if (isdigit(current))
-            return {T_NUM, consumeNumber(), 1}; // Line number is hardcoded for simplicity
-        else if (isalpha(current) || current == '_')
+        if (!edits.empty())
         {
-            string word = consumeWord();
-            if (word == "int")
-                return {T_INT, word, 1};
-            else if (word == "float")
-                return {T_FLOAT, word, 1};
-            else if (word == "string")
-                return {T_STRING, word, 1};
-            else if (word == "bool")
-                return {T_BOOL, word, 1};
-            else if (word == "if")
-                return {T_IF, word, 1};
-            else if (word == "else")
-                return {T_ELSE, word, 1};
-            else if (word == "return")
-                return {T_RETURN, word, 1};
-            else if (word == "while")
-                return {T_WHILE, word, 1};
-            else if (word == "for")
-                return {T_FOR, word, 1};
-            return {T_ID, word, 1};
+            cerr << "Error: --edit works on a single file" << endl;
+            return 1;
         }
-        else if (current == '"')
-            return {T_STRING, consumeString(), 1};
-
-        // Handle operators and punctuation
-        switch (current)
-        {
-        case '=':
-            return {T_ASSIGN, "=", 1};
-        case '+':
-            return {T_PLUS, "+", 1};
-        case '-':
-            return {T_MINUS, "-", 1};
-        case '*':
-            return {T_MUL, "*", 1};
-        case '/':
-            return {T_DIV, "/", 1};
-        case '(':
-            return {T_LPAREN, "(", 1};
-        case ')':
-            return {T_RPAREN, ")", 1};
-        case '{':
-            return {T_LBRACE, "{", 1};
-        case '}':
-            return {T_RBRACE, "}", 1};
-        case ';':
-            return {T_SEMICOLON, ";", 1};
-        case '>':
-            return {T_GT, ">", 1};
-        case '<':
-            return {T_LT, "<", 1};
-        case '!':
-            if (src[pos + 1] == '=')
-            {
-                pos += 2; // Skip '!='
-                return {T_NEQ, "!=", 1};
-            }
-            break;
-        case '&':
-            if (src[pos + 1] == '&')
-            {
-                pos += 2; // Skip '&&'
-                return {T_LOGICAL_AND, "&&", 1};
-            }
-            break;
-        case '|':
-            if (src[pos + 1] == '|')
-            {
-                pos += 2; // Skip '||'
-                return {T_LOGICAL_OR, "||", 1};
-            }
-            break;
-        case '\0':
-            return {T_EOF, "", 1}; // End of file
-        }
-
-        cout << "Error: Unrecognized character '" << current << "' on line 1." << endl;
-        exit(1);
+        return finish(compileFiles(paths, threads, options) == 0);
     }
 
-    vector<Token> tokenize()
+    SourceFile file;
+    bool fromFile = arg < argc;
+    if (fromFile && !openSource(file, argv[arg]))
     {
-        vector<Token> tokenList;
-        Token token;
-        do
-        {
-            token = nextToken();
-            tokenList.push_back(token);
-        } while (token.type != T_EOF);
-        return tokenList;
+        cerr << "Error: Could not open file " << argv[arg] << endl;
+        return 1;
     }
-};
 
-int main()
-{
     string sourceCode = R"(
     int x;
     float y; 
     string name; 
     x = 5; 
     y = 4.5; 
-    name = \"test\"; 
+    name = "test"; 
     if (x > y) 
-    { return; } 
+    { return x; } 
     else { x = y; }
     )";
-    Lexer lexer(sourceCode);
-    vector<Token> tokens = lexer.tokenize();
+    string_view source = fromFile ? file.text() : string_view(sourceCode);
+    StringInterner names;
+    TypeTable types;
 
-    Parser parser(tokens);
-    parser.parseProgram();
+    if (!edits.empty())
+    {
+        // Parse once, then bring the tree up to date after each edit, as an editor would
+        IncrementalSession session(string(source), names, types, options.maxErrors);
+        for (const Edit &edit : edits)
+        {
+            auto start = chrono::steady_clock::now();
+            pair<size_t, size_t> work = session.edit(edit.offset, edit.deleted, edit.inserted);
+            auto micros = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+            cerr << "Edit at " << edit.offset << ": re-lexed " << work.first << " tokens, re-parsed "
+                 << work.second << " statements in " << micros << " us" << endl;
+        }
+        if (session.errors().count() > 0)
+        {
+            session.errors().report();
+            return finish(false);
+        }
+        cout << "Parsing completed successfully! No Syntax Error" << endl;
+        session.currentParser().displaySymbolTable();
+        if (options.dumpAst)
+            session.tree().dump(session.root(), names, types, session.lines());
+        return finish(runBackend(session.tree(), names, session.lines(), session.root(), options, cout));
+    }
 
-    return 0;
+    CompileArena arena;
+    return finish(compileSource(source, options, arena, cout));
 }
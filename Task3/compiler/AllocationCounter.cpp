@@ -0,0 +1,26 @@
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "TimeReport.h"
+
+thread_local uint64_t allocationCount = 0;
+thread_local uint64_t allocationBytes = 0;
+
+// Replacing the global operator new slows down every allocation of the
+// process, so only benchmark builds do it: compile with -DCOUNT_ALLOCATIONS
+// for --bench and --time-report to show allocations per phase.
+#ifdef COUNT_ALLOCATIONS
+void *operator new(std::size_t size)
+{
+    allocationCount++;
+    allocationBytes += size;
+    if (void *memory = std::malloc(size > 0 ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+// Not inlined, or GCC takes the free() for a mismatch with the built-in new
+__attribute__((noinline)) void operator delete(void *memory) noexcept { std::free(memory); }
+__attribute__((noinline)) void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+#endif
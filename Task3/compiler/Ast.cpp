@@ -0,0 +1,102 @@
+#include "Ast.h"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+uint32_t Ast::add(NodeKind kind, uint32_t offset, TypeId type)
+{
+    if ((count >> CHUNK_BITS) == chunks.size())
+        chunks.emplace_back(new Node[1u << CHUNK_BITS]);
+    Node &node = (*this)[count];
+    node.kind = kind;
+    node.op = T_EOF;
+    node.offset = offset;
+    node.type = type;
+    node.a = node.b = node.c = NO_NODE;
+    node.intValue = 0;
+    return count++;
+}
+
+void Ast::append(const Node *nodes, uint32_t length)
+{
+    const uint32_t CHUNK = 1u << CHUNK_BITS;
+    while (length > 0)
+    {
+        if ((count >> CHUNK_BITS) == chunks.size())
+            chunks.emplace_back(new Node[CHUNK]);
+        uint32_t room = min(length, CHUNK - (count & (CHUNK - 1)));
+        memcpy(&(*this)[count], nodes, room * sizeof(Node));
+        nodes += room;
+        length -= room;
+        count += room;
+    }
+}
+
+void Ast::dump(uint32_t index, const StringInterner &names, const TypeTable &types, LineIndex &lines,
+               ostream &out) const
+{
+    static const char *const kindNames[] = {"Program", "Block", "Decl", "Assign", "If", "While",
+                                            "For", "Return", "Binary", "Unary", "Number", "String", "Name", "Error"};
+    static const string indent(MAX_DUMP_INDENT * 2, ' ');
+
+    // A chain of operators is as deep as the program is long, so the walk
+    // keeps its own stack, with the children pushed last first
+    struct Pending
+    {
+        uint32_t node, depth;
+        uint32_t base; // Start of the top-level statement the node is in
+    };
+    vector<Pending> pending;
+    if (index != NO_NODE)
+        pending.push_back({index, 0, 0});
+    while (!pending.empty())
+    {
+        auto [at, depth, base] = pending.back();
+        pending.pop_back();
+        const Node &node = (*this)[at];
+        out.write(indent.data(), min<size_t>(depth, MAX_DUMP_INDENT) * 2);
+        if (depth > MAX_DUMP_INDENT)
+            out << "[" << depth << "] ";
+        out << kindNames[node.kind];
+        if (node.kind == N_DECL || node.kind == N_ASSIGN || node.kind == N_NAME)
+            out << " " << names.name(node.symbol);
+        else if (node.kind == N_STRING)
+            out << " \"" << names.name(node.symbol) << "\"";
+        else if (node.kind == N_NUMBER && node.type == TYPE_FLOAT)
+            out << " " << node.floatValue;
+        else if (node.kind == N_NUMBER)
+            out << " " << node.intValue;
+        else if (node.kind == N_BINARY || node.kind == N_UNARY)
+            out << " " << operatorText(node.op);
+        out << " : " << types.name(node.type) << " (line " << lines.line(base + node.offset) << ")\n";
+
+        // Children; the declarations that names and assignments refer to are not children
+        auto push = [&](uint32_t child) {
+            if (child != NO_NODE)
+                pending.push_back({child, depth + 1, base});
+        };
+        if (node.kind == N_PROGRAM)
+        {
+            for (uint32_t i = node.b; i > 0; i--)
+                pending.push_back({statements(node)[i - 1], depth + 1, statementStarts(node)[i - 1]});
+            continue;
+        }
+        if (node.kind == N_BLOCK)
+        {
+            for (uint32_t i = node.b; i > 0; i--)
+                push(statements(node)[i - 1]);
+            continue;
+        }
+        if (node.kind == N_FOR)
+            push(node.body);
+        push(node.c);
+        if (node.kind != N_ASSIGN)
+            push(node.b);
+        if (node.kind != N_NAME)
+            push(node.a);
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef COMPILER_AST_H
+#define COMPILER_AST_H
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "Token.h"
+#include "Diagnostics.h"
+
+// Abstract syntax tree. Nodes live in an arena of fixed-size chunks and refer
+// to each other by 32-bit index, so building the tree is a bump allocation per
+// node and throwing it away is a single reset() that keeps the chunks for the
+// next parse. The statements of a block are stored contiguously in lists.
+// A node keeps the byte offset of where it is in the source, counted from the
+// start of the top-level statement it belongs to, so an edit only moves the
+// statement starts the program lists; lines are looked up when they are needed.
+enum NodeKind : uint8_t
+{
+    N_PROGRAM, // a = start of the statements in lists, b = statement count, c = start of their source offsets
+    N_BLOCK,   // a = start of the statements in lists, b = statement count
+    N_DECL,    // symbol = name, type = declared type, a = initializer or NO_NODE
+    N_ASSIGN,  // symbol = name, a = value, b = declaration or NO_NODE
+    N_IF,      // a = condition, b = then branch, c = else branch or NO_NODE
+    N_WHILE,   // a = condition, b = body
+    N_FOR,     // a = init assignment, b = condition, c = step assignment, body = body
+    N_RETURN,  // a = value or NO_NODE
+    N_BINARY,  // op = operator, a = left, b = right
+    N_UNARY,   // op = T_MINUS or T_NOT, a = operand
+    N_NUMBER,  // intValue or floatValue, chosen by type
+    N_STRING,  // symbol = interned text
+    N_NAME,    // symbol = name, a = declaration or NO_NODE
+    N_ERROR    // Stands in for a statement or operand that failed to parse
+};
+
+struct Node
+{
+    NodeKind kind;
+    TokenType op; // Operator of N_BINARY and N_UNARY
+    uint32_t offset; // Past the start of its top-level statement; the program's is from the start of the source
+    TypeId type;  // Declared type of N_DECL and N_ASSIGN targets, result type of expressions
+    uint32_t a, b, c;
+    union
+    {
+        int64_t intValue;
+        double floatValue;
+        uint32_t symbol;
+        uint32_t body;
+    };
+};
+
+static_assert(sizeof(Node) == 32, "Node should stay half a cache line");
+
+class Ast
+{
+private:
+    static const uint32_t CHUNK_BITS = 12; // 4096 nodes (128 KiB) per chunk
+    static const uint32_t MAX_DUMP_INDENT = 40;
+
+    std::vector<std::unique_ptr<Node[]>> chunks;
+    uint32_t count = 0;
+    std::vector<uint32_t> lists; // Statement lists of blocks, each one contiguous
+
+public:
+    uint32_t add(NodeKind kind, uint32_t offset, TypeId type = TYPE_VOID);
+
+    Node &operator[](uint32_t index) { return chunks[index >> CHUNK_BITS][index & ((1u << CHUNK_BITS) - 1)]; }
+    const Node &operator[](uint32_t index) const { return chunks[index >> CHUNK_BITS][index & ((1u << CHUNK_BITS) - 1)]; }
+
+    uint32_t size() const { return count; }
+
+    // Bytes held by the chunks and statement lists, including what is kept for reuse
+    size_t memoryUsed() const
+    {
+        return chunks.size() * (sizeof(Node) << CHUNK_BITS) + lists.capacity() * sizeof(uint32_t);
+    }
+
+    // Copies length finished nodes in after the last one, as CompileCache
+    // restores a tree
+    void append(const Node *nodes, uint32_t length);
+
+    // Stores a statement list and returns where it starts
+    uint32_t addList(const uint32_t *items, uint32_t length)
+    {
+        uint32_t start = uint32_t(lists.size());
+        lists.insert(lists.end(), items, items + length);
+        return start;
+    }
+
+    // Every statement list, back to back
+    const std::vector<uint32_t> &statementLists() const { return lists; }
+
+    // Statements of an N_PROGRAM or N_BLOCK node
+    const uint32_t *statements(const Node &block) const { return lists.data() + block.a; }
+    uint32_t *statements(const Node &block) { return lists.data() + block.a; }
+
+    // Source offsets where the statements of an N_PROGRAM node start
+    const uint32_t *statementStarts(const Node &program) const { return lists.data() + program.c; }
+    uint32_t *statementStarts(const Node &program) { return lists.data() + program.c; }
+
+    // Frees every node at once; the chunks are kept for the next tree
+    void reset()
+    {
+        count = 0;
+        lists.clear();
+    }
+
+    // Prints the subtree under index, one node per line, for --dump-ast. Lines
+    // are indented two spaces per level up to MAX_DUMP_INDENT levels; deeper
+    // ones start with their depth in brackets, so the output stays linear.
+    void dump(uint32_t index, const StringInterner &names, const TypeTable &types, LineIndex &lines,
+              std::ostream &out = std::cout) const;
+};
+
+#endif
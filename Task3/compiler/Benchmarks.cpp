@@ -0,0 +1,876 @@
+#include "Benchmarks.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "Token.h"
+#include "Compile.h"
+#include "Ast.h"
+#include "Diagnostics.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Bytecode.h"
+#include "TreeInterpreter.h"
+#include "Ir.h"
+#include "IrLowering.h"
+#include "X86.h"
+#include "Generators.h"
+#include "ParallelLexer.h"
+#include "IncrementalSession.h"
+
+using namespace std;
+
+// Workloads for --bench
+struct Benchmark
+{
+    string name;
+    string source;
+};
+
+static const Benchmark loopBenchmarks[] = {
+    {"nested while", R"(
+        int i; int j; int sum;
+        while (i < 1000)
+        {
+            j = 0;
+            while (j < 1000) { sum = sum + i * j / 7; j = j + 1; }
+            i = i + 1;
+        }
+        return sum;
+    )"},
+    {"for, float", R"(
+        int i; float x; float s;
+        for (i = 0; i < 1000000; i = i + 1) { x = x + 0.5; s = s + x / (i + 1); }
+        return s;
+    )"},
+    {"collatz", R"(
+        int k; int n; int steps;
+        for (k = 1; k < 20000; k = k + 1)
+        {
+            n = k;
+            while (n > 1)
+            {
+                if (n - n / 2 * 2 == 0) n = n / 2; else n = 3 * n + 1;
+                steps = steps + 1;
+            }
+        }
+        return steps;
+    )"},
+    {"bool logic", R"(
+        int i; int hits; bool a;
+        for (i = 0; i < 1000000; i = i + 1)
+        {
+            a = i / 3 * 3 == i || i / 5 * 5 == i;
+            if (a && !(i / 15 * 15 == i)) hits = hits + 1;
+        }
+        return hits;
+    )"},
+    {"strings", R"(
+        int i; int n; string s;
+        for (i = 0; i < 300000; i = i + 1)
+        {
+            s = "ab";
+            if (s + "cd" == "abcd") n = n + 1;
+        }
+        return n;
+    )"},
+};
+
+// Builds a random int expression with 2^depth leaves over a, b, i and small
+// constants. The generator is seeded, so a workload is the same every run.
+static string randomExpression(int depth, uint32_t &seed)
+{
+    auto next = [&](uint32_t range) {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 16) % range;
+    };
+    if (depth == 0)
+    {
+        static const char *const leaves[] = {"a", "b", "i"};
+        return next(4) == 0 ? to_string(1 + next(99)) : string(leaves[next(3)]);
+    }
+    string left = randomExpression(depth - 1, seed);
+    uint32_t choice = next(4);
+    if (choice == 3) // Divides by a constant only, so it never faults
+        return "(" + left + ") / " + to_string(2 + next(8));
+    static const char *const operators[] = {" + ", " - ", " * "};
+    return "(" + left + operators[choice] + randomExpression(depth - 1, seed) + ")";
+}
+
+// The fixed loop programs plus generated workloads: deeply nested loops,
+// long arithmetic expressions and thousands of live variables
+static vector<Benchmark> benchmarkWorkloads()
+{
+    vector<Benchmark> workloads(begin(loopBenchmarks), end(loopBenchmarks));
+
+    workloads.push_back({"nested loops", "int i; int j; int k; int l; int sum;\n"
+                                         "for (i = 0; i < 30; i = i + 1)\n"
+                                         "    for (j = 0; j < 30; j = j + 1)\n"
+                                         "        for (k = 0; k < 30; k = k + 1)\n"
+                                         "            for (l = 0; l < 30; l = l + 1)\n"
+                                         "                sum = sum + i * j - k / (l + 1);\n"
+                                         "return sum;\n"});
+
+    uint32_t seed = 2024;
+    string arithmetic = "int i; int a = 3; int b = 5; float x; float y;\n"
+                        "for (i = 0; i < 20000; i = i + 1)\n{\n";
+    for (int statement = 0; statement < 4; statement++)
+    {
+        arithmetic += "    a = " + randomExpression(4, seed) + ";\n";
+        arithmetic += "    b = " + randomExpression(4, seed) + ";\n";
+        arithmetic += "    x = (" + randomExpression(3, seed) + ") * 0.5 + y * 0.25;\n";
+        arithmetic += "    y = x / 3 - (" + randomExpression(3, seed) + ") * 0.125;\n";
+    }
+    workloads.push_back({"arithmetic", arithmetic + "}\nreturn a + b + x + y;\n"});
+
+    const int variables = 2000;
+    string many = "int r;\n";
+    for (int v = 0; v < variables; v++)
+        many += "int v" + to_string(v) + " = " + to_string(v) + ";\n";
+    many += "for (r = 0; r < 100; r = r + 1)\n{\n    v0 = v0 + r;\n";
+    for (int v = 1; v < variables; v++)
+        many += "    v" + to_string(v) + " = v" + to_string(v - 1) + " + v" + to_string(v * 7919 % variables) + " - " +
+                to_string(v) + ";\n";
+    workloads.push_back({"many variables", many + "}\nreturn v" + to_string(variables - 1) + ";\n"});
+    return workloads;
+}
+
+struct PhaseStats
+{
+    double milliseconds;
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+    long peakRssKb; // High-water mark of the process so far; 0 where it cannot be read
+};
+
+template <typename Work>
+PhaseStats measurePhase(Work work)
+{
+    uint64_t count = allocationCount, bytes = allocationBytes;
+    auto start = chrono::steady_clock::now();
+    work();
+    PhaseStats stats;
+    stats.milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    stats.allocations = allocationCount - count;
+    stats.allocatedBytes = allocationBytes - bytes;
+    stats.peakRssKb = 0;
+#ifndef _WIN32
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        stats.peakRssKb = usage.ru_maxrss;
+#endif
+    return stats;
+}
+
+static void printPhase(ostream &out, const string &workload, const char *engine, const char *phase,
+                       const PhaseStats &stats)
+{
+    out << left << setw(16) << workload << setw(7) << engine << setw(9) << phase << right << fixed << setprecision(1)
+        << setw(10) << stats.milliseconds;
+    if (allocationsCounted)
+        out << setw(10) << stats.allocations << setw(10) << stats.allocatedBytes / 1024;
+    else
+        out << setw(10) << "-" << setw(10) << "-";
+    out << setw(10) << stats.peakRssKb << defaultfloat << setprecision(6);
+}
+
+// Runs one workload on one engine, printing a row per phase, and returns
+// what the program returned. With optimize the VM runs the code lowered
+// from the optimized Ir; the JIT always compiles that Ir.
+static string benchmarkEngine(const Benchmark &benchmark, ExecutionEngine engine, bool optimize, ostream &out)
+{
+    const char *engineName = engine == ENGINE_TREE ? "tree" : engine == ENGINE_JIT ? "jit" : optimize ? "vm -O" : "vm";
+    StringInterner names;
+    TypeTable types;
+    Ast ast;
+    Diagnostics diagnostics(benchmark.source, 0);
+    LineIndex &lines = diagnostics.lineIndex();
+    uint32_t program = NO_NODE;
+    PhaseStats parse = measurePhase([&] {
+        Lexer lexer(benchmark.source, names, diagnostics);
+        TokenStream stream(lexer);
+        ostream discard(nullptr); // The symbol table is not part of the report
+        program = Parser(stream, names, types, ast, diagnostics).parseProgram(discard);
+    });
+    printPhase(out, benchmark.name, engineName, "parse", parse);
+    out << "\n";
+    if (diagnostics.count() > 0)
+    {
+        diagnostics.report(out);
+        return "does not compile";
+    }
+
+    Bytecode bytecode;
+    JitCode native;
+    bool lowered = true, nativeCode = false;
+    if (engine == ENGINE_JIT || (engine == ENGINE_BYTECODE && optimize))
+    {
+        Ir ir;
+        PhaseStats optimizing = measurePhase([&] {
+            lowered = IrBuilder(ast, names, lines, ir).build(program);
+            PassManager::standard().run(ir);
+        });
+        printPhase(out, benchmark.name, engineName, "optimize", optimizing);
+        out << "\n";
+        if (engine == ENGINE_JIT)
+        {
+            PhaseStats compile = measurePhase([&] { nativeCode = lowered && native.compile(ir); });
+            printPhase(out, benchmark.name, engineName, "compile", compile);
+            out << (nativeCode ? "\n" : "  not supported, the VM runs it\n");
+        }
+        if (!nativeCode)
+        {
+            PhaseStats lower = measurePhase([&] { IrLowering(ir, bytecode).lower(); });
+            printPhase(out, benchmark.name, engineName, "lower", lower);
+            out << "\n";
+        }
+    }
+    else if (engine == ENGINE_BYTECODE)
+    {
+        PhaseStats lower = measurePhase([&] { lowered = BytecodeCompiler(ast, names, lines, bytecode).compileProgram(program); });
+        printPhase(out, benchmark.name, engineName, "lower", lower);
+        out << "\n";
+    }
+    if (!lowered)
+        return "does not compile";
+
+    RunResult result;
+    PhaseStats run = measurePhase([&] {
+        result = nativeCode                 ? native.run()
+                 : engine == ENGINE_TREE ? TreeInterpreter(ast, names, lines).run(program)
+                                         : execute(bytecode);
+    });
+    printPhase(out, benchmark.name, engineName, "execute", run);
+    string value = result.error.empty() ? returnedText(result) : result.error;
+    out << setw(12) << result.executed << setw(10) << fixed << setprecision(1)
+        << result.executed / run.milliseconds / 1e3 << defaultfloat << setprecision(6) << "  " << value << endl;
+    return value;
+}
+
+// Runs work in a child process, so that peak RSS is its own, and returns the
+// string it produced. Where there is no fork() it just runs here.
+template <typename Work>
+string runIsolated(Work work)
+{
+#ifndef _WIN32
+    cout.flush();
+    int channel[2];
+    if (pipe(channel) == 0)
+    {
+        pid_t child = fork();
+        if (child == 0)
+        {
+            close(channel[0]);
+            string text = work();
+            cout.flush();
+            for (size_t written = 0; written < text.size();)
+            {
+                ssize_t count = write(channel[1], text.data() + written, text.size() - written);
+                if (count <= 0)
+                    break;
+                written += size_t(count);
+            }
+            _exit(0);
+        }
+        close(channel[1]);
+        string text;
+        char buffer[4096];
+        ssize_t count;
+        while (child > 0 && (count = read(channel[0], buffer, sizeof buffer)) > 0)
+            text.append(buffer, size_t(count));
+        close(channel[0]);
+        if (child > 0)
+        {
+            waitpid(child, nullptr, 0);
+            return text;
+        }
+    }
+#endif
+    return work();
+}
+
+int runBenchmarks(ostream &out)
+{
+    out << left << setw(16) << "Workload" << setw(7) << "Engine" << setw(9) << "Phase" << right << setw(10) << "ms"
+        << setw(10) << "Allocs" << setw(10) << "Alloc KB" << setw(10) << "Peak KB" << setw(12) << "Steps"
+        << setw(10) << "M/s" << "  Result\n";
+    bool agree = true;
+    for (const Benchmark &benchmark : benchmarkWorkloads())
+    {
+        string tree = runIsolated([&] { return benchmarkEngine(benchmark, ENGINE_TREE, false, out); });
+        string vm = runIsolated([&] { return benchmarkEngine(benchmark, ENGINE_BYTECODE, false, out); });
+        string optimized = runIsolated([&] { return benchmarkEngine(benchmark, ENGINE_BYTECODE, true, out); });
+        string jit = runIsolated([&] { return benchmarkEngine(benchmark, ENGINE_JIT, true, out); });
+        if (tree != vm || tree != optimized || tree != jit)
+        {
+            out << "Engines disagree on " << benchmark.name << ": " << tree << " vs " << vm << " vs " << optimized
+                << " vs " << jit << endl;
+            agree = false;
+        }
+    }
+    out << "Steps are tree nodes visited or VM instructions executed; the JIT does not count them." << endl;
+    return agree ? 0 : 1;
+}
+
+size_t checkNative(size_t count, ostream &out)
+{
+#ifndef _WIN32
+    string pattern = (filesystem::temp_directory_path() / "native-XXXXXX").string();
+    if (!mkdtemp(pattern.data()))
+    {
+        out << "Error: could not create a temporary directory" << endl;
+        return count;
+    }
+    string binary = pattern + "/program", assemblyPath = binary + ".s";
+    // The sign of a NaN is not specified, and printf shows it
+    auto withoutNanSign = [](string text) {
+        for (size_t at; (at = text.find("-nan")) != string::npos;)
+            text.erase(at, 1);
+        return text;
+    };
+    size_t failed = 0;
+    for (uint32_t seed = 1; seed <= count; seed++)
+    {
+        string source = ProgramGenerator(seed).program();
+        StringInterner names;
+        TypeTable types;
+        Ast ast;
+        Diagnostics diagnostics(source, 0);
+        LineIndex &lines = diagnostics.lineIndex();
+        Lexer lexer(source, names, diagnostics);
+        TokenStream stream(lexer);
+        ostream discard(nullptr);
+        uint32_t program = Parser(stream, names, types, ast, diagnostics).parseProgram(discard);
+        Bytecode bytecode;
+        Ir ir;
+        if (diagnostics.count() > 0 || !BytecodeCompiler(ast, names, lines, bytecode).compileProgram(program) ||
+            !IrBuilder(ast, names, lines, ir).build(program))
+        {
+            out << "Program " << seed << " does not compile:\n" << source;
+            diagnostics.report(out);
+            failed++;
+            continue;
+        }
+        if (seed % 2 == 0)
+            PassManager::standard().run(ir);
+        RunResult result = execute(bytecode);
+        ostringstream expected;
+        printRunResult(result, expected);
+        int expectedStatus = !result.error.empty() ? 1
+                             : result.returned && bankOf(result.type) == BANK_INT ? int(result.intValue & 255)
+                                                                                   : 0;
+        JitCode native;
+        ostringstream jitted;
+        if (native.compile(ir))
+            printRunResult(native.run(), jitted);
+        if (withoutNanSign(jitted.str()) != withoutNanSign(expected.str()))
+        {
+            out << "Program " << seed << (seed % 2 == 0 ? " (optimized)" : "") << " printed\n" << jitted.str()
+                << "on the JIT instead of\n" << expected.str() << source;
+            failed++;
+            continue;
+        }
+
+        X86Emitter emitter(ir);
+        emitter.compile();
+        {
+            ofstream assembly(assemblyPath);
+            emitter.writeAssembly(assembly);
+        }
+        if (system(("cc -o " + binary + " " + assemblyPath).c_str()) != 0)
+        {
+            out << "Program " << seed << " does not assemble:\n" << source;
+            failed++;
+            continue;
+        }
+        string output;
+        int status = -1;
+        if (FILE *pipe = popen(("ulimit -t 10; " + binary).c_str(), "r")) // A wrong loop would never end
+        {
+            char buffer[4096];
+            for (size_t read; (read = fread(buffer, 1, sizeof buffer, pipe)) > 0;)
+                output.append(buffer, read);
+            status = pclose(pipe);
+        }
+        int exitStatus = status != -1 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        if (withoutNanSign(output) != withoutNanSign(expected.str()) || exitStatus != expectedStatus)
+        {
+            out << "Program " << seed << (seed % 2 == 0 ? " (optimized)" : "") << " exited with " << exitStatus
+                << " and printed\n" << output << "instead of " << expectedStatus << " and\n" << expected.str() << source;
+            failed++;
+        }
+    }
+    filesystem::remove_all(pattern);
+    out << count - failed << " of " << count << " programs agree with the VM" << endl;
+    return failed;
+#else
+    out << "Error: --check-native needs a POSIX system" << endl;
+    return count;
+#endif
+}
+
+// What checkEdits compares: the errors, or the symbol table, the tree and
+// the declarations that names and assignments link to, numbered in tree order
+static string describeSession(IncrementalSession &session, const StringInterner &names, const TypeTable &types)
+{
+    ostringstream out;
+    if (session.errors().count() > 0)
+    {
+        session.errors().report(out);
+        return out.str();
+    }
+    session.currentParser().displaySymbolTable(out);
+    const Ast &ast = session.tree();
+    ast.dump(session.root(), names, types, session.lines(), out);
+    unordered_map<uint32_t, size_t> declarations;
+    vector<uint32_t> links;
+    vector<uint32_t> pending{session.root()};
+    while (!pending.empty())
+    {
+        uint32_t index = pending.back();
+        pending.pop_back();
+        if (index == NO_NODE)
+            continue;
+        const Node &node = ast[index];
+        if (node.kind == N_PROGRAM || node.kind == N_BLOCK)
+        {
+            for (uint32_t i = node.b; i > 0; i--)
+                pending.push_back(ast.statements(node)[i - 1]);
+            continue;
+        }
+        if (node.kind == N_DECL)
+            declarations.emplace(index, declarations.size());
+        else if (node.kind == N_NAME)
+            links.push_back(node.a);
+        else if (node.kind == N_ASSIGN)
+            links.push_back(node.b);
+        if (node.kind == N_FOR)
+            pending.push_back(node.body);
+        pending.push_back(node.c);
+        if (node.kind != N_ASSIGN)
+            pending.push_back(node.b);
+        if (node.kind != N_NAME)
+            pending.push_back(node.a);
+    }
+    out << "Links:";
+    for (uint32_t link : links)
+    {
+        auto found = declarations.find(link);
+        out << ' ' << (link == NO_NODE ? string("-") : found == declarations.end() ? string("?") : to_string(found->second));
+    }
+    out << '\n';
+    return out.str();
+}
+
+size_t checkEdits(size_t count, ostream &out)
+{
+    static const char *const fragments[] = {" ", "x", "int ", "; ", ";", "}", "{", "=", "1", "\"", "else ",
+                                            "+", "i0", "(", ")", "\n", "x0 = 2;", "float x0;", "==", "!"};
+    const int editsPerProgram = 40;
+    uint32_t random = 12345;
+    auto next = [&](uint32_t range) {
+        random = random * 1103515245u + 12345u;
+        return (random >> 16) % range;
+    };
+    size_t failed = 0;
+    for (uint32_t seed = 1; seed <= count; seed++)
+    {
+        size_t maxErrors = seed % 2 == 0 ? 3 : 0;
+        StringInterner names;
+        TypeTable types;
+        IncrementalSession session(ProgramGenerator(seed).program(), names, types, maxErrors);
+        for (int edit = 0; edit < editsPerProgram; edit++)
+        {
+            string before = session.source();
+            size_t offset = next(uint32_t(before.size() + 1));
+            size_t deleted = next(3) == 0 ? min<size_t>(next(6), before.size() - offset) : 0;
+            string inserted = next(4) == 0 ? "" : fragments[next(sizeof fragments / sizeof fragments[0])];
+            session.edit(offset, deleted, inserted);
+
+            StringInterner freshNames;
+            TypeTable freshTypes;
+            IncrementalSession fresh(session.source(), freshNames, freshTypes, maxErrors);
+            string edited = describeSession(session, names, types), parsed = describeSession(fresh, freshNames, freshTypes);
+            if (edited != parsed)
+            {
+                out << "Program " << seed << ", edit " << edit << ": replacing " << deleted << " bytes at " << offset
+                    << " with \"" << inserted << "\" in\n" << before << "\ngave\n" << edited << "instead of\n" << parsed;
+                failed++;
+                break; // Later edits would start from a wrong tree
+            }
+        }
+    }
+    out << count - failed << " of " << count << " programs parse the same incrementally" << endl;
+    return failed;
+}
+
+// Generated code in which two runs of lines in three are quoted into one
+// string literal, for checkParallelLexer. Quotes inside the literal are
+// escaped, or in half of them turned into apostrophes: lexed from a chunk
+// seam, a string with an escaped quote ahead ends where the literal does,
+// while one with none leaves the chunk's tokens out of step with it.
+static string quotedSource(uint32_t seed, size_t bytes)
+{
+    string code, text;
+    SourceGenerator(seed).generate(code, bytes);
+    uint32_t random = seed;
+    auto next = [&](uint32_t range) {
+        random = random * 1103515245u + 12345u;
+        return (random >> 16) % range;
+    };
+    size_t quoted = 0;
+    for (size_t at = 0; at < code.size();)
+    {
+        size_t end = at;
+        for (uint32_t lines = 1 + next(200); lines > 0 && end < code.size(); lines--)
+            end = min(code.find('\n', end), code.size() - 1) + 1;
+        if (next(3) == 0)
+            text.append(code, at, end - at);
+        else
+        {
+            text += "string q" + to_string(quoted++) + " = \"";
+            bool escape = next(2) == 0;
+            for (size_t i = at; i < end; i++)
+            {
+                if (code[i] == '"' && !escape)
+                    text += '\'';
+                else
+                {
+                    if (code[i] == '"' || code[i] == '\\')
+                        text += '\\';
+                    text += code[i];
+                }
+            }
+            text += "\";\n";
+        }
+        if (next(20) == 0)
+            text += "$\n"; // Reported and skipped by the lexer
+        at = end;
+    }
+    if (seed % 4 == 0)
+        text += "string open = \"runs to the end of the file\n";
+    return text;
+}
+
+size_t checkParallelLexer(size_t count, ostream &out)
+{
+    size_t failed = 0;
+    for (uint32_t seed = 1; seed <= count; seed++)
+    {
+        size_t bytes = seed == 1 ? 8 << 20 : 256 << 10;
+        size_t minChunk = seed == 1 ? 1 << 20 : 1 << 10;
+        string text = quotedSource(seed, bytes);
+        StringInterner serialNames;
+        Diagnostics serialErrors(text, 0);
+        TokenBuffer serial;
+        Lexer(text, serialNames, serialErrors).tokenize(serial);
+        ostringstream serialReport;
+        serialErrors.report(serialReport);
+
+        for (size_t threads : {2, 3, 8})
+        {
+            StringInterner names;
+            Diagnostics errors(text, 0);
+            TokenBuffer tokens;
+            tokenizeParallel(text, names, errors, threads, tokens, minChunk);
+            ostringstream report;
+            errors.report(report);
+
+            size_t differs = tokens.size() == serial.size() ? SIZE_MAX : min(tokens.size(), serial.size());
+            for (size_t i = 0; i < min(tokens.size(), serial.size()) && differs == SIZE_MAX; i++)
+            {
+                Token token = tokens.token(i), expected = serial.token(i);
+                if (token.type != expected.type || token.value.data() != expected.value.data() ||
+                    token.value.size() != expected.value.size() || token.symbol != expected.symbol)
+                    differs = i;
+            }
+            if (differs != SIZE_MAX || names.size() != serialNames.size() || report.str() != serialReport.str())
+            {
+                out << "Source " << seed << " (" << text.size() << " bytes) on " << threads << " threads: ";
+                if (differs != SIZE_MAX)
+                    out << tokens.size() << " tokens instead of " << serial.size() << ", the first to differ is "
+                        << differs << "\n";
+                else
+                    out << "names or errors differ\n" << report.str() << "instead of\n" << serialReport.str();
+                failed++;
+                break;
+            }
+        }
+    }
+    out << count - failed << " of " << count << " sources lex the same on several threads" << endl;
+    return failed;
+}
+
+// Index of the first token of buffer that is not the one in expected, or SIZE_MAX if none
+static size_t firstDifferentToken(const TokenBuffer &buffer, const vector<Token> &expected)
+{
+    size_t symbol = 0;
+    for (size_t i = 0; i < min(buffer.size(), expected.size()); i++)
+    {
+        Token token = buffer.token(i, symbol);
+        symbol = buffer.nextSymbolIndex(i, symbol);
+        if (token.type != expected[i].type || token.value.data() != expected[i].value.data() ||
+            token.value.size() != expected[i].value.size() || token.symbol != expected[i].symbol ||
+            buffer.start(i) != buffer.startOf(expected[i]))
+            return i;
+    }
+    return buffer.size() == expected.size() ? SIZE_MAX : min(buffer.size(), expected.size());
+}
+
+size_t checkTokenBuffer(size_t count, ostream &out)
+{
+    static const char *const insertions[] = {"\"", "$", "\\", "12.5", "007", "Agar ", "double ", "==",
+                                             "x1", "\"\\\"\"", "\n"};
+    uint32_t random = 54321;
+    auto next = [&](uint32_t range) {
+        random = random * 1103515245u + 12345u;
+        return (random >> 16) % range;
+    };
+    size_t failed = 0;
+    for (uint32_t seed = 1; seed <= count; seed++)
+    {
+        string text;
+        SourceGenerator(seed).generate(text, 64 << 10);
+        for (size_t i = text.size() / 1024; i > 0; i--)
+            text.insert(next(uint32_t(text.size())), insertions[next(sizeof insertions / sizeof insertions[0])]);
+        if (seed % 8 == 0)
+            text.insert(next(uint32_t(text.size())), 1, '\0'); // Ends the tokens early
+
+        StringInterner names;
+        Diagnostics diagnostics(text, 0);
+        vector<Token> expected;
+        Lexer lexer(text, names, diagnostics);
+        do
+            expected.push_back(lexer.nextToken());
+        while (expected.back().type != T_EOF);
+        TokenBuffer tokens;
+        Lexer(text, names, diagnostics).tokenize(tokens);
+
+        string problem;
+        size_t differs = firstDifferentToken(tokens, expected);
+        if (differs != SIZE_MAX)
+            problem = "token " + to_string(differs) + " differs";
+        for (int probe = 0; probe < 1000 && problem.empty(); probe++)
+        {
+            size_t i = next(uint32_t(tokens.size()));
+            Token token = tokens.token(i);
+            if (token.value.data() != expected[i].value.data() || token.symbol != expected[i].symbol)
+                problem = "token " + to_string(i) + " differs when it is read on its own";
+            else if (tokens.firstStartingAt(tokens.start(i)) != i)
+                problem = "firstStartingAt does not find token " + to_string(i);
+        }
+        // Splice a run of tokens out, then lex it again and splice it back in
+        for (int splice = 0; splice < 20 && problem.empty(); splice++)
+        {
+            size_t from = next(uint32_t(tokens.size())), to = min(from + next(200), tokens.size() - 1);
+            from = min(from, to);
+            TokenBuffer run;
+            run.reset(text, names);
+            for (size_t i = from; i < to; i++)
+                run.add(expected[i]);
+            TokenBuffer none;
+            none.reset(text, names);
+            tokens.splice(from, to, none);
+            tokens.splice(from, from, run);
+            differs = firstDifferentToken(tokens, expected);
+            if (differs != SIZE_MAX)
+                problem = "token " + to_string(differs) + " differs after splicing tokens " + to_string(from) +
+                          " to " + to_string(to);
+        }
+        if (!problem.empty())
+        {
+            out << "Source " << seed << " (" << tokens.size() << " tokens): " << problem << endl;
+            failed++;
+        }
+    }
+    out << count - failed << " of " << count << " sources give the same tokens from a TokenBuffer" << endl;
+    return failed;
+}
+
+bool parseSize(const char *text, uint64_t &bytes)
+{
+    const char *end = text + strlen(text);
+    auto parsed = from_chars(text, end, bytes);
+    if (parsed.ec != errc() || end - parsed.ptr > 1)
+        return false;
+    if (parsed.ptr == end)
+        return true;
+    const char *units = "KMG";
+    const char *unit = strchr(units, toupper(*parsed.ptr));
+    if (!unit || !*unit)
+        return false;
+    bytes <<= 10 * (unit - units + 1);
+    return true;
+}
+
+int runScaleBenchmark(uint64_t maxBytes, ostream &out)
+{
+    static const char *const phaseNames[] = {"lex", "symbols", "parse"};
+    const int PHASES = 3;
+    const uint64_t REFERENCE = 64 << 10;
+
+    out << right << setw(10) << "Size" << "  " << left << setw(9) << "Phase" << right << setw(7) << "Iters"
+        << setw(11) << "ms/iter" << setw(9) << "MB/s" << setw(9) << "ns/B" << setw(10) << "Alloc/B" << setw(10)
+        << "Peak MB" << "\n";
+    vector<uint64_t> sizes;
+    vector<array<double, PHASES>> nanosecondsPerByte;
+    bool flagged = false;
+    for (uint64_t target = 1 << 10; target <= max(maxBytes, uint64_t(1) << 10); target *= 4)
+    {
+        string measured = runIsolated([&] {
+            string source;
+            SourceGenerator(2024).generate(source, size_t(target));
+
+            // What the symbols phase replays: a name id with the operation in the top two bits
+            const uint32_t DECLARE = 1u << 30, ENTER = 2u << 30, EXIT = 3u << 30, OPERATION = 3u << 30;
+            vector<uint32_t> operations;
+            StringInterner names;
+            {
+                Diagnostics diagnostics(source, 0);
+                Lexer lexer(source, names, diagnostics);
+                TokenType previous = T_EOF;
+                for (Token token = lexer.nextToken(); token.type != T_EOF; token = lexer.nextToken())
+                {
+                    if (token.type == T_LBRACE)
+                        operations.push_back(ENTER);
+                    else if (token.type == T_RBRACE)
+                        operations.push_back(EXIT);
+                    else if (token.type == T_ID)
+                        operations.push_back(token.symbol | (TypeTable::primitive(tokenText(previous)) != TYPE_ERROR ? DECLARE : 0));
+                    previous = token.type;
+                }
+            }
+
+            size_t sink = 0; // Keeps the optimizer from dropping the work
+            auto phase = [&](int which) {
+                if (which == 0)
+                {
+                    StringInterner lexed;
+                    Diagnostics diagnostics(source, 0);
+                    Lexer lexer(source, lexed, diagnostics);
+                    while (lexer.nextToken().type != T_EOF)
+                        sink++;
+                }
+                else if (which == 1)
+                {
+                    SymbolTable table;
+                    for (uint32_t operation : operations)
+                    {
+                        switch (operation & OPERATION)
+                        {
+                        case ENTER: table.enterScope(); break;
+                        case EXIT: table.exitScope(); break;
+                        case DECLARE: sink += table.declare(operation & ~OPERATION, TYPE_INT, 0, 0); break;
+                        default: sink += table.lookup(operation) != nullptr; break;
+                        }
+                    }
+                }
+                else
+                {
+                    CompileArena arena;
+                    TypeTable types;
+                    Diagnostics diagnostics(source, 0);
+                    Lexer lexer(source, arena.names, diagnostics);
+                    TokenStream stream(lexer);
+                    ostream discard(nullptr);
+                    Parser(stream, arena.names, types, arena.ast, diagnostics).parseProgram(discard);
+                    sink += arena.ast.size();
+                    if (diagnostics.count() > 0)
+                    {
+                        diagnostics.report(out);
+                        sink = 0;
+                    }
+                }
+            };
+
+            string result = to_string(source.size());
+            for (int which = 0; which < PHASES; which++)
+            {
+                size_t iterations = 0;
+                double total = 0;
+                PhaseStats stats{};
+                while (iterations == 0 || total < 100)
+                {
+                    stats = measurePhase([&] { phase(which); });
+                    total += stats.milliseconds;
+                    iterations++;
+                }
+                double milliseconds = total / iterations;
+                double bytes = double(source.size());
+                out << setw(10) << source.size() << "  " << left << setw(9) << phaseNames[which] << right << fixed
+                    << setprecision(2) << setw(7) << iterations << setw(11) << milliseconds << setprecision(1)
+                    << setw(9) << bytes / 1e3 / milliseconds << setprecision(2) << setw(9)
+                    << milliseconds * 1e6 / bytes << setw(10) << stats.allocatedBytes / bytes << setprecision(1)
+                    << setw(10) << stats.peakRssKb / 1024.0 << defaultfloat << setprecision(6) << endl;
+                result += " " + to_string(milliseconds * 1e6 / bytes);
+            }
+            return sink > 0 ? result : string();
+        });
+
+        istringstream fields(measured);
+        uint64_t size = 0;
+        array<double, PHASES> perByte{};
+        if (!(fields >> size >> perByte[0] >> perByte[1] >> perByte[2]))
+        {
+            out << "The front end rejected the generated program of " << target << " bytes" << endl;
+            return 1;
+        }
+        sizes.push_back(size);
+        nanosecondsPerByte.push_back(perByte);
+    }
+
+    // Judged only from the first size of at least REFERENCE bytes on
+    size_t first = size_t(find_if(sizes.begin(), sizes.end(), [&](uint64_t size) { return size >= REFERENCE; }) -
+                          sizes.begin());
+    for (int which = 0; which < PHASES; which++)
+    {
+        if (sizes.size() - first < 2)
+            break;
+        double sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+        size_t points = sizes.size() - first;
+        for (size_t i = first; i < sizes.size(); i++)
+        {
+            double x = log(double(sizes[i])), y = log(nanosecondsPerByte[i][which] * sizes[i]);
+            sumX += x;
+            sumY += y;
+            sumXX += x * x;
+            sumXY += x * y;
+            double growth = nanosecondsPerByte[i][which] / nanosecondsPerByte[first][which];
+            if (growth > 2)
+            {
+                out << "Non-linear: " << phaseNames[which] << " spends " << fixed << setprecision(1) << growth
+                    << defaultfloat << setprecision(6) << "x the time per byte at " << sizes[i] << " bytes as at "
+                    << sizes[first] << endl;
+                flagged = true;
+            }
+        }
+        double exponent = (points * sumXY - sumX * sumY) / (points * sumXX - sumX * sumX);
+        out << phaseNames[which] << " time grows as size^" << fixed << setprecision(2) << exponent << defaultfloat
+            << setprecision(6);
+        if (exponent > 1.2)
+        {
+            out << ", which is non-linear";
+            flagged = true;
+        }
+        out << endl;
+    }
+    return flagged ? 1 : 0;
+}
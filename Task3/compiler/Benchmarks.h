@@ -0,0 +1,60 @@
+#ifndef COMPILER_BENCHMARKS_H
+#define COMPILER_BENCHMARKS_H
+
+#include <cstdint>
+#include <ostream>
+
+// Runs every workload on both engines, on the VM again with the optimized
+// code and on the JIT, each in its own process, and checks that they agree. Time, allocations and peak RSS are reported per phase.
+int runBenchmarks(std::ostream &out);
+
+// Checks the native code generator against the VM: generates count
+// programs, compiles each through the Ir (optimized every other one) to
+// assembly, links it with the system C compiler, and compares what the
+// binary prints and its exit status with what --run prints and the status
+// the program should exit with. The same code also runs on the JIT. Returns
+// the number of programs that differ.
+size_t checkNative(size_t count, std::ostream &out);
+
+// Checks IncrementalSession against parsing from scratch: applies random
+// edits to count generated programs, half of them with a limit of three
+// errors, and after each edit compares the session's errors, or its symbol
+// table, tree and the declaration every name is linked to, with those of a
+// new session on the edited text. Returns the number of edits that differ.
+size_t checkEdits(size_t count, std::ostream &out);
+
+// Checks tokenizeParallel against the serial lexer on count generated
+// sources in which most lines are quoted into multi-line string literals,
+// with escaped quotes, stray characters and now and then a string that never
+// ends, so chunks begin inside strings. Each is lexed on 2, 3 and 8 threads
+// with small chunks; the first source is 8 MB and uses the default chunk
+// size. Tokens, interned names and errors must match. Returns the number of
+// sources that differ.
+size_t checkParallelLexer(size_t count, std::ostream &out);
+
+// Checks TokenBuffer against the Tokens the lexer returns, on count
+// generated sources with stray quotes, characters, '\0' and localized
+// keywords inserted: every token rebuilt in order and at random, where each
+// starts and firstStartingAt, and the buffer again after random runs of
+// tokens are spliced out and back in. Returns the number of sources that
+// differ.
+size_t checkTokenBuffer(size_t count, std::ostream &out);
+
+// Parses "64", "64K", "64M" or "1G" as a number of bytes
+bool parseSize(const char *text, uint64_t &bytes);
+
+// The scaling benchmark behind --scale-bench: front-end phases on generated
+// programs of 1 KB, 4 KB, ... up to maxBytes, each size in a child process
+// so its peak RSS is its own. Phases:
+//   lex     - Lexer::nextToken over the whole text, tokens not kept
+//   symbols - the declarations, lookups and scopes of the text replayed on a SymbolTable
+//   parse   - the whole front end, as compileSource runs it: lexing, parsing, checking
+// Like Google Benchmark, a phase is repeated until it has run for a tenth of
+// a second and the mean is reported. Work per byte should not grow with the
+// size; a phase whose ns/byte at some size is over twice what it was at the
+// first size of at least 64 KB (below that fixed costs dominate) is flagged,
+// as is a phase whose time fits size^k with k over 1.2. Returns 1 if any
+// phase was flagged.
+int runScaleBenchmark(uint64_t maxBytes, std::ostream &out);
+
+#endif
@@ -0,0 +1,440 @@
+#include "Bytecode.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+using namespace std;
+
+void Bytecode::dump(ostream &out) const
+{
+    static const char *const opcodeNames[] = {
+#define OPCODE_NAME(name) #name,
+        OPCODES(OPCODE_NAME)
+#undef OPCODE_NAME
+    };
+    for (uint32_t i = 0; i < constants[BANK_INT]; i++)
+        out << "i" << i << " = " << ints[i] << "\n";
+    for (uint32_t i = 0; i < constants[BANK_FLOAT]; i++)
+        out << "f" << i << " = " << floats[i] << "\n";
+    for (uint32_t i = 0; i < constants[BANK_STRING]; i++)
+        out << "s" << i << " = \"" << strings[i] << "\"\n";
+    out << "Registers: " << ints.size() << " int, " << floats.size() << " float, " << strings.size()
+        << " string\n";
+    for (size_t i = 0; i < code.size(); i++)
+    {
+        out << setw(6) << right << i << "  " << setw(15) << left << opcodeNames[code[i].op] << code[i].a << " "
+            << code[i].b << " " << code[i].c << "\n";
+    }
+    out << right;
+}
+
+uint32_t BytecodeCompiler::intConstant(int64_t value)
+{
+    auto inserted = intConstants.emplace(value, uint32_t(program.ints.size()));
+    if (inserted.second)
+        program.ints.push_back(value);
+    return inserted.first->second;
+}
+
+uint32_t BytecodeCompiler::floatConstant(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof bits);
+    auto inserted = floatConstants.emplace(bits, uint32_t(program.floats.size()));
+    if (inserted.second)
+        program.floats.push_back(value);
+    return inserted.first->second;
+}
+
+uint32_t BytecodeCompiler::stringConstant(uint32_t symbol)
+{
+    auto inserted = stringConstants.emplace(symbol, uint32_t(program.strings.size()));
+    if (inserted.second)
+        program.strings.push_back(string(names.name(symbol)));
+    return inserted.first->second;
+}
+
+uint32_t BytecodeCompiler::allocate(Bank bank)
+{
+    uint32_t reg = top[bank]++;
+    if (bank == BANK_INT && reg == program.ints.size())
+        program.ints.push_back(0);
+    else if (bank == BANK_FLOAT && reg == program.floats.size())
+        program.floats.push_back(0.0);
+    else if (bank == BANK_STRING && reg == program.strings.size())
+        program.strings.emplace_back();
+    return reg;
+}
+
+void BytecodeCompiler::emitConvert(uint32_t dest, TypeId to, uint32_t src, TypeId from, uint32_t line)
+{
+    static const Opcode moves[] = {OP_MOVE_I, OP_MOVE_F, OP_MOVE_S};
+    if (sameRepresentation(to, from))
+    {
+        if (dest != src)
+            emit(moves[bankOf(to)], line, dest, src);
+    }
+    else if (to == TYPE_FLOAT)
+        emit(OP_INT_TO_FLOAT, line, dest, src);
+    else if (to == TYPE_INT)
+        emit(OP_FLOAT_TO_INT, line, dest, src);
+    else // to == TYPE_BOOL
+    {
+        static const Opcode toBool[] = {OP_INT_TO_BOOL, OP_FLOAT_TO_BOOL, OP_STRING_TO_BOOL};
+        emit(toBool[bankOf(from)], line, dest, src);
+    }
+}
+
+uint32_t BytecodeCompiler::compileExpression(uint32_t index)
+{
+    const Node &node = ast[index];
+    if (node.kind == N_NUMBER)
+        return node.type == TYPE_FLOAT ? floatConstant(node.floatValue) : intConstant(node.intValue);
+    if (node.kind == N_STRING)
+        return stringConstant(node.symbol);
+    if (node.kind == N_NAME)
+    {
+        assert(node.a != NO_NODE); // Programs with an undeclared name are never lowered
+        return variables.at(node.a);
+    }
+    uint32_t dest = allocate(bankOf(node.type));
+    emitExpression(index, dest);
+    return dest;
+}
+
+uint32_t BytecodeCompiler::operand(uint32_t index, TypeId type)
+{
+    TypeId from = ast[index].type;
+    uint32_t reg = compileExpression(index);
+    if (sameRepresentation(type, from))
+        return reg;
+    uint32_t converted = allocate(bankOf(type));
+    emitConvert(converted, type, reg, from, lineOf(ast[index]));
+    return converted;
+}
+
+void BytecodeCompiler::compileInto(uint32_t index, uint32_t dest, TypeId type)
+{
+    const Node &node = ast[index];
+    bool logical = node.kind == N_BINARY && (node.op == T_LOGICAL_AND || node.op == T_LOGICAL_OR);
+    if ((node.kind == N_BINARY || node.kind == N_UNARY) && sameRepresentation(type, node.type) &&
+        (!logical || dest >= statementBase[BANK_INT])) // && and || write dest early, so only into a temporary
+    {
+        emitExpression(index, dest);
+        return;
+    }
+    array<uint32_t, 3> mark = top;
+    emitConvert(dest, type, compileExpression(index), node.type, lineOf(node));
+    top = mark;
+}
+
+void BytecodeCompiler::emitExpression(uint32_t index, uint32_t dest)
+{
+    const Node &node = ast[index];
+    if (depth >= MAX_EXPRESSION_DEPTH)
+    {
+        tooDeep = true;
+        return;
+    }
+    depth++;
+    array<uint32_t, 3> mark = top;
+    if (node.kind == N_UNARY && node.op == T_NOT)
+        emit(OP_NOT, lineOf(node), dest, operand(node.a, TYPE_BOOL));
+    else if (node.kind == N_UNARY)
+        emit(node.type == TYPE_FLOAT ? OP_NEG_F : OP_NEG_I, lineOf(node), dest, operand(node.a, node.type));
+    else if (node.op == T_LOGICAL_AND || node.op == T_LOGICAL_OR)
+    {
+        // Short-circuit: the right operand is skipped once the left one decides
+        compileInto(node.a, dest, TYPE_BOOL);
+        size_t skip = emit(node.op == T_LOGICAL_AND ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE, lineOf(node), dest);
+        compileInto(node.b, dest, TYPE_BOOL);
+        patch(skip);
+    }
+    else if (node.type == TYPE_BOOL) // Comparison; > and >= are < and <= with the operands swapped
+    {
+        TypeId left = ast[node.a].type, right = ast[node.b].type;
+        TypeId common = left == TYPE_STRING ? TYPE_STRING : max(TYPE_INT, max(left, right));
+        uint32_t b = operand(node.a, common), c = operand(node.b, common);
+        int offset = 0;
+        switch (node.op)
+        {
+        case T_EQ: offset = 0; break;
+        case T_NEQ: offset = 1; break;
+        case T_LT: offset = 2; break;
+        case T_LE: offset = 3; break;
+        case T_GT: offset = 2; swap(b, c); break;
+        default: offset = 3; swap(b, c); break; // T_GE
+        }
+        emit(Opcode(OP_EQ_I + 4 * bankOf(common) + offset), lineOf(node), dest, b, c);
+    }
+    else if (node.type == TYPE_STRING) // + is the only operator on strings
+        emit(OP_CONCAT, lineOf(node), dest, operand(node.a, TYPE_STRING), operand(node.b, TYPE_STRING));
+    else
+    {
+        uint32_t b = operand(node.a, node.type), c = operand(node.b, node.type);
+        int offset = node.op == T_PLUS ? 0 : node.op == T_MINUS ? 1 : node.op == T_MUL ? 2 : 3;
+        emit(Opcode((node.type == TYPE_FLOAT ? OP_ADD_F : OP_ADD_I) + offset), lineOf(node), dest, b, c);
+    }
+    top = mark;
+    depth--;
+}
+
+void BytecodeCompiler::compileStatement(uint32_t index)
+{
+    const Node &node = ast[index];
+    if (statementDepth >= MAX_STATEMENT_DEPTH)
+    {
+        tooDeep = true;
+        return;
+    }
+    statementDepth++;
+    array<uint32_t, 3> mark = top;
+    switch (node.kind)
+    {
+    case N_PROGRAM:
+        for (uint32_t i = 0; i < node.b; i++)
+        {
+            base = ast.statementStarts(node)[i];
+            compileStatement(ast.statements(node)[i]);
+        }
+        base = 0;
+        top = mark;
+        break;
+    case N_BLOCK:
+        for (uint32_t i = 0; i < node.b; i++)
+            compileStatement(ast.statements(node)[i]);
+        top = mark; // The block's variables go out of scope
+        break;
+    case N_DECL:
+    {
+        // The initializer can already see the name; there it reads as zero,
+        // the value a declaration without an initializer gives
+        uint32_t reg = allocate(bankOf(node.type));
+        variables[index] = zeroConstant(bankOf(node.type));
+        statementBase = top;
+        if (node.a != NO_NODE)
+            compileInto(node.a, reg, node.type);
+        else
+            emitConvert(reg, node.type, zeroConstant(bankOf(node.type)), node.type, lineOf(node));
+        variables[index] = reg;
+        top = statementBase; // The variable stays until its scope ends
+        break;
+    }
+    case N_ASSIGN:
+        assert(node.b != NO_NODE);
+        statementBase = top;
+        compileInto(node.a, variables.at(node.b), node.type);
+        top = mark;
+        break;
+    case N_IF:
+    {
+        // Temporaries are given back after the condition only: an unbraced
+        // declaration as a branch stays in scope after the statement
+        size_t skipThen = emit(OP_JUMP_IF_FALSE, lineOf(node), condition(node.a));
+        top = mark;
+        compileStatement(node.b);
+        if (node.c == NO_NODE)
+            patch(skipThen);
+        else
+        {
+            size_t skipElse = emit(OP_JUMP, lineOf(node), 0);
+            patch(skipThen);
+            compileStatement(node.c);
+            patch(skipElse);
+        }
+        break;
+    }
+    case N_WHILE:
+    case N_FOR:
+    {
+        // The condition is placed after the body, so an iteration takes one branch
+        if (node.kind == N_FOR)
+            compileStatement(node.a);
+        size_t toCondition = emit(OP_JUMP, lineOf(node), 0);
+        uint32_t body = uint32_t(program.code.size());
+        if (node.kind == N_FOR)
+        {
+            compileStatement(node.body);
+            compileStatement(node.c);
+        }
+        else
+            compileStatement(node.b);
+        patch(toCondition);
+        array<uint32_t, 3> beforeCondition = top;
+        emit(OP_JUMP_IF_TRUE, lineOf(node), condition(node.kind == N_FOR ? node.b : node.a), body);
+        top = beforeCondition;
+        break;
+    }
+    case N_RETURN:
+    {
+        static const Opcode returns[] = {OP_RETURN_I, OP_RETURN_F, OP_RETURN_S};
+        emit(returns[bankOf(ast[node.a].type)], lineOf(node), compileExpression(node.a), ast[node.a].type);
+        top = mark;
+        break;
+    }
+    default:
+        break; // N_ERROR cannot occur in a tree without errors
+    }
+    statementDepth--;
+}
+
+BytecodeCompiler::BytecodeCompiler(const Ast &ast, const StringInterner &names, LineIndex &lines, Bytecode &program)
+    : ast(ast), names(names), lines(lines), program(program)
+{
+    // Every constant of the tree gets its register before any variable does
+    intConstant(0);
+    floatConstant(0.0);
+    stringConstants.emplace(NO_SYMBOL, 0);
+    program.strings.emplace_back();
+    for (uint32_t i = 0; i < ast.size(); i++)
+    {
+        const Node &node = ast[i];
+        if (node.kind == N_NUMBER && node.type == TYPE_FLOAT)
+            floatConstant(node.floatValue);
+        else if (node.kind == N_NUMBER)
+            intConstant(node.intValue);
+        else if (node.kind == N_STRING)
+            stringConstant(node.symbol);
+    }
+    program.constants = {uint32_t(program.ints.size()), uint32_t(program.floats.size()),
+                         uint32_t(program.strings.size())};
+    top = statementBase = program.constants;
+}
+
+RunResult execute(const Bytecode &program)
+{
+    static void *const handlers[] = {
+#define OPCODE_LABEL(name) &&L_##name,
+        OPCODES(OPCODE_LABEL)
+#undef OPCODE_LABEL
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == OP_COUNT, "One handler per opcode");
+
+    vector<int64_t> intRegisters = program.ints;
+    vector<double> floatRegisters = program.floats;
+    vector<string> stringRegisters = program.strings;
+    int64_t *I = intRegisters.data();
+    double *F = floatRegisters.data();
+    string *S = stringRegisters.data();
+    const Instruction *code = program.code.data(), *pc = code;
+    uint64_t executed = 0;
+    RunResult result;
+
+#define VM_DISPATCH()               \
+    do                              \
+    {                               \
+        executed++;                 \
+        goto *handlers[pc->op];     \
+    } while (0)
+#define VM_NEXT()                   \
+    do                              \
+    {                               \
+        pc++;                       \
+        VM_DISPATCH();              \
+    } while (0)
+#define VM_WRAP(x, op, y) int64_t(uint64_t(x) op uint64_t(y))
+
+    VM_DISPATCH();
+
+L_MOVE_I: I[pc->a] = I[pc->b]; VM_NEXT();
+L_MOVE_F: F[pc->a] = F[pc->b]; VM_NEXT();
+L_MOVE_S: S[pc->a] = S[pc->b]; VM_NEXT();
+L_INT_TO_FLOAT: F[pc->a] = double(I[pc->b]); VM_NEXT();
+L_FLOAT_TO_INT: I[pc->a] = floatToInt(F[pc->b]); VM_NEXT();
+L_INT_TO_BOOL: I[pc->a] = I[pc->b] != 0; VM_NEXT();
+L_FLOAT_TO_BOOL: I[pc->a] = F[pc->b] != 0; VM_NEXT();
+L_STRING_TO_BOOL: I[pc->a] = !S[pc->b].empty(); VM_NEXT();
+L_ADD_I: I[pc->a] = VM_WRAP(I[pc->b], +, I[pc->c]); VM_NEXT();
+L_SUB_I: I[pc->a] = VM_WRAP(I[pc->b], -, I[pc->c]); VM_NEXT();
+L_MUL_I: I[pc->a] = VM_WRAP(I[pc->b], *, I[pc->c]); VM_NEXT();
+L_DIV_I:
+    if (I[pc->c] == 0)
+    {
+        result.error = "Runtime error: division by zero on line " + to_string(program.lines[pc - code]);
+        goto done;
+    }
+    I[pc->a] = I[pc->c] == -1 ? VM_WRAP(0, -, I[pc->b]) : I[pc->b] / I[pc->c]; // INT64_MIN / -1 wraps too
+    VM_NEXT();
+L_ADD_F: F[pc->a] = F[pc->b] + F[pc->c]; VM_NEXT();
+L_SUB_F: F[pc->a] = F[pc->b] - F[pc->c]; VM_NEXT();
+L_MUL_F: F[pc->a] = F[pc->b] * F[pc->c]; VM_NEXT();
+L_DIV_F: F[pc->a] = F[pc->b] / F[pc->c]; VM_NEXT();
+L_CONCAT:
+    if (pc->a == pc->b && pc->a != pc->c)
+        S[pc->a] += S[pc->c]; // s = s + t appends in place
+    else
+        S[pc->a] = S[pc->b] + S[pc->c];
+    VM_NEXT();
+L_NEG_I: I[pc->a] = VM_WRAP(0, -, I[pc->b]); VM_NEXT();
+L_NEG_F: F[pc->a] = -F[pc->b]; VM_NEXT();
+L_NOT: I[pc->a] = !I[pc->b]; VM_NEXT();
+L_EQ_I: I[pc->a] = I[pc->b] == I[pc->c]; VM_NEXT();
+L_NE_I: I[pc->a] = I[pc->b] != I[pc->c]; VM_NEXT();
+L_LT_I: I[pc->a] = I[pc->b] < I[pc->c]; VM_NEXT();
+L_LE_I: I[pc->a] = I[pc->b] <= I[pc->c]; VM_NEXT();
+L_EQ_F: I[pc->a] = F[pc->b] == F[pc->c]; VM_NEXT();
+L_NE_F: I[pc->a] = F[pc->b] != F[pc->c]; VM_NEXT();
+L_LT_F: I[pc->a] = F[pc->b] < F[pc->c]; VM_NEXT();
+L_LE_F: I[pc->a] = F[pc->b] <= F[pc->c]; VM_NEXT();
+L_EQ_S: I[pc->a] = S[pc->b] == S[pc->c]; VM_NEXT();
+L_NE_S: I[pc->a] = S[pc->b] != S[pc->c]; VM_NEXT();
+L_LT_S: I[pc->a] = S[pc->b] < S[pc->c]; VM_NEXT();
+L_LE_S: I[pc->a] = S[pc->b] <= S[pc->c]; VM_NEXT();
+L_JUMP:
+    pc = code + pc->a;
+    VM_DISPATCH();
+L_JUMP_IF_FALSE:
+    pc = I[pc->a] ? pc + 1 : code + pc->b;
+    VM_DISPATCH();
+L_JUMP_IF_TRUE:
+    pc = I[pc->a] ? code + pc->b : pc + 1;
+    VM_DISPATCH();
+L_RETURN_I:
+    result.intValue = I[pc->a];
+    goto returned;
+L_RETURN_F:
+    result.floatValue = F[pc->a];
+    goto returned;
+L_RETURN_S:
+    result.stringValue = S[pc->a];
+    goto returned;
+returned:
+    result.returned = true;
+    result.type = pc->b;
+L_HALT:
+done:
+    result.executed = executed;
+    return result;
+
+#undef VM_DISPATCH
+#undef VM_NEXT
+#undef VM_WRAP
+}
+
+string returnedText(const RunResult &result)
+{
+    ostringstream text;
+    if (result.type == TYPE_BOOL)
+        text << (result.intValue ? "true" : "false");
+    else if (bankOf(result.type) == BANK_INT)
+        text << result.intValue;
+    else if (bankOf(result.type) == BANK_FLOAT)
+        text << result.floatValue;
+    else
+        text << '"' << result.stringValue << '"';
+    return text.str();
+}
+
+void printRunResult(const RunResult &result, ostream &out)
+{
+    if (!result.error.empty())
+        out << result.error << endl;
+    else if (!result.returned)
+        out << "Program finished without returning a value" << endl;
+    else
+        out << "Program returned " << returnedText(result) << endl;
+}
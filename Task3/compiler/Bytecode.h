@@ -0,0 +1,215 @@
+#ifndef COMPILER_BYTECODE_H
+#define COMPILER_BYTECODE_H
+
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Token.h"
+#include "Ast.h"
+
+// Register bytecode. Values are stored unboxed in three typed register
+// banks: ints (which also hold bools), floats and strings; an opcode fixes
+// the bank of each of its operands. Constants are preloaded into registers
+// of their own, so no instruction loads one. Operands:
+//   MOVE_*, conversions, NEG_*, NOT:  a = op b
+//   arithmetic, CONCAT, comparisons:  a = b op c (comparisons write the int bank)
+//   JUMP: go to a;  JUMP_IF_*: go to b if int register a is (non)zero
+//   RETURN_*: stop with register a, whose TypeId is b
+#define OPCODES(X)                                                                                   \
+    X(MOVE_I) X(MOVE_F) X(MOVE_S)                                                                    \
+    X(INT_TO_FLOAT) X(FLOAT_TO_INT) X(INT_TO_BOOL) X(FLOAT_TO_BOOL) X(STRING_TO_BOOL)               \
+    X(ADD_I) X(SUB_I) X(MUL_I) X(DIV_I) X(ADD_F) X(SUB_F) X(MUL_F) X(DIV_F) X(CONCAT)               \
+    X(NEG_I) X(NEG_F) X(NOT)                                                                         \
+    X(EQ_I) X(NE_I) X(LT_I) X(LE_I) X(EQ_F) X(NE_F) X(LT_F) X(LE_F) X(EQ_S) X(NE_S) X(LT_S) X(LE_S) \
+    X(JUMP) X(JUMP_IF_FALSE) X(JUMP_IF_TRUE)                                                         \
+    X(RETURN_I) X(RETURN_F) X(RETURN_S) X(HALT)
+
+enum Opcode : uint8_t
+{
+#define OPCODE_ENUM(name) OP_##name,
+    OPCODES(OPCODE_ENUM)
+#undef OPCODE_ENUM
+    OP_COUNT
+};
+
+// The compiler picks arithmetic and comparison opcodes by offset from these
+static_assert(OP_ADD_F == OP_ADD_I + 4 && OP_EQ_F == OP_EQ_I + 4 && OP_EQ_S == OP_EQ_I + 8,
+              "Typed opcode groups must stay in bank order");
+
+struct Instruction
+{
+    Opcode op;
+    uint32_t a, b, c;
+};
+
+enum Bank : uint8_t
+{
+    BANK_INT,
+    BANK_FLOAT,
+    BANK_STRING
+};
+
+inline Bank bankOf(TypeId type)
+{
+    if (type == TYPE_FLOAT || type == TYPE_DOUBLE)
+        return BANK_FLOAT;
+    return type == TYPE_STRING ? BANK_STRING : BANK_INT;
+}
+
+// bool values are 0 or 1 in the int bank, so they can be used as ints unchanged
+inline bool sameRepresentation(TypeId to, TypeId from)
+{
+    return to == from || (to == TYPE_INT && from == TYPE_BOOL);
+}
+
+// A compiled program and the initial contents of its registers: the
+// constants first, then zeroed registers for variables and temporaries
+struct Bytecode
+{
+    std::vector<Instruction> code;
+    std::vector<uint32_t> lines; // Source line of each instruction, for runtime errors
+    std::vector<int64_t> ints;
+    std::vector<double> floats;
+    std::vector<std::string> strings;
+    std::array<uint32_t, 3> constants = {0, 0, 0}; // Constant registers at the start of each bank
+
+    // Prints the constants and a listing of the code, for --dump-bytecode
+    void dump(std::ostream &out) const;
+};
+
+// Lowers a checked AST to Bytecode; it is only run on trees without errors,
+// so every name has a declaration and every operator valid operands. The
+// language has no functions, so the program is one flat register frame. A
+// variable keeps its register while its scope is open, and temporaries are
+// taken above the live variables like a stack and given back after use.
+class BytecodeCompiler
+{
+private:
+    static const size_t MAX_EXPRESSION_DEPTH = 10000; // Lowering recurses on the tree
+    static const size_t MAX_STATEMENT_DEPTH = 10000;  // Statements in statements, counted apart
+
+    const Ast &ast;
+    const StringInterner &names;
+    LineIndex &lines;
+    Bytecode &program;
+    std::array<uint32_t, 3> top;           // First free register of each bank
+    std::array<uint32_t, 3> statementBase; // Registers from here up are temporaries of the current statement
+    std::unordered_map<uint32_t, uint32_t> variables;      // Declaration node -> register
+    std::unordered_map<int64_t, uint32_t> intConstants;
+    std::unordered_map<uint64_t, uint32_t> floatConstants; // Keyed by bit pattern
+    std::unordered_map<uint32_t, uint32_t> stringConstants; // Keyed by interned text
+    size_t depth = 0;
+    size_t statementDepth = 0;
+    bool tooDeep = false;
+    uint32_t base = 0; // Start of the top-level statement being compiled, which node offsets count from
+
+    uint32_t lineOf(const Node &node) { return lines.line(base + node.offset); }
+
+    uint32_t intConstant(int64_t value);
+
+    uint32_t floatConstant(double value);
+
+    uint32_t stringConstant(uint32_t symbol);
+
+    // Zero value of a bank, which declarations without an initializer start from
+    uint32_t zeroConstant(Bank bank)
+    {
+        if (bank == BANK_INT)
+            return intConstant(0);
+        return bank == BANK_FLOAT ? floatConstant(0.0) : stringConstants.at(NO_SYMBOL);
+    }
+
+    uint32_t allocate(Bank bank);
+
+    size_t emit(Opcode op, uint32_t line, uint32_t a, uint32_t b = 0, uint32_t c = 0)
+    {
+        program.code.push_back(Instruction{op, a, b, c});
+        program.lines.push_back(line);
+        return program.code.size() - 1;
+    }
+
+    // Points the jump at index to the next instruction
+    void patch(size_t index)
+    {
+        Instruction &jump = program.code[index];
+        (jump.op == OP_JUMP ? jump.a : jump.b) = uint32_t(program.code.size());
+    }
+
+    void emitConvert(uint32_t dest, TypeId to, uint32_t src, TypeId from, uint32_t line);
+
+    // Register holding the value of the expression at index, in the bank of its type.
+    // Constants and variables are used in place; anything else gets a temporary.
+    uint32_t compileExpression(uint32_t index);
+
+    // Register holding the value of the expression at index converted to type
+    uint32_t operand(uint32_t index, TypeId type);
+
+    // Int register that is nonzero when the condition at index holds
+    uint32_t condition(uint32_t index)
+    {
+        return bankOf(ast[index].type) == BANK_INT ? compileExpression(index) : operand(index, TYPE_BOOL);
+    }
+
+    // Evaluates the expression at index into dest as type. An operator node
+    // writes dest only with its last instruction, after its operands have
+    // been read, so dest may be one of the variables the expression reads.
+    void compileInto(uint32_t index, uint32_t dest, TypeId type);
+
+    // Emits the N_BINARY or N_UNARY node at index with its result in dest
+    void emitExpression(uint32_t index, uint32_t dest);
+
+    void compileStatement(uint32_t index);
+
+public:
+    BytecodeCompiler(const Ast &ast, const StringInterner &names, LineIndex &lines, Bytecode &program);
+
+    // Compiles the N_PROGRAM node; false if expressions or statements nest too deeply
+    bool compileProgram(uint32_t root)
+    {
+        compileStatement(root);
+        emit(OP_HALT, lineOf(ast[root]), 0);
+        return !tooDeep;
+    }
+};
+
+// Outcome of running a Bytecode program
+struct RunResult
+{
+    bool returned = false; // False if the program ran off its end
+    TypeId type = TYPE_VOID;
+    int64_t intValue = 0;
+    double floatValue = 0;
+    std::string stringValue;
+    uint64_t executed = 0; // VM instructions dispatched, or tree nodes visited
+    std::string error;          // Set if a runtime error stopped the program
+};
+
+// float to int conversion that saturates instead of being undefined out of range
+inline int64_t floatToInt(double value)
+{
+    if (value != value)
+        return 0; // NaN
+    if (value <= -9223372036854775808.0)
+        return INT64_MIN;
+    if (value >= 9223372036854775808.0)
+        return INT64_MAX;
+    return int64_t(value);
+}
+
+// Runs a program. Dispatch is threaded through a table of label addresses
+// (computed goto, a GCC and Clang extension): every handler ends in its own
+// indirect jump to the next one, instead of all of them sharing the single
+// branch of a switch. Integer arithmetic wraps around like unsigned math.
+RunResult execute(const Bytecode &program);
+
+// The value a program returned, spelled as a literal of its type
+std::string returnedText(const RunResult &result);
+
+// Prints how a run ended, as --run reports it
+void printRunResult(const RunResult &result, std::ostream &out);
+
+#endif
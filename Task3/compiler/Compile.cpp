@@ -0,0 +1,222 @@
+#include "Compile.h"
+
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "Diagnostics.h"
+#include "Parser.h"
+#include "ParallelLexer.h"
+#include "Bytecode.h"
+#include "TreeInterpreter.h"
+#include "Ir.h"
+#include "IrLowering.h"
+#include "X86.h"
+#include "CompileCache.h"
+
+using namespace std;
+
+bool runBackend(const Ast &ast, const StringInterner &names, LineIndex &lines, uint32_t program,
+                const CompileOptions &options, ostream &out)
+{
+    if (!options.dumpBytecode && !options.dumpIr && !options.run && options.asmPath.empty())
+        return true;
+    TIME_SCOPE("back end");
+    bool jit = options.run && options.engine == ENGINE_JIT;
+    bool optimize = options.optimize || jit;
+    Bytecode bytecode;
+    JitCode native;
+    bool compiled = true, nativeCode = false;
+    if (optimize || options.dumpIr || !options.asmPath.empty())
+    {
+        Ir ir;
+        {
+            TIME_SCOPE("build ir");
+            compiled = IrBuilder(ast, names, lines, ir).build(program);
+        }
+        PassManager passes = PassManager::standard();
+        if (compiled && optimize)
+            passes.run(ir);
+        if (compiled && options.dumpIr)
+        {
+            ir.dump(out);
+            if (optimize)
+                passes.report(out);
+        }
+        if (compiled && !options.asmPath.empty())
+        {
+            TIME_SCOPE("emit assembly");
+            X86Emitter emitter(ir);
+            if (!emitter.compile())
+            {
+                out << "Error: native code generation does not support strings" << endl;
+                return false;
+            }
+            ofstream file(options.asmPath);
+            emitter.writeAssembly(file);
+            if (!file)
+            {
+                out << "Error: Could not write file " << options.asmPath << endl;
+                return false;
+            }
+        }
+        nativeCode = compiled && jit && native.compile(ir);
+        bool lower = options.dumpBytecode || (options.run && options.engine != ENGINE_TREE && !nativeCode);
+        if (compiled && lower && optimize)
+        {
+            TIME_SCOPE("lower ir");
+            IrLowering(ir, bytecode).lower();
+        }
+    }
+    if (compiled && !optimize && (options.dumpBytecode || (options.run && options.engine == ENGINE_BYTECODE)))
+    {
+        TIME_SCOPE("compile bytecode");
+        compiled = BytecodeCompiler(ast, names, lines, bytecode).compileProgram(program);
+    }
+    if (!compiled)
+    {
+        out << "Error: the program nests expressions or statements too deeply to compile" << endl;
+        return false;
+    }
+    if (options.dumpBytecode)
+        bytecode.dump(out);
+    if (!options.run)
+        return true;
+    RunResult result;
+    {
+        TIME_SCOPE("run");
+        result = nativeCode                          ? native.run()
+                 : options.engine == ENGINE_TREE ? TreeInterpreter(ast, names, lines).run(program)
+                                                 : execute(bytecode);
+    }
+    printRunResult(result, out);
+    return result.error.empty();
+}
+
+FrontEndResult runFrontEnd(string_view source, const CompileOptions &options, CompileArena &arena,
+                           string *symbolTable)
+{
+    arena.names.clear();
+    arena.ast.reset();
+    TypeTable types;
+    Diagnostics diagnostics(source, options.maxErrors);
+    Lexer lexer(source, arena.names, diagnostics);
+    if (options.lexThreads > 1)
+        tokenizeParallel(source, arena.names, diagnostics, options.lexThreads, arena.tokens);
+
+    // A serial lexer runs inside the parser, a few tokens ahead of it
+    TokenStream stream = options.lexThreads > 1 ? TokenStream(arena.tokens) : TokenStream(lexer);
+    Parser parser(stream, arena.names, types, arena.ast, diagnostics);
+    ostringstream text;
+    uint32_t program = parser.parseProgram(text);
+    if (diagnostics.count() > 0)
+    {
+        TIME_SCOPE("report errors");
+        diagnostics.report(text);
+    }
+    else if (symbolTable)
+    {
+        ostringstream table;
+        parser.displaySymbolTable(table);
+        *symbolTable = table.str();
+    }
+    return FrontEndResult{text.str(), diagnostics.count() > 0, program};
+}
+
+bool finishCompile(const FrontEndResult &result, CompileArena &arena, const CompileOptions &options, ostream &out)
+{
+    out << result.text;
+    if (result.failed)
+        return false;
+    if (options.dumpAst)
+        arena.ast.dump(result.program, arena.names, TypeTable(), arena.lines, out);
+    return runBackend(arena.ast, arena.names, arena.lines, result.program, options, out);
+}
+
+bool compileSource(string_view source, const CompileOptions &options, CompileArena &arena, ostream &out)
+{
+    TIME_SCOPE("compile source");
+    arena.lines.reset(source);
+    uint64_t key = options.cache ? CompileCache::key(source, options.maxErrors) : 0;
+    FrontEndResult result;
+    if (options.cache && options.cache->load(key, source.size(), arena, result))
+        return finishCompile(result, arena, options, out);
+
+    result = runFrontEnd(source, options, arena);
+    if (options.cache)
+        options.cache->store(key, source.size(), arena, result);
+    return finishCompile(result, arena, options, out);
+}
+
+size_t compileFiles(const vector<string> &paths, size_t threads, CompileOptions options)
+{
+    options.lexThreads = 1;
+    WorkStealingPool pool(threads);
+    vector<CompileArena> arenas(pool.workers());
+    vector<string> outputs(paths.size());
+    vector<char> failed(paths.size(), 0);
+
+    pool.run(paths.size(), [&](size_t index, size_t worker) {
+        ostringstream out;
+        SourceFile file;
+        if (!openSource(file, paths[index]))
+        {
+            out << "Error: Could not open file " << paths[index] << endl;
+            failed[index] = 1;
+        }
+        else if (!compileSource(file.text(), options, arenas[worker], out))
+            failed[index] = 1;
+        outputs[index] = out.str();
+    });
+
+    size_t failures = 0;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        cout << "==> " << paths[i] << " <==\n" << outputs[i];
+        failures += failed[i];
+    }
+    cout << paths.size() << " file(s) compiled, " << failures << " with errors." << endl;
+    return failures;
+}
+
+bool parseCount(string_view text, size_t &value)
+{
+    auto parsed = from_chars(text.data(), text.data() + text.size(), value);
+    return parsed.ec == errc() && parsed.ptr == text.data() + text.size();
+}
+
+bool parseCompileOption(int argc, const char *const argv[], int &arg, CompileOptions &options)
+{
+    string option = argv[arg];
+    if (option == "--dump-ast")
+        options.dumpAst = true;
+    else if (option == "--dump-bytecode")
+        options.dumpBytecode = true;
+    else if (option == "--dump-ir")
+        options.dumpIr = true;
+    else if (option == "--optimize")
+        options.optimize = true;
+    else if (option == "--run")
+        options.run = true;
+    else if (option == "--emit-asm" && arg + 1 < argc)
+        options.asmPath = argv[++arg];
+    else if (option == "--jit")
+    {
+        options.run = true;
+        options.engine = ENGINE_JIT;
+    }
+    else if (option == "--engine" && arg + 1 < argc &&
+             (string(argv[arg + 1]) == "tree" || string(argv[arg + 1]) == "vm" || string(argv[arg + 1]) == "jit"))
+    {
+        string engine = argv[++arg];
+        options.engine = engine == "tree" ? ENGINE_TREE : engine == "vm" ? ENGINE_BYTECODE : ENGINE_JIT;
+    }
+    else if (option == "--max-errors" && arg + 1 < argc && parseCount(argv[arg + 1], options.maxErrors))
+        arg++; // 0 reports every error
+    else if (option == "--lex-threads" && arg + 1 < argc && parseCount(argv[arg + 1], options.lexThreads))
+        arg++;
+    else
+        return false;
+    return true;
+}
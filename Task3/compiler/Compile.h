@@ -0,0 +1,105 @@
+#ifndef COMPILER_COMPILE_H
+#define COMPILER_COMPILE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TimeReport.h"
+#include "../../common/SourceFile.h"
+#include "Token.h"
+#include "Ast.h"
+#include "Lexer.h"
+
+// Reading a source is timed as its own phase for --time-report
+inline bool openSource(SourceFile &file, const std::string &path)
+{
+    TIME_SCOPE("read source");
+    return file.open(path);
+}
+
+enum ExecutionEngine : uint8_t
+{
+    ENGINE_TREE,
+    ENGINE_BYTECODE,
+    ENGINE_JIT // Machine code from the optimized Ir, or the VM where that is not possible
+};
+
+class CompileCache;
+
+struct CompileOptions
+{
+    size_t maxErrors = 20;
+    bool dumpAst = false;
+    bool dumpBytecode = false;
+    bool dumpIr = false;
+    bool optimize = false; // Lower through the Ir and its passes instead of straight from the AST
+    bool run = false;
+    std::string asmPath; // Where to write x86-64 assembly, if anywhere
+    ExecutionEngine engine = ENGINE_BYTECODE; // What --run executes the program with
+    size_t lexThreads = 1; // More than one lexes each file with tokenizeParallel
+    CompileCache *cache = nullptr; // Where front-end results are kept between runs, if anywhere
+};
+
+// State one thread reuses from file to file: the AST arena, the interner's
+// block and slot table, the token buffer of parallel lexing, and the lines
+// of the source the tree came from
+struct CompileArena
+{
+    Ast ast;
+    StringInterner names;
+    TokenBuffer tokens;
+    LineIndex lines;
+};
+
+// What the front end made of one source, as CompileCache keeps it: the text
+// the parser printed, with the diagnostics if it had errors, and otherwise
+// the names and AST the back end runs on, left in a CompileArena
+struct FrontEndResult
+{
+    std::string text;
+    bool failed = false;
+    uint32_t program = NO_NODE;
+};
+
+// Lowers a checked program to bytecode, directly or through the optimized
+// Ir, lists what the options ask for, writes assembly if asked to, and runs
+// it on the chosen engine. The JIT always compiles the optimized Ir, and
+// the VM runs what it cannot compile. Returns false if the program could
+// not be compiled or failed at run time.
+bool runBackend(const Ast &ast, const StringInterner &names, LineIndex &lines, uint32_t program,
+                const CompileOptions &options, std::ostream &out);
+
+// Lexes, parses and checks one source into arena. If symbolTable is given
+// and there were no errors, the symbol table is also printed to it.
+FrontEndResult runFrontEnd(std::string_view source, const CompileOptions &options, CompileArena &arena,
+                           std::string *symbolTable = nullptr);
+
+// Prints what the front end made of a source and, if it had no errors,
+// hands the tree to the back end. arena.lines must be on the source.
+// Returns false if anything failed.
+bool finishCompile(const FrontEndResult &result, CompileArena &arena, const CompileOptions &options,
+                   std::ostream &out);
+
+// Lexes, parses and checks one source, writing everything the compiler
+// prints for it to out. With a cache, a source it has seen goes straight to
+// the back end. Returns false if it had errors.
+bool compileSource(std::string_view source, const CompileOptions &options, CompileArena &arena, std::ostream &out);
+
+// Compiles many files at once on a WorkStealingPool. Each file's output is
+// buffered and everything is printed in input order once all are done, so
+// the result does not depend on scheduling. Files are already spread over
+// the threads, so each one is lexed serially. Returns the number that failed.
+size_t compileFiles(const std::vector<std::string> &paths, size_t threads, CompileOptions options);
+
+// Parses all of text as a number: "4x" and "" are not numbers
+bool parseCount(std::string_view text, size_t &value);
+
+// Options that say how to compile a file, as main and a --serve process
+// both read them. If argv[arg] is one, takes it and any value it has,
+// leaving arg at the last one, and returns true.
+bool parseCompileOption(int argc, const char *const argv[], int &arg, CompileOptions &options);
+
+#endif
@@ -0,0 +1,249 @@
+#include "CompileCache.h"
+
+#include <algorithm>
+#include <fstream>
+#include <ios>
+#include <thread>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
+
+#include "TimeReport.h"
+#include "Ast.h"
+
+using namespace std;
+
+void CompileCache::evict()
+{
+    lock_guard<mutex> lock(evicting);
+    struct Entry
+    {
+        filesystem::file_time_type used;
+        uint64_t size;
+        filesystem::path path;
+    };
+    vector<Entry> entries;
+    uint64_t total = 0;
+    error_code error;
+    for (const filesystem::directory_entry &file : filesystem::directory_iterator(directory, error))
+    {
+        if (file.path().extension() != ".ast")
+            continue;
+        Entry entry{file.last_write_time(error), file.file_size(error), file.path()};
+        if (error)
+            continue; // Removed by another process meanwhile
+        total += entry.size;
+        entries.push_back(move(entry));
+    }
+    if (total > capacity)
+    {
+        sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.used < b.used; });
+        for (const Entry &entry : entries)
+        {
+            if (total <= capacity)
+                break;
+            if (filesystem::remove(entry.path, error))
+                evictions++;
+            total -= entry.size;
+        }
+    }
+    bytesHeld = total;
+}
+
+bool CompileCache::open()
+{
+    error_code error;
+    filesystem::create_directories(directory, error);
+    if (!filesystem::is_directory(directory, error))
+        return false;
+    evict();
+    return true;
+}
+
+bool CompileCache::load(uint64_t key, size_t sourceSize, CompileArena &arena, FrontEndResult &result)
+{
+    TIME_SCOPE("cache load");
+    if (bytesHeld > capacity)
+        evict();
+    filesystem::path path = entryPath(key);
+    ifstream file(path, ios::binary | ios::ate);
+    string data(file ? size_t(file.tellg()) : 0, '\0');
+    file.seekg(0);
+    if (!file.read(data.data(), streamsize(data.size())))
+        data.clear();
+    size_t at = 0;
+    auto take = [&](void *to, size_t size) {
+        if (data.size() - at < size)
+            return false;
+        memcpy(to, data.data() + at, size);
+        at += size;
+        return true;
+    };
+    auto number = [&](auto &value) { return take(&value, sizeof value); };
+
+    char magic[sizeof MAGIC];
+    uint64_t storedKey = 0, storedSize = 0, checksum = 0;
+    uint32_t length = 0;
+    bool valid = data.size() >= sizeof checksum;
+    if (valid)
+    {
+        memcpy(&checksum, data.data() + data.size() - sizeof checksum, sizeof checksum);
+        data.resize(data.size() - sizeof checksum);
+        valid = xxHash64(data) == checksum && take(magic, sizeof magic) && memcmp(magic, MAGIC, sizeof MAGIC) == 0 &&
+                number(storedKey) && storedKey == key && number(storedSize) && storedSize == sourceSize &&
+                number(length) && data.size() - at >= length;
+    }
+    uint8_t failed = 0;
+    if (valid)
+    {
+        result.text.assign(data, at, length);
+        at += length;
+        valid = number(failed) && failed <= 1;
+        result.failed = failed;
+    }
+    if (valid && !result.failed)
+    {
+        uint32_t names = 0, nodes = 0, lists = 0;
+        valid = number(result.program) && number(names);
+        arena.names.clear();
+        arena.ast.reset();
+        for (uint32_t id = 0; valid && id < names; id++)
+        {
+            valid = number(length) && data.size() - at >= length;
+            if (valid)
+                valid = arena.names.intern(string_view(data.data() + at, length)) == id;
+            at += length;
+        }
+        valid = valid && number(nodes) && data.size() - at >= size_t(nodes) * sizeof(Node);
+        if (valid)
+        {
+            arena.ast.append((const Node *)(data.data() + at), nodes);
+            at += size_t(nodes) * sizeof(Node);
+        }
+        valid = valid && number(lists) && data.size() - at == size_t(lists) * sizeof(uint32_t);
+        if (valid)
+        {
+            vector<uint32_t> statements(lists);
+            take(statements.data(), statements.size() * sizeof(uint32_t));
+            arena.ast.addList(statements.data(), lists);
+        }
+    }
+    if (!valid)
+    {
+        misses++;
+        return false;
+    }
+    error_code error;
+    filesystem::last_write_time(path, filesystem::file_time_type::clock::now(), error);
+    hits++;
+    return true;
+}
+
+void CompileCache::store(uint64_t key, size_t sourceSize, const CompileArena &arena, const FrontEndResult &result)
+{
+    TIME_SCOPE("cache store");
+    string data;
+    data.reserve(result.text.size() + (result.failed ? 0 : size_t(arena.ast.size()) * sizeof(Node)) + 64);
+    put(data, MAGIC, sizeof MAGIC);
+    put(data, key);
+    put(data, uint64_t(sourceSize));
+    put(data, uint32_t(result.text.size()));
+    data += result.text;
+    put(data, uint8_t(result.failed));
+    if (!result.failed)
+    {
+        put(data, result.program);
+        put(data, uint32_t(arena.names.size()));
+        for (uint32_t id = 0; id < arena.names.size(); id++)
+        {
+            put(data, uint32_t(arena.names.name(id).size()));
+            data += arena.names.name(id);
+        }
+        put(data, arena.ast.size());
+        for (uint32_t i = 0; i < arena.ast.size(); i++)
+            put(data, &arena.ast[i], sizeof(Node));
+        const vector<uint32_t> &lists = arena.ast.statementLists();
+        put(data, uint32_t(lists.size()));
+        put(data, lists.data(), lists.size() * sizeof(uint32_t));
+    }
+    put(data, xxHash64(data));
+    if (data.size() > capacity)
+        return; // Would only be evicted again
+
+    // Written aside and renamed, so no reader ever sees half an entry
+    filesystem::path path = entryPath(key), temporary = path;
+    temporary += "." + to_string(hash<thread::id>()(this_thread::get_id())) + ".tmp";
+#ifndef _WIN32
+    temporary += to_string(getpid());
+#endif
+    {
+        ofstream file(temporary, ios::binary);
+        file.write(data.data(), streamsize(data.size()));
+        if (!file)
+            return;
+    }
+    error_code error;
+    filesystem::rename(temporary, path, error);
+    if (error)
+    {
+        filesystem::remove(temporary, error);
+        return;
+    }
+    if ((bytesHeld += data.size()) > capacity)
+        evict();
+}
+
+void CompileCache::saveStatistics(ostream *report)
+{
+    filesystem::path path = directory / "statistics", temporary = path;
+    uint64_t total[3] = {0, 0, 0};
+    uint64_t run[3] = {hits, misses, evictions};
+    {
+        // Runs that end together must not both read the old totals and each
+        // write back only their own counts on top
+#ifndef _WIN32
+        int lock = ::open((directory / "statistics.lock").c_str(), O_RDWR | O_CREAT, 0644);
+        if (lock >= 0)
+            flock(lock, LOCK_EX);
+        temporary += "." + to_string(getpid());
+#endif
+        temporary += ".tmp";
+        ifstream(path) >> total[0] >> total[1] >> total[2];
+        for (int i = 0; i < 3; i++)
+            total[i] += run[i];
+        ofstream file(temporary);
+        file << total[0] << " " << total[1] << " " << total[2] << "\n";
+        file.close();
+        error_code error;
+        if (file)
+            filesystem::rename(temporary, path, error); // Readers see the old totals or the new ones
+        if (!file || error)
+            filesystem::remove(temporary, error);
+#ifndef _WIN32
+        if (lock >= 0)
+            close(lock); // Releases the lock
+#endif
+    }
+    if (!report)
+        return;
+
+    uint64_t entries = 0, bytes = 0;
+    error_code error;
+    for (const filesystem::directory_entry &file : filesystem::directory_iterator(directory, error))
+    {
+        if (file.path().extension() == ".ast")
+        {
+            entries++;
+            bytes += file.file_size(error);
+        }
+    }
+    *report << "Cache " << directory.string() << ": " << entries << " entries, " << bytes / 1024 << " of "
+            << capacity / 1024 << " KB\n"
+            << "  this run: " << run[0] << " hits, " << run[1] << " misses, " << run[2] << " evictions\n"
+            << "  all runs: " << total[0] << " hits, " << total[1] << " misses, " << total[2] << " evictions"
+            << endl;
+}
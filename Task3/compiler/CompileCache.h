@@ -0,0 +1,132 @@
+#ifndef COMPILER_COMPILE_CACHE_H
+#define COMPILER_COMPILE_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "Compile.h"
+
+// 64-bit xxHash (XXH64) of data: fast, and spreads every input bit over the
+// whole result, so cache keys collide only by chance
+inline uint64_t xxHash64(std::string_view data, uint64_t seed = 0)
+{
+    const uint64_t PRIME1 = 0x9E3779B185EBCA87ull, PRIME2 = 0xC2B2AE3D27D4EB4Full, PRIME3 = 0x165667B19E3779F9ull,
+                   PRIME4 = 0x85EBCA77C2B2AE63ull, PRIME5 = 0x27D4EB2F165667C5ull;
+    auto rotate = [](uint64_t value, int bits) { return (value << bits) | (value >> (64 - bits)); };
+    auto round = [&](uint64_t accumulator, uint64_t input) { return rotate(accumulator + input * PRIME2, 31) * PRIME1; };
+    auto read64 = [&](size_t at) {
+        uint64_t value;
+        memcpy(&value, data.data() + at, sizeof value);
+        return value;
+    };
+
+    size_t at = 0;
+    uint64_t hash;
+    if (data.size() >= 32)
+    {
+        uint64_t lanes[4] = {seed + PRIME1 + PRIME2, seed + PRIME2, seed, seed - PRIME1};
+        for (; at + 32 <= data.size(); at += 32)
+        {
+            for (int lane = 0; lane < 4; lane++)
+                lanes[lane] = round(lanes[lane], read64(at + 8 * lane));
+        }
+        hash = rotate(lanes[0], 1) + rotate(lanes[1], 7) + rotate(lanes[2], 12) + rotate(lanes[3], 18);
+        for (uint64_t lane : lanes)
+            hash = (hash ^ round(0, lane)) * PRIME1 + PRIME4;
+    }
+    else
+        hash = seed + PRIME5;
+    hash += data.size();
+    for (; at + 8 <= data.size(); at += 8)
+        hash = rotate(hash ^ round(0, read64(at)), 27) * PRIME1 + PRIME4;
+    if (at + 4 <= data.size())
+    {
+        uint32_t value;
+        memcpy(&value, data.data() + at, sizeof value);
+        hash = rotate(hash ^ (value * PRIME1), 23) * PRIME2 + PRIME3;
+        at += 4;
+    }
+    for (; at < data.size(); at++)
+        hash = rotate(hash ^ (uint8_t(data[at]) * PRIME5), 11) * PRIME1;
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    return hash ^ (hash >> 32);
+}
+
+// A directory of front-end results, one file per source, so a file that
+// has not changed since it was last compiled skips lexing and parsing.
+// Entries are keyed by the XXH64 of the source, seeded with VERSION and
+// the options that change what the front end prints; each one ends in the
+// XXH64 of its contents, so a damaged entry is a miss. A hit refreshes the
+// entry's modification time, and when the entries outgrow the size cap the
+// ones used longest ago are evicted, checked on open, lookup and store.
+// Hit, miss and eviction counts add up across runs in the file
+// "statistics", which runs update one at a time.
+class CompileCache
+{
+private:
+    static constexpr char MAGIC[8] = {'C', 'A', 'C', 'H', 'E', 'A', 'S', 'T'};
+    // Bump whenever the entry layout, Node or what the front end prints
+    // changes, so entries of an older compiler are misses
+    static const uint32_t VERSION = 3;
+
+    std::filesystem::path directory;
+    uint64_t capacity; // Bytes
+    std::atomic<uint64_t> hits{0}, misses{0}, evictions{0};
+    std::atomic<uint64_t> bytesHeld{0}; // Entries as of the last eviction scan, plus what was stored since
+    std::mutex evicting;
+
+    std::filesystem::path entryPath(uint64_t key) const
+    {
+        char name[24];
+        snprintf(name, sizeof name, "%016llx.ast", (unsigned long long)key);
+        return directory / name;
+    }
+
+    // Removes the least recently used entries until the rest fit the cap
+    void evict();
+
+    static void put(std::string &data, const void *bytes, size_t size) { data.append((const char *)bytes, size); }
+
+    template <typename T>
+    static void put(std::string &data, T value)
+    {
+        put(data, &value, sizeof value);
+    }
+
+public:
+    CompileCache(const std::string &directory, uint64_t capacity) : directory(directory), capacity(capacity) {}
+
+    // False if the directory does not exist and cannot be made. Evicts what
+    // is over the cap, as an earlier run may have had a bigger one.
+    bool open();
+
+    static uint64_t key(std::string_view source, size_t maxErrors)
+    {
+        std::string seed = std::string(MAGIC, sizeof MAGIC) + " version " + std::to_string(VERSION) + " max-errors " +
+                           std::to_string(maxErrors);
+        return xxHash64(source, xxHash64(seed));
+    }
+
+    // Fills result and, unless the source had errors, arena from the entry of key
+    bool load(uint64_t key, size_t sourceSize, CompileArena &arena, FrontEndResult &result);
+
+    void store(uint64_t key, size_t sourceSize, const CompileArena &arena, const FrontEndResult &result);
+
+    // Adds this run's counts to the ones kept in the directory and, if
+    // report is set, prints both
+    void saveStatistics(std::ostream *report);
+};
+
+#endif
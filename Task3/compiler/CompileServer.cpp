@@ -0,0 +1,415 @@
+#include "CompileServer.h"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <ios>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "../../common/SourceFile.h"
+#include "Compile.h"
+#include "Lexer.h"
+#include "CompileCache.h"
+
+using namespace std;
+
+#ifndef _WIN32
+
+// Fills in the address of a Unix domain socket. Returns false if the path is too long for one.
+static bool socketAddress(const string &path, sockaddr_un &address)
+{
+    memset(&address, 0, sizeof address);
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof address.sun_path)
+        return false;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return true;
+}
+
+// Writes all of data to a socket. Returns false if the peer went away.
+static bool sendAll(int connection, string_view data)
+{
+    while (!data.empty())
+    {
+        ssize_t count = write(connection, data.data(), data.size());
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count <= 0)
+            return false;
+        data.remove_prefix(size_t(count));
+    }
+    return true;
+}
+
+// Reads from a socket until the peer closes its end or, if a terminator is
+// given, until what was read ends with it. Gives up past limit bytes, or
+// once timeoutMs milliseconds have passed if that is not negative.
+// Returns false on an error.
+static bool receive(int connection, string &data, string_view terminator = {}, size_t limit = SIZE_MAX,
+                    int timeoutMs = -1)
+{
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    char buffer[4096];
+    while (terminator.empty() || data.size() < terminator.size() ||
+           data.compare(data.size() - terminator.size(), terminator.size(), terminator) != 0)
+    {
+        if (timeoutMs >= 0)
+        {
+            auto left = chrono::duration_cast<chrono::milliseconds>(deadline - chrono::steady_clock::now());
+            pollfd readable{connection, POLLIN, 0};
+            int ready = left.count() > 0 ? poll(&readable, 1, int(left.count())) : 0;
+            if (ready < 0 && errno == EINTR)
+                continue;
+            if (ready <= 0)
+                return false;
+        }
+        ssize_t count = read(connection, buffer, sizeof buffer);
+        if (count < 0 && errno == EINTR)
+            continue;
+        if (count < 0 || data.size() + size_t(count) > limit)
+            return false;
+        if (count == 0)
+            return terminator.empty();
+        data.append(buffer, size_t(count));
+    }
+    return true;
+}
+
+// A long-running compiler for --serve. It listens on a Unix domain socket
+// and keeps the front-end results of every file it has been asked about in
+// memory, so a file that has not changed is not read, lexed or parsed
+// again. A file whose size and modification time are as they were counts
+// as unchanged; otherwise it is read and hashed, and only a different XXH64
+// sends it through the front end again. Requests are served one at a time,
+// and a client gets REQUEST_TIMEOUT_MS to send its request and to take the
+// reply. Results are dropped least recently used first once there are more
+// than MAX_FILES or they hold more than MAX_BYTES.
+//
+// A request is a list of fields, each ending in '\n', closed by an empty
+// one: the verb ("check", "symbols", "compile", "stats" or "stop"), the
+// client's working directory, and for the first three the compile options
+// and the file. The reply is the exit status on a line of its own followed
+// by what the one-shot compiler would have printed, after which the server
+// closes the connection.
+class CompileServer
+{
+private:
+    static const size_t MAX_REQUEST = 1 << 20;
+    static const int REQUEST_TIMEOUT_MS = 10000;
+    static const size_t MAX_FILES = 4096;
+    static const size_t MAX_BYTES = size_t(1) << 30;
+
+    struct Entry
+    {
+        int64_t modified = 0;
+        uint64_t size = 0;
+        uint64_t hash = 0;
+        CompileArena arena;
+        FrontEndResult result;
+        string symbolTable; // What --symbols prints if there were no errors
+        size_t bytes = 0;   // Memory the entry holds, about
+        list<string>::iterator recent;
+    };
+
+    string socketPath; // Relative to the directory the server started in, which requests do not change
+    // By absolute path and --max-errors, since the front end stops after that many
+    unordered_map<string, unique_ptr<Entry>> files;
+    list<string> recentFiles; // Keys of files, most recently used first
+    size_t bytesHeld = 0;
+    uint64_t requests = 0, unchanged = 0, rehashed = 0, parsed = 0, evicted = 0;
+
+    void forget(const string &key)
+    {
+        auto found = files.find(key);
+        bytesHeld -= found->second->bytes;
+        recentFiles.erase(found->second->recent);
+        files.erase(found);
+    }
+
+    // The entry of path, brought up to date with the file; null if it cannot be read
+    Entry *lookup(const string &path, const CompileOptions &options)
+    {
+        string key = path + "\n" + to_string(options.maxErrors);
+        error_code error;
+        int64_t modified = int64_t(filesystem::last_write_time(path, error).time_since_epoch().count());
+        uint64_t size = error ? 0 : uint64_t(filesystem::file_size(path, error));
+        bool known = files.count(key) > 0;
+        if (error)
+        {
+            if (known)
+                forget(key); // Deleted, most likely
+            return nullptr;
+        }
+        unique_ptr<Entry> &entry = files[key];
+        if (!known)
+        {
+            entry = make_unique<Entry>();
+            recentFiles.push_front(key);
+            entry->recent = recentFiles.begin();
+        }
+        else
+            recentFiles.splice(recentFiles.begin(), recentFiles, entry->recent);
+        if (known && entry->modified == modified && entry->size == size)
+        {
+            unchanged++;
+            return entry.get();
+        }
+
+        SourceFile file;
+        if (!openSource(file, path))
+        {
+            forget(key);
+            return nullptr;
+        }
+        uint64_t hash = xxHash64(file.text());
+        entry->modified = modified;
+        entry->size = size;
+        if (known && entry->hash == hash)
+        {
+            rehashed++;
+            return entry.get();
+        }
+        entry->hash = hash;
+        entry->symbolTable.clear();
+        entry->result = runFrontEnd(file.text(), options, entry->arena, &entry->symbolTable);
+        entry->arena.tokens = TokenBuffer(); // Only needed while parsing
+        entry->arena.lines.index(file.text()); // The file is closed before the back end asks for lines
+        parsed++;
+
+        bytesHeld -= entry->bytes;
+        entry->bytes = sizeof(Entry) + key.size() + entry->arena.ast.memoryUsed() + entry->arena.names.memoryUsed() + entry->arena.lines.memoryUsed() +
+                       entry->result.text.capacity() + entry->symbolTable.capacity();
+        bytesHeld += entry->bytes;
+        Entry *current = entry.get();
+        while (files.size() > 1 && (files.size() > MAX_FILES || bytesHeld > MAX_BYTES))
+        {
+            forget(recentFiles.back()); // Never the current one, which is at the front
+            evicted++;
+        }
+        return current;
+    }
+
+    // Answers one request, setting the client's exit status and whether to stop serving
+    string answer(const vector<string> &fields, int &status, bool &stop)
+    {
+        ostringstream out;
+        status = 1;
+        requests++;
+        if (fields.size() < 2)
+        {
+            out << "Error: Malformed request" << endl;
+            return out.str();
+        }
+        const string &verb = fields[0];
+        if (verb == "stats")
+        {
+            out << files.size() << " result(s) in memory, " << bytesHeld / 1024 << " KB, " << evicted << " evicted. "
+                << requests << " request(s): " << parsed << " parsed, " << unchanged << " unchanged, " << rehashed
+                << " modified but with the same text" << endl;
+            status = 0;
+            return out.str();
+        }
+        if (verb == "stop")
+        {
+            stop = true;
+            status = 0;
+            return out.str();
+        }
+        if (verb != "check" && verb != "symbols" && verb != "compile")
+        {
+            out << "Error: Unknown request " << verb << endl;
+            return out.str();
+        }
+        if (fields.size() < 3)
+        {
+            out << "Error: Malformed request" << endl;
+            return out.str();
+        }
+
+        // Relative paths, of the file and in --emit-asm, are the client's
+        filesystem::path directory = fields[1];
+        if (!directory.is_absolute())
+        {
+            out << "Error: The client's directory " << fields[1] << " is not an absolute path" << endl;
+            return out.str();
+        }
+        CompileOptions options;
+        vector<const char *> arguments;
+        for (size_t i = 2; i + 1 < fields.size(); i++)
+            arguments.push_back(fields[i].c_str());
+        for (int arg = 0; arg < int(arguments.size()); arg++)
+        {
+            if (!parseCompileOption(int(arguments.size()), arguments.data(), arg, options))
+            {
+                out << "Error: The server does not take " << arguments[arg] << endl;
+                return out.str();
+            }
+        }
+        if (!options.asmPath.empty())
+            options.asmPath = (directory / options.asmPath).string();
+        Entry *entry = lookup((directory / fields.back()).lexically_normal().string(), options);
+        if (!entry)
+        {
+            out << "Error: Could not open file " << fields.back() << endl;
+            return out.str();
+        }
+        if (verb == "check" || (verb == "symbols" && entry->result.failed))
+        {
+            out << entry->result.text;
+            status = entry->result.failed ? 1 : 0;
+        }
+        else if (verb == "symbols")
+        {
+            out << entry->symbolTable;
+            status = 0;
+        }
+        else
+            status = finishCompile(entry->result, entry->arena, options, out) ? 0 : 1;
+        return out.str();
+    }
+
+public:
+    explicit CompileServer(string socketPath) : socketPath(move(socketPath)) {}
+
+    // Serves requests until one says stop. Returns main's exit status.
+    int run()
+    {
+        sockaddr_un address;
+        if (!socketAddress(socketPath, address))
+        {
+            cerr << "Error: Socket path " << socketPath << " is too long" << endl;
+            return 1;
+        }
+        int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0)
+        {
+            cerr << "Error: Could not create a socket" << endl;
+            return 1;
+        }
+        // A socket left behind by a server that did not stop would block
+        // bind(), but one that still answers belongs to a running server
+        struct stat info;
+        if (stat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+        {
+            if (connect(listener, reinterpret_cast<sockaddr *>(&address), sizeof address) == 0)
+            {
+                cerr << "Error: A server is already listening on " << socketPath << endl;
+                close(listener);
+                return 1;
+            }
+            unlink(socketPath.c_str());
+        }
+        if (bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof address) != 0 || listen(listener, 16) != 0)
+        {
+            cerr << "Error: Could not listen on " << socketPath << endl;
+            close(listener);
+            return 1;
+        }
+        signal(SIGPIPE, SIG_IGN); // A client that goes away mid-reply must not end the server
+        cerr << "Serving on " << socketPath << endl;
+
+        bool stop = false;
+        while (!stop)
+        {
+            int connection = accept(listener, nullptr, nullptr);
+            if (connection < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                cerr << "Error: Could not accept a connection on " << socketPath << endl;
+                break;
+            }
+            // A reply the client does not take must not hold up the server either
+            timeval timeout{REQUEST_TIMEOUT_MS / 1000, REQUEST_TIMEOUT_MS % 1000 * 1000};
+            setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+            string request;
+            if (receive(connection, request, "\n\n", MAX_REQUEST, REQUEST_TIMEOUT_MS))
+            {
+                vector<string> fields;
+                for (size_t start = 0, end; (end = request.find('\n', start)) != start; start = end + 1)
+                    fields.push_back(request.substr(start, end - start));
+                int status = 1;
+                string reply = answer(fields, status, stop);
+                sendAll(connection, to_string(status) + "\n" + reply);
+            }
+            close(connection);
+        }
+        close(listener);
+        unlink(socketPath.c_str());
+        return stop ? 0 : 1;
+    }
+};
+#endif
+
+int serve(const string &socketPath)
+{
+#ifndef _WIN32
+    return CompileServer(socketPath).run();
+#else
+    cerr << "Error: --serve needs Unix domain sockets" << endl;
+    return 1;
+#endif
+}
+
+int askServer(const string &socketPath, const string &verb, const vector<string> &fields, ostream &out)
+{
+#ifndef _WIN32
+    error_code error;
+    string request = verb + "\n" + filesystem::current_path(error).string() + "\n";
+    for (const string &field : fields)
+    {
+        if (field.empty() || field.find('\n') != string::npos)
+        {
+            cerr << "Error: Arguments sent to the server must be non-empty and without newlines" << endl;
+            return 1;
+        }
+        request += field + "\n";
+    }
+    request += "\n";
+
+    sockaddr_un address;
+    int connection = socketAddress(socketPath, address) ? socket(AF_UNIX, SOCK_STREAM, 0) : -1;
+    if (connection < 0 || connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof address) != 0)
+    {
+        cerr << "Error: Could not connect to a server on " << socketPath << endl;
+        if (connection >= 0)
+            close(connection);
+        return 1;
+    }
+    string reply;
+    bool answered = sendAll(connection, request) && receive(connection, reply);
+    close(connection);
+    size_t newline = reply.find('\n');
+    if (!answered || newline == string::npos)
+    {
+        cerr << "Error: The server on " << socketPath << " did not answer" << endl;
+        return 1;
+    }
+    out.write(reply.data() + newline + 1, streamsize(reply.size() - newline - 1));
+    out.flush();
+    return atoi(reply.c_str());
+#else
+    (void)verb;
+    (void)fields;
+    (void)out;
+    cerr << "Error: --connect needs Unix domain sockets, so cannot reach " << socketPath << endl;
+    return 1;
+#endif
+}
@@ -0,0 +1,17 @@
+#ifndef COMPILER_COMPILE_SERVER_H
+#define COMPILER_COMPILE_SERVER_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Runs a CompileServer on socketPath, for --serve
+int serve(const std::string &socketPath);
+
+// The client side of --serve, for --connect: sends the verb, the working
+// directory and the other fields (compile options and file) to the server
+// on socketPath, and prints its reply. Returns the exit status it gave.
+int askServer(const std::string &socketPath, const std::string &verb, const std::vector<std::string> &fields,
+              std::ostream &out);
+
+#endif
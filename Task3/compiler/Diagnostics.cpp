@@ -0,0 +1,78 @@
+#include "Diagnostics.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+void LineIndex::build()
+{
+    vector<uint32_t> found;
+    scan(0, src.size(), found);
+    newlines.assign(move(found));
+    built = true;
+    last = 0;
+}
+
+void LineIndex::scan(size_t from, size_t to, vector<uint32_t> &found) const
+{
+    const char *base = src.data();
+    for (const char *at = base + from, *end = base + to;
+         (at = static_cast<const char *>(memchr(at, '\n', size_t(end - at)))) != nullptr; at++)
+        found.push_back(uint32_t(at - base));
+}
+
+size_t LineIndex::lineIndex(size_t offset)
+{
+    if (!built)
+        build();
+    if (!onLine(last, offset))
+    {
+        if (last < newlines.size() && onLine(last + 1, offset))
+            last++;
+        else
+            last = newlines.lowerBound(uint32_t(offset));
+    }
+    return last;
+}
+
+ptrdiff_t LineIndex::replace(string_view text, size_t offset, size_t deleted, size_t inserted)
+{
+    src = text;
+    if (!built)
+        return 0; // No line was handed out, so none is off
+    size_t first = newlines.lowerBound(uint32_t(offset)), end = newlines.lowerBound(uint32_t(offset + deleted));
+    newlines.shift(end, ptrdiff_t(inserted) - ptrdiff_t(deleted));
+    vector<uint32_t> found;
+    scan(offset, offset + inserted, found);
+    MovingOffsets added;
+    added.assign(found);
+    newlines.splice(first, end, added);
+    last = 0;
+    return ptrdiff_t(found.size()) - ptrdiff_t(end - first);
+}
+
+void Diagnostics::append(const Diagnostics &other, size_t from, size_t to)
+{
+    for (const Diagnostic &diagnostic : other.errors)
+    {
+        if (diagnostic.offset >= from && diagnostic.offset < to)
+            error(diagnostic.offset, diagnostic.message);
+    }
+}
+
+void Diagnostics::report(ostream &out)
+{
+    sort(errors.begin(), errors.end(), [](const Diagnostic &a, const Diagnostic &b) {
+        return a.offset != b.offset ? a.offset < b.offset : a.message < b.message;
+    });
+    for (const Diagnostic &diagnostic : errors)
+    {
+        size_t offset = min(diagnostic.offset, src.size());
+        out << diagnostic.message << " on line " << lines.line(offset) << ", column " << lines.column(offset)
+            << endl;
+    }
+    if (full())
+        out << "Too many errors, stopped after " << maxErrors << "." << endl;
+    out << errors.size() << " error(s) found." << endl;
+}
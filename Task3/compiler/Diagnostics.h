@@ -0,0 +1,334 @@
+#ifndef COMPILER_DIAGNOSTICS_H
+#define COMPILER_DIAGNOSTICS_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Token.h"
+
+// A vector with a gap where it was last spliced, as editors keep their text.
+// A splice moves the gap there, which only moves the entries between it and
+// the previous splice; inserting more than the gap holds widens it by a
+// sixteenth of the size, so that the entries after it move now and then
+// rather than on every edit.
+template <typename T>
+class GapVector
+{
+private:
+    std::vector<T> items; // Entries [0, gapStart), the gap, then the rest
+    size_t gapStart = 0, gapSize = 0;
+
+    void moveGap(size_t to)
+    {
+        if (to < gapStart)
+            std::move_backward(items.begin() + to, items.begin() + gapStart, items.begin() + gapStart + gapSize);
+        else
+            std::move(items.begin() + gapStart + gapSize, items.begin() + to + gapSize, items.begin() + gapStart);
+        gapStart = to;
+    }
+
+public:
+    size_t size() const { return items.size() - gapSize; }
+    bool empty() const { return size() == 0; }
+    const T &operator[](size_t i) const { return items[i < gapStart ? i : i + gapSize]; }
+    T &operator[](size_t i) { return items[i < gapStart ? i : i + gapSize]; }
+    size_t memoryUsed() const { return items.capacity() * sizeof(T); }
+
+    void clear() { assign({}); }
+
+    void assign(std::vector<T> values)
+    {
+        items = std::move(values);
+        gapStart = gapSize = 0;
+    }
+
+    void push_back(const T &value)
+    {
+        if (gapSize != 0)
+        {
+            moveGap(size());
+            items.resize(gapStart);
+            gapSize = 0;
+        }
+        items.push_back(value);
+    }
+
+    // Replaces entries [from, to) with count values
+    void splice(size_t from, size_t to, const T *values, size_t count)
+    {
+        if (gapSize == 0)
+            gapStart = from;
+        else
+            moveGap(from);
+        gapSize += to - from;
+        if (count > gapSize)
+        {
+            size_t wider = count - gapSize + size() / 16 + 16;
+            items.insert(items.begin() + gapStart, wider, T());
+            gapSize += wider;
+        }
+        std::copy(values, values + count, items.begin() + gapStart);
+        gapStart += count;
+        gapSize -= count;
+    }
+
+    void splice(size_t from, size_t to, const std::vector<T> &replacement)
+    {
+        splice(from, to, replacement.data(), replacement.size());
+    }
+
+    void splice(size_t from, size_t to, const GapVector &replacement)
+    {
+        std::vector<T> values(replacement.size());
+        for (size_t i = 0; i < values.size(); i++)
+            values[i] = replacement[i];
+        splice(from, to, values);
+    }
+};
+
+// Ascending offsets into a text that is edited in place, or ascending token
+// numbers, as incremental parsing keeps them. An edit moves every entry past
+// it by the same amount. Rather than rewriting them all, the latest move is
+// kept pending from one entry on, and when another comes only the entries
+// between the two are rewritten; the entries are kept in a GapVector for
+// the same reason. Edits close together cost little however much text
+// follows them.
+class MovingOffsets
+{
+private:
+    GapVector<uint32_t> items; // Entries from pendingFrom on are pendingBy short of their value
+    size_t pendingFrom = SIZE_MAX;
+    int64_t pendingBy = 0;
+
+    void add(size_t from, size_t to, int64_t by)
+    {
+        for (size_t i = from; i < std::min(to, items.size()); i++)
+            items[i] = uint32_t(items[i] + by);
+    }
+
+public:
+    size_t size() const { return items.size(); }
+    uint32_t operator[](size_t i) const { return uint32_t(items[i] + (i >= pendingFrom ? pendingBy : 0)); }
+    size_t memoryUsed() const { return items.memoryUsed(); }
+
+    void clear() { assign({}); }
+
+    void assign(std::vector<uint32_t> values)
+    {
+        items.assign(std::move(values));
+        pendingFrom = SIZE_MAX;
+        pendingBy = 0;
+    }
+
+    void push_back(uint32_t value) { items.push_back(uint32_t(value - (items.size() >= pendingFrom ? pendingBy : 0))); }
+
+    // Moves entries [from, size()) by delta
+    void shift(size_t from, int64_t delta)
+    {
+        if (pendingBy == 0)
+            pendingFrom = from;
+        else if (from >= pendingFrom)
+        {
+            add(pendingFrom, from, pendingBy);
+            pendingFrom = from;
+        }
+        else
+            add(from, pendingFrom, delta);
+        pendingBy += delta;
+    }
+
+    // Replaces entries [from, to) with those of replacement
+    void splice(size_t from, size_t to, const MovingOffsets &replacement)
+    {
+        // Settle the pending move up to to, so the new entries go in as they are
+        if (pendingBy != 0 && pendingFrom < to)
+        {
+            add(pendingFrom, from, pendingBy);
+            pendingFrom = to;
+        }
+        std::vector<uint32_t> values(replacement.size());
+        for (size_t i = 0; i < values.size(); i++)
+            values[i] = replacement[i];
+        items.splice(from, to, values);
+        if (pendingBy != 0)
+            pendingFrom = pendingFrom - to + from + values.size();
+    }
+
+    // The first entry not below value
+    size_t lowerBound(uint32_t value) const
+    {
+        size_t low = 0, high = items.size();
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+            if ((*this)[middle] < value)
+                low = middle + 1;
+            else
+                high = middle;
+        }
+        return low;
+    }
+};
+
+// Where the lines of a source start. Nothing is done until a line is first
+// asked for; then one memchr pass (vectorised by the C library) records the
+// offset of every '\n', and each lookup is a binary search over them. The
+// back ends ask in source order, so the line of the previous lookup is
+// tried first and most lookups cost a compare or two.
+class LineIndex
+{
+private:
+    std::string_view src;
+    MovingOffsets newlines; // Offsets of every '\n', in order
+    bool built = false;
+    size_t last = 0; // Line index of the previous lookup
+
+    void build();
+
+    // Appends the offsets of the newlines in [from, to) to found
+    void scan(size_t from, size_t to, std::vector<uint32_t> &found) const;
+
+    // Whether offset is on line index k, which runs past the newline before it up to its own
+    bool onLine(size_t k, size_t offset) const
+    {
+        return (k == 0 || newlines[k - 1] < offset) && (k == newlines.size() || offset <= newlines[k]);
+    }
+
+    // 0-based line of offset: how many newlines come before it
+    size_t lineIndex(size_t offset);
+
+public:
+    explicit LineIndex(std::string_view src = {}) : src(src) {}
+
+    // Starts over on another text
+    void reset(std::string_view text)
+    {
+        src = text;
+        built = false;
+        newlines.clear();
+    }
+
+    // Indexes all of text now, so lines can still be looked up once it is gone
+    void index(std::string_view text)
+    {
+        reset(text);
+        build();
+        src = {};
+    }
+
+    size_t memoryUsed() const { return newlines.memoryUsed(); }
+
+    // Follows an edit to the text, which now reads inserted bytes at offset
+    // where deleted ones were. Returns how many lines the text gained; lines
+    // handed out before the edit for offsets past it are off by that much.
+    ptrdiff_t replace(std::string_view text, size_t offset, size_t deleted, size_t inserted);
+
+    // 1-based line and column of the byte at offset
+    uint32_t line(size_t offset) { return uint32_t(lineIndex(offset) + 1); }
+    uint32_t column(size_t offset)
+    {
+        size_t k = lineIndex(offset);
+        return uint32_t(offset - (k == 0 ? 0 : newlines[k - 1] + 1) + 1);
+    }
+};
+
+// Collects errors so one run reports every problem instead of stopping at the
+// first. A diagnostic only keeps the byte offset it points at; line and column
+// are looked up in a LineIndex when the list is printed. Once
+// maxErrors have been recorded (0 means no limit) the rest are dropped and
+// the parser stops.
+class Diagnostics
+{
+private:
+    struct Diagnostic
+    {
+        size_t offset;
+        uint32_t origin; // Whoever was checking when it was reported, see setOrigin()
+        std::string message;
+    };
+
+    std::string_view src;
+    LineIndex lines;
+    size_t maxErrors;
+    std::vector<Diagnostic> errors;
+    uint32_t origin = NO_SYMBOL;
+
+public:
+    Diagnostics(std::string_view src, size_t maxErrors) : src(src), lines(src), maxErrors(maxErrors) {}
+
+    // Offset of a view into the source, such as a token's value
+    size_t offsetOf(std::string_view text) const { return size_t(text.data() - src.data()); }
+
+    // Lines of the source, for positions other than the diagnostics'
+    LineIndex &lineIndex() { return lines; }
+
+    void error(size_t offset, std::string message)
+    {
+        if (!full())
+            errors.push_back(Diagnostic{offset, origin, std::move(message)});
+    }
+
+    bool full() const { return maxErrors != 0 && errors.size() >= maxErrors; }
+    size_t limit() const { return maxErrors; }
+    void setLimit(size_t limit) { maxErrors = limit; }
+    size_t count() const { return errors.size(); }
+
+    void setSource(std::string_view text)
+    {
+        src = text;
+        lines.reset(text);
+    }
+
+    // Follows an in-place edit of the source, see LineIndex::replace
+    ptrdiff_t edit(std::string_view text, size_t offset, size_t deleted, size_t inserted)
+    {
+        src = text;
+        return lines.replace(text, offset, deleted, inserted);
+    }
+
+    // Copies the errors of other whose offsets are in [from, to)
+    void append(const Diagnostics &other, size_t from, size_t to);
+    void clear() { errors.clear(); }
+
+    // Tags the errors reported from now on, so they can be dropped together
+    // when the code that produced them is checked again. NO_SYMBOL means none.
+    void setOrigin(uint32_t tag) { origin = tag; }
+
+    // After an edit, drops the errors recorded before firstNew that came from
+    // a replaced origin, or that have no origin and lay in the re-lexed range
+    // [from, to) of the old text. Kept ones at or after editEnd move by delta.
+    // Errors from firstNew on are already in new-text offsets.
+    template <typename Replaced>
+    void rebase(size_t firstNew, size_t from, size_t to, size_t editEnd, ptrdiff_t delta, Replaced replaced)
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < errors.size(); i++)
+        {
+            Diagnostic &diagnostic = errors[i];
+            if (i < firstNew)
+            {
+                if (diagnostic.origin == NO_SYMBOL ? diagnostic.offset >= from && diagnostic.offset < to
+                                                   : replaced(diagnostic.origin))
+                    continue;
+                if (diagnostic.offset >= editEnd)
+                    diagnostic.offset += delta;
+            }
+            if (kept != i)
+                errors[kept] = std::move(diagnostic);
+            kept++;
+        }
+        errors.resize(kept);
+    }
+
+    // Prints the errors in source order. Ties are broken by text rather than by
+    // when they were reported, which differs between full and incremental runs.
+    void report(std::ostream &out = std::cout);
+};
+
+#endif
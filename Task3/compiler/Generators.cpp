@@ -0,0 +1,249 @@
+#include "Generators.h"
+
+#include <algorithm>
+#include <fstream>
+#include <ios>
+
+using namespace std;
+
+string ProgramGenerator::intExpression(int depth)
+{
+    if (depth == 0 || next(3) == 0)
+    {
+        static const char *const variables[] = {"a", "b", "c"};
+        uint32_t choice = next(16);
+        if (choice < 6)
+            return variables[choice % 3];
+        if (choice < 10 && loops > 0)
+            return "i" + to_string(next(loops));
+        if (choice == 10)
+            return to_string(3000000000ull + next(1000)); // Wider than an immediate
+        return to_string(next(20));
+    }
+    static const char *const operators[] = {" + ", " - ", " * ", " / "};
+    uint32_t choice = next(10);
+    if (choice == 0)
+        return "-" + intExpression(depth - 1);
+    if (choice == 1)
+        return "(" + floatExpression(depth - 1) + ")"; // Saturates on the way back to int
+    if (choice % 4 == 3 && next(3) != 0)
+        return "(" + intExpression(depth - 1) + " / " + to_string(1 + next(9)) + ")";
+    return "(" + intExpression(depth - 1) + operators[choice % 4] + intExpression(depth - 1) + ")";
+}
+
+string ProgramGenerator::floatExpression(int depth)
+{
+    if (depth == 0 || next(3) == 0)
+    {
+        static const char *const leaves[] = {"x", "y", "0.5", "2.25", "a", "b", "x", "y", "0.5", "2.25", "c",
+                                             "4611686018427387904.0"}; // Saturates when converted
+        return leaves[next(12)];
+    }
+    static const char *const operators[] = {" + ", " - ", " * ", " / "};
+    if (next(8) == 0)
+        return "-" + floatExpression(depth - 1);
+    return "(" + floatExpression(depth - 1) + operators[next(4)] +
+           (next(3) == 0 ? intExpression(depth - 1) : floatExpression(depth - 1)) + ")";
+}
+
+string ProgramGenerator::condition(int depth)
+{
+    static const char *const comparisons[] = {" == ", " != ", " < ", " <= ", " > ", " >= "};
+    uint32_t choice = next(depth > 0 ? 7 : 3);
+    if (choice == 0)
+        return "p";
+    if (choice == 1)
+        return "(" + intExpression(2) + comparisons[next(6)] + intExpression(2) + ")";
+    if (choice == 2)
+        return "(" + floatExpression(2) + comparisons[next(6)] + floatExpression(2) + ")";
+    if (choice == 3)
+        return "!" + condition(depth - 1);
+    if (choice == 4)
+        return "(" + condition(depth - 1) + (next(2) ? " && " : " || ") + condition(depth - 1) + ")";
+    return choice == 5 ? intExpression(1) : floatExpression(1); // Converted to bool
+}
+
+string ProgramGenerator::block(int depth, const string &indent)
+{
+    string text = indent + "{\n";
+    for (uint32_t count = 1 + next(3); count > 0; count--)
+        text += statement(depth - 1, indent + "    ");
+    return text + indent + "}\n";
+}
+
+string ProgramGenerator::statement(int depth, const string &indent)
+{
+    uint32_t choice = next(depth > 0 ? 10 : 5);
+    if (choice == 0)
+        return indent + "a = " + intExpression(3) + ";\n";
+    if (choice == 1)
+        return indent + (next(2) ? "b = " : "c = ") + intExpression(3) + ";\n";
+    if (choice == 2)
+        return indent + (next(2) ? "x = " : "y = ") + floatExpression(3) + ";\n";
+    if (choice == 3)
+        return indent + "p = " + condition(2) + ";\n";
+    if (choice == 4 && next(3) == 0)
+        return indent + "if (" + condition(1) + ") return " + returnValue() + ";\n";
+    if (choice == 4)
+        return indent + "c = " + intExpression(2) + ";\n";
+    if (choice < 8 || loops == 3)
+    {
+        string text = indent + "if (" + condition(2) + ")\n" + block(depth, indent);
+        if (next(2))
+            text += indent + "else\n" + block(depth, indent);
+        return text;
+    }
+    string counter = "i" + to_string(loops++);
+    string text = indent + "for (" + counter + " = 0; " + counter + " < " + to_string(next(6)) + "; " + counter +
+                  " = " + counter + " + 1)\n" + block(depth, indent);
+    loops--;
+    return text;
+}
+
+string ProgramGenerator::program()
+{
+    string text = "int a = " + to_string(next(100)) + "; int b = " + to_string(next(10)) +
+                  "; int c;\nfloat x = 1.5; float y; bool p;\nint i0; int i1; int i2;\n";
+    for (uint32_t count = 2 + next(6); count > 0; count--)
+        text += statement(3, "");
+    uint32_t ending = next(4);
+    if (ending < 2)
+        text += "return a + b * 3 + c * 7;\n"; // Sums up the state in the exit status
+    else if (ending == 2)
+        text += "return " + returnValue() + ";\n";
+    return text;
+}
+
+string SourceGenerator::variable(Kind kind)
+{
+    static const char prefixes[] = {'g', 'f', 's', 'b'};
+    if (!locals[kind].empty() && (declared == 0 || next(3) == 0))
+        return locals[kind][next(uint32_t(locals[kind].size()))];
+    if (declared == 0)
+        return "";
+    return prefixes[kind] + to_string(declared - 1 - min(declared - 1, uint64_t(next(WINDOW))));
+}
+
+string SourceGenerator::expression(Kind kind, int depth)
+{
+    static const char *const arithmetic[] = {" + ", " - ", " * ", " / "};
+    static const char *const comparisons[] = {" == ", " != ", " < ", " <= ", " > ", " >= "};
+    static const char *const words[] = {"alpha", "beta", "gamma", "delta", "epsilon"};
+    if (depth == 0 || next(4) == 0)
+    {
+        string name = next(3) > 0 ? variable(kind) : "";
+        if (!name.empty())
+            return name;
+        switch (kind)
+        {
+        case INT: return to_string(next(100000));
+        case FLOAT: return to_string(next(1000)) + "." + to_string(next(100));
+        case STRING: return string("\"") + words[next(5)] + "\"";
+        case BOOL: return "(" + to_string(next(100)) + " < 50)";
+        }
+    }
+    switch (kind)
+    {
+    case INT:
+        if (next(8) == 0)
+            return "-" + expression(INT, depth - 1);
+        return "(" + expression(INT, depth - 1) + arithmetic[next(4)] + expression(INT, depth - 1) + ")";
+    case FLOAT:
+        return "(" + expression(FLOAT, depth - 1) + arithmetic[next(4)] +
+               expression(next(3) == 0 ? INT : FLOAT, depth - 1) + ")";
+    case STRING:
+        return expression(STRING, depth - 1) + " + " + expression(STRING, depth - 1);
+    case BOOL:
+        break;
+    }
+    uint32_t choice = next(5);
+    if (choice == 0)
+        return "!" + expression(BOOL, depth - 1);
+    if (choice == 1)
+        return "(" + expression(BOOL, depth - 1) + (next(2) ? " && " : " || ") + expression(BOOL, depth - 1) + ")";
+    if (choice == 2)
+        return "(" + expression(STRING, 1) + (next(2) ? " == " : " != ") + expression(STRING, 1) + ")";
+    Kind compared = choice == 3 ? INT : FLOAT;
+    return "(" + expression(compared, depth - 1) + comparisons[next(6)] + expression(compared, depth - 1) + ")";
+}
+
+void SourceGenerator::block(int depth, string &text, const string &indent)
+{
+    text += indent + "{\n";
+    scopeStarts.push_back({locals[INT].size(), locals[FLOAT].size(), locals[STRING].size(), locals[BOOL].size()});
+    string inner = indent + "    ";
+    if (next(2) == 0)
+    {
+        // Named after the depth, so they shadow the locals of enclosing blocks
+        Kind kind = Kind(next(4));
+        string name = string(1, "lmtq"[kind]) + to_string(depth);
+        declaration(kind, name, text, inner);
+        locals[kind].push_back(name);
+    }
+    for (uint32_t count = 1 + next(3); count > 0; count--)
+        statement(depth - 1, text, inner);
+    for (int kind = INT; kind <= BOOL; kind++)
+        locals[kind].resize(scopeStarts.back()[kind]);
+    scopeStarts.pop_back();
+    text += indent + "}\n";
+}
+
+void SourceGenerator::statement(int depth, string &text, const string &indent)
+{
+    uint32_t choice = next(depth > 0 ? 9 : 4);
+    if (choice < 4)
+    {
+        Kind kind = Kind(choice);
+        bool longExpression = next(64) == 0;
+        text += indent + variable(kind) + " = " + expression(kind, longExpression ? 8 : 3) + ";\n";
+        return;
+    }
+    if (choice < 6)
+    {
+        text += indent + "if (" + expression(BOOL, 2) + ")\n";
+        block(depth, text, indent);
+        if (next(2))
+        {
+            text += indent + "else\n";
+            block(depth, text, indent);
+        }
+        return;
+    }
+    if (choice < 8)
+    {
+        text += indent + "while (" + expression(BOOL, 2) + ")\n";
+        block(depth, text, indent);
+        return;
+    }
+    string counter = variable(INT);
+    text += indent + "for (" + counter + " = 0; " + counter + " < " + to_string(1 + next(100)) + "; " + counter +
+            " = " + counter + " + 1)\n";
+    block(depth, text, indent);
+}
+
+void SourceGenerator::generate(string &text, size_t bytes)
+{
+    while (text.size() < bytes)
+    {
+        declaration(INT, "g" + to_string(units), text, "");
+        declaration(FLOAT, "f" + to_string(units), text, "");
+        declaration(STRING, "s" + to_string(units), text, "");
+        declaration(BOOL, "b" + to_string(units), text, "");
+        declared = ++units;
+        statement(3, text, "");
+    }
+}
+
+bool writeGeneratedSource(const string &path, uint64_t bytes)
+{
+    ofstream file(path, ios::binary);
+    SourceGenerator generator(2024);
+    string piece;
+    for (uint64_t written = 0; written < bytes && file; written += piece.size())
+    {
+        piece.clear();
+        generator.generate(piece, size_t(min(bytes - written, uint64_t(1) << 20)));
+        file.write(piece.data(), streamsize(piece.size()));
+    }
+    return bool(file);
+}
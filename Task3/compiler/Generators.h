@@ -0,0 +1,106 @@
+#ifndef COMPILER_GENERATORS_H
+#define COMPILER_GENERATORS_H
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Builds random programs over int, float and bool variables: assignments,
+// if/else, nested counted loops and early returns, with division by
+// variables that may be zero. Loop counters are only written by their
+// loop, so every program ends. The same seed gives the same program.
+class ProgramGenerator
+{
+private:
+    uint32_t seed;
+    int loops = 0; // Counters in use: i0 to i<loops - 1>
+
+    uint32_t next(uint32_t range)
+    {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 16) % range;
+    }
+
+    std::string intExpression(int depth);
+
+    std::string floatExpression(int depth);
+
+    std::string condition(int depth);
+
+    std::string block(int depth, const std::string &indent);
+
+    std::string statement(int depth, const std::string &indent);
+
+    std::string returnValue()
+    {
+        uint32_t choice = next(3);
+        return choice == 0 ? intExpression(2) : choice == 1 ? floatExpression(2) : condition(1);
+    }
+
+public:
+    explicit ProgramGenerator(uint32_t seed) : seed(seed) {}
+
+    std::string program();
+};
+
+// Writes programs of any size for the scaling benchmark and --generate.
+// The text is a run of units; each declares a fresh global of every type
+// (g<n>, f<n>, s<n>, b<n>) and then one compound statement that nests if/else,
+// while and for with local declarations and assignments, over the globals of
+// the last few units. Now and then an expression is very long. Everything
+// is declared before use and type checks, so the whole front end runs on
+// it; it is not meant to be run, as its while loops need not end. The same seed always gives the same text, whether it is made at once
+// or in pieces.
+class SourceGenerator
+{
+private:
+    enum Kind
+    {
+        INT,
+        FLOAT,
+        STRING,
+        BOOL
+    };
+
+    static const uint64_t WINDOW = 16; // Units whose globals a unit uses
+
+    uint32_t seed;
+    uint64_t units = 0;    // Units begun
+    uint64_t declared = 0; // Units whose globals are all declared, and usable
+    std::vector<std::string> locals[4]; // In scope inside the unit being written
+    std::vector<std::array<size_t, 4>> scopeStarts; // Local counts of each kind when each open block began
+
+    uint32_t next(uint32_t range)
+    {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 16) % range;
+    }
+
+    // A variable of kind in scope, or "" if there is none yet
+    std::string variable(Kind kind);
+
+    std::string expression(Kind kind, int depth);
+
+    void declaration(Kind kind, const std::string &name, std::string &text, const std::string &indent)
+    {
+        static const char *const keywords[] = {"int ", "float ", "string ", "bool "};
+        text += indent + keywords[kind] + name + " = " + expression(kind, 2) + ";\n";
+    }
+
+    void block(int depth, std::string &text, const std::string &indent);
+
+    void statement(int depth, std::string &text, const std::string &indent);
+
+public:
+    explicit SourceGenerator(uint32_t seed) : seed(seed) {}
+
+    // Appends units to text until it is at least bytes long
+    void generate(std::string &text, size_t bytes);
+};
+
+// Writes a generated program of about bytes to path, a megabyte at a time.
+// Returns false if the file could not be written.
+bool writeGeneratedSource(const std::string &path, uint64_t bytes);
+
+#endif
@@ -0,0 +1,266 @@
+#include "IncrementalSession.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "TimeReport.h"
+
+using namespace std;
+
+void IncrementalSession::parseTopLevel(GapVector<Statement> &run, MovingOffsets &runTokens)
+{
+    runTokens.push_back(uint32_t(parser->position()));
+    Statement statement{NO_NODE, uint32_t(parser->symbols().visibleCount()), nextId++};
+    diagnostics.setOrigin(statement.id);
+    statement.node = parser->parseListedStatement();
+    diagnostics.setOrigin(NO_SYMBOL);
+    run.push_back(statement);
+}
+
+void IncrementalSession::parseAll()
+{
+    Lexer lexer(text, names, diagnostics);
+    diagnostics.setSource(text);
+    diagnostics.clear();
+    lexer.tokenize(tokens);
+    ast.reset();
+    stream = make_unique<TokenStream>(tokens);
+    parser = make_unique<Parser>(*stream, names, types, ast, diagnostics);
+    program = ast.add(N_PROGRAM, uint32_t(tokens.start(0)));
+    statements.clear();
+    firstTokens.clear();
+    while (tokens.type(parser->position()) != T_EOF && !diagnostics.full())
+        parseTopLevel(statements, firstTokens);
+    staleFrom = 0;
+    staleTo = SIZE_MAX;
+    storeProgramList();
+    fullParseNodes = ast.size();
+    garbage = 0;
+}
+
+void IncrementalSession::storeProgramList()
+{
+    ast[program].offset = uint32_t(tokens.start(0));
+    if (ast[program].b == NO_NODE) // A new program node has no list yet
+        ast[program].b = 0;
+    else if (ast[program].b == statements.size())
+    {
+        uint32_t *list = ast.statements(ast[program]);
+        uint32_t *starts = ast.statementStarts(ast[program]);
+        for (size_t i = staleFrom; i < min(staleTo, statements.size()); i++)
+        {
+            list[i] = statements[i].node;
+            starts[i] = uint32_t(tokens.start(firstTokens[i]));
+        }
+        staleFrom = staleTo = 0;
+        return;
+    }
+
+    vector<uint32_t> nodes, starts;
+    nodes.reserve(statements.size());
+    starts.reserve(statements.size());
+    for (size_t i = 0; i < statements.size(); i++)
+    {
+        nodes.push_back(statements[i].node);
+        starts.push_back(uint32_t(tokens.start(firstTokens[i])));
+    }
+    garbage += 2 * ast[program].b;
+    ast[program].a = ast.addList(nodes.data(), uint32_t(nodes.size()));
+    ast[program].b = uint32_t(nodes.size());
+    ast[program].c = ast.addList(starts.data(), uint32_t(starts.size()));
+    staleFrom = staleTo = 0;
+}
+
+pair<size_t, size_t> IncrementalSession::edit(size_t offset, size_t deleted, string_view inserted)
+{
+    TIME_SCOPE("edit");
+    offset = min(offset, text.size());
+    deleted = min(deleted, text.size() - offset);
+    ptrdiff_t delta = ptrdiff_t(inserted.size()) - ptrdiff_t(deleted);
+    // A buffer at the error limit was only parsed up to where it was reached
+    if (statements.empty() || garbage > 2 * fullParseNodes + 4096 || diagnostics.full())
+    {
+        text.replace(offset, deleted, inserted);
+        parseAll();
+        return {tokens.size(), statements.size()};
+    }
+
+    // Tokens before restart lex the same whatever follows them: the last
+    // token starting before the edit may merge with or grow into it
+    size_t restart = tokens.firstStartingAt(offset);
+    restart = restart > 0 ? restart - 1 : 0;
+    size_t reuse = tokens.firstStartingAt(offset + deleted);
+    size_t restartOffset = min(tokens.start(restart), offset);
+
+    // Edit the text in place, so only the offsets of tokens after the
+    // edit change; they move lazily, see MovingOffsets
+    text.replace(offset, deleted, inserted);
+    tokens.setSource(text);
+    if (delta != 0)
+        tokens.shift(reuse, delta);
+
+    // Errors the old text had are still counted until rebase() drops them, so
+    // the limit waits until the errors of the new text are known
+    size_t limit = diagnostics.limit();
+    diagnostics.setLimit(0);
+
+    // Re-lex until a token starts where an old one after the edit now starts;
+    // the lexer keeps no state, so from there on the old tokens are right
+    size_t firstNewError = diagnostics.count();
+    diagnostics.edit(text, offset, deleted, inserted.size());
+    Lexer lexer(text, names, diagnostics);
+    lexer.seek(restartOffset);
+    TokenBuffer relexed;
+    relexed.reset(text, names);
+    size_t sync = reuse;
+    while (true)
+    {
+        Token token = lexer.nextToken();
+        size_t start = relexed.startOf(token);
+        while (sync < tokens.size() && tokens.start(sync) < start)
+            sync++;
+        if (sync < tokens.size() && tokens.start(sync) == start)
+            break;
+        relexed.add(token);
+        if (token.type == T_EOF)
+        {
+            sync = tokens.size(); // An early '\0' ends the file before any old token
+            break;
+        }
+    }
+    // The token synced on was lexed again too, so its own error (an
+    // unterminated string starts at it) counts as re-lexed
+    size_t relexedEnd = sync < tokens.size() ? tokens.start(sync) - delta + 1 : SIZE_MAX;
+
+    size_t oldSyncToken = sync;
+    tokens.splice(restart, sync, relexed);
+    ptrdiff_t tokenDelta = ptrdiff_t(relexed.size()) - ptrdiff_t(oldSyncToken - restart);
+    size_t syncToken = restart + relexed.size();
+
+    // The statement before the re-lexed tokens may have peeked at the first of them
+    size_t peek = restart > 0 ? restart - 1 : 0;
+    size_t first = firstTokens.lowerBound(uint32_t(peek + 1));
+    first = first > 0 ? first - 1 : 0;
+
+    // Make the symbol table look as it did before the first re-parsed
+    // statement. The declarations of that one and later ones are only
+    // hidden, so they need not be made again if the run ends up the same.
+    SymbolTable &symbolTable = parser->symbols();
+    size_t symbolsBefore = statements[first].symbolsBefore;
+    symbolTable.hide(symbolsBefore);
+    size_t hiddenEnd = symbolTable.live().size();
+
+    // Re-parse until an old statement boundary past the re-lexed tokens
+    uint32_t nodeMark = ast.size();
+    GapVector<Statement> run;
+    MovingOffsets runTokens;
+    size_t next = first;
+    parser->seek(firstTokens[first]);
+    while (true)
+    {
+        size_t pos = parser->position();
+        while (next < statements.size() && ptrdiff_t(firstTokens[next]) + tokenDelta < ptrdiff_t(pos))
+            next++;
+        if (tokens.type(pos) == T_EOF)
+        {
+            next = statements.size();
+            break;
+        }
+        // Error recovery looks at the token before a statement, so that one must be old too
+        if (pos > syncToken && next < statements.size() &&
+            ptrdiff_t(firstTokens[next]) + tokenDelta == ptrdiff_t(pos))
+            break;
+        parseTopLevel(run, runTokens);
+    }
+
+    // Later statements are still right if the run declares the same names
+    // with the same types. Its declarations then take over the old nodes,
+    // which later statements refer to, and the hidden ones are shown again;
+    // otherwise parse on to the end.
+    const vector<Symbol> &live = symbolTable.live();
+    size_t oldDeclarations = (next < statements.size() ? statements[next].symbolsBefore : hiddenEnd) - symbolsBefore;
+    size_t newDeclarations = live.size() - hiddenEnd;
+    bool sameDeclarations = next < statements.size() && oldDeclarations == newDeclarations;
+    for (size_t i = 0; sameDeclarations && i < newDeclarations; i++)
+    {
+        const Symbol &symbol = live[hiddenEnd + i], &old = live[symbolsBefore + i];
+        sameDeclarations = symbol.name == old.name && symbol.type == old.type;
+    }
+
+    if (sameDeclarations)
+    {
+        unordered_map<uint32_t, uint32_t> moved; // New declaration node -> old one
+        for (size_t i = 0; i < newDeclarations; i++)
+        {
+            uint32_t node = live[hiddenEnd + i].declaration, old = live[symbolsBefore + i].declaration;
+            ast[old] = ast[node];
+            moved[node] = old;
+        }
+        symbolTable.popTo(hiddenEnd);
+        symbolTable.show();
+        // Top-level declarations are referred to by names and assignments,
+        // and held by the statement list or by the unbraced body of an if,
+        // while or for, none of which opens a scope
+        auto relink = [&](uint32_t &link) {
+            auto found = moved.find(link);
+            if (found != moved.end())
+                link = found->second;
+        };
+        for (uint32_t i = nodeMark; i < ast.size(); i++)
+        {
+            Node &node = ast[i];
+            if (node.kind == N_NAME)
+                relink(node.a);
+            else if (node.kind == N_ASSIGN || node.kind == N_WHILE)
+                relink(node.b);
+            else if (node.kind == N_IF)
+            {
+                relink(node.b);
+                relink(node.c);
+            }
+            else if (node.kind == N_FOR)
+                relink(node.body);
+        }
+        for (size_t i = 0; i < run.size(); i++)
+            relink(run[i].node);
+    }
+    else
+    {
+        vector<Symbol> declared(live.begin() + hiddenEnd, live.end());
+        symbolTable.popTo(symbolsBefore);
+        symbolTable.show();
+        for (const Symbol &symbol : declared)
+            symbolTable.declare(symbol.name, symbol.type, symbol.line, symbol.declaration);
+        while (tokens.type(parser->position()) != T_EOF)
+            parseTopLevel(run, runTokens);
+        next = statements.size();
+    }
+
+    // Errors of the replaced statements and tokens go; later ones move with the text
+    unordered_map<uint32_t, bool> replacedIds;
+    for (size_t i = first; i < next; i++)
+        replacedIds[statements[i].id] = true;
+    auto replaced = [&](uint32_t id) { return replacedIds.count(id) > 0; };
+    diagnostics.rebase(firstNewError, restartOffset, relexedEnd, offset + deleted, delta, replaced);
+
+    garbage += ast.size() - nodeMark; // About as many nodes as the replaced statements had
+    if (tokenDelta != 0)
+        firstTokens.shift(next, tokenDelta);
+    firstTokens.splice(first, next, runTokens);
+    bool countChanged = run.size() != next - first;
+    statements.splice(first, next, run);
+
+    // The program list is rewritten when the tree is next read: from the
+    // first re-parsed statement to the end if later ones moved
+    staleFrom = staleFrom < staleTo ? min(staleFrom, first) : first;
+    staleTo = countChanged || delta != 0 ? SIZE_MAX : max(staleTo, first + run.size());
+
+    diagnostics.setLimit(limit);
+    if (diagnostics.full())
+    {
+        // A full parse would have stopped at the limit, and reported only the errors before it
+        parseAll();
+        return {tokens.size(), statements.size()};
+    }
+    return {relexed.size(), run.size()};
+}
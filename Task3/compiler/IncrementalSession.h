@@ -0,0 +1,90 @@
+#ifndef COMPILER_INCREMENTAL_SESSION_H
+#define COMPILER_INCREMENTAL_SESSION_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Token.h"
+#include "Ast.h"
+#include "Diagnostics.h"
+#include "Lexer.h"
+#include "Parser.h"
+
+// Keeps the tokens and AST of one buffer up to date as it is edited, for use
+// in an editor loop. An edit is re-lexed from the token before it until the
+// new tokens line up with old ones again, and only the top-level statements
+// that cover those tokens are re-parsed; everything else is reused. Nodes of
+// replaced statements stay in the arena until garbage outgrows the tree, when
+// the whole buffer is parsed again. With an error limit, parsing stops where
+// a full parse would: an edit that leaves the buffer with that many errors,
+// or one made while it has them, parses it all again. Nothing is done for
+// the statements after an edit: their token numbers and the text offsets of
+// their tokens move lazily (see MovingOffsets), the declarations they made
+// are hidden rather than popped while earlier code is re-parsed, and the
+// program node's list is brought up to date when the tree is next read.
+class IncrementalSession
+{
+private:
+    struct Statement
+    {
+        uint32_t node;
+        uint32_t symbolsBefore; // Top-level declarations made by earlier statements
+        uint32_t id;            // Origin of the diagnostics reported while parsing it
+    };
+
+    std::string text;
+    StringInterner &names;
+    TypeTable &types;
+    Diagnostics diagnostics;
+    TokenBuffer tokens;
+    Ast ast;
+    std::unique_ptr<TokenStream> stream; // Reads tokens, so the parser can be moved back to any statement
+    std::unique_ptr<Parser> parser;
+    uint32_t program = NO_NODE;
+    GapVector<Statement> statements;   // Top-level statements in source order
+    MovingOffsets firstTokens;         // Where each of them starts
+    size_t staleFrom = 0, staleTo = 0; // Program list entries not yet rewritten, see tree()
+    size_t fullParseNodes = 0;    // Arena size right after the last full parse
+    size_t garbage = 0;           // Nodes and list entries replaced since then
+    uint32_t nextId = 0;
+
+    // Parses the statement at the parser's position as the next top-level
+    // one, adding it to run and where it starts to runTokens
+    void parseTopLevel(GapVector<Statement> &run, MovingOffsets &runTokens);
+
+    void parseAll();
+
+    // Points the program node at the statements and where they start, rewriting
+    // only the stale entries if the count is unchanged
+    void storeProgramList();
+
+public:
+    IncrementalSession(std::string source, StringInterner &names, TypeTable &types, size_t maxErrors = 0)
+        : text(std::move(source)), names(names), types(types), diagnostics(text, maxErrors)
+    {
+        text.reserve(text.size() + text.size() / 16 + 4096); // So the first edits need not copy it
+        parseAll();
+    }
+
+    const std::string &source() const { return text; }
+    const Ast &tree()
+    {
+        if (staleFrom < staleTo)
+            storeProgramList();
+        return ast;
+    }
+    uint32_t root() const { return program; }
+    Diagnostics &errors() { return diagnostics; }
+    LineIndex &lines() { return diagnostics.lineIndex(); }
+    Parser &currentParser() { return *parser; }
+
+    // Replaces deleted bytes at offset with inserted. Returns how many tokens
+    // were re-lexed and how many top-level statements were re-parsed.
+    std::pair<size_t, size_t> edit(size_t offset, size_t deleted, std::string_view inserted);
+};
+
+#endif
@@ -0,0 +1,1029 @@
+#include "Ir.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstdlib>
+#include <numeric>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "TimeReport.h"
+
+using namespace std;
+
+uint32_t Ir::constant(TypeId type, uint64_t bits, int64_t intValue, double floatValue)
+{
+    auto inserted = constants.emplace(make_pair(type, bits), uint32_t(values.size()));
+    if (inserted.second)
+    {
+        add(IR_CONST, type, NO_BLOCK, 0);
+        values.back().intValue = intValue;
+        values.back().floatValue = floatValue;
+    }
+    return inserted.first->second;
+}
+
+uint32_t Ir::add(IrOp op, TypeId type, uint32_t block, uint32_t line, uint32_t a, uint32_t b,
+             uint32_t c)
+{
+    IrValue value;
+    value.op = op;
+    value.type = type;
+    value.block = block;
+    value.line = line;
+    value.a = a;
+    value.b = b;
+    value.c = c;
+    value.intValue = 0;
+    value.floatValue = 0;
+    values.push_back(move(value));
+    uint32_t id = uint32_t(values.size() - 1);
+    if (block != NO_BLOCK)
+        blocks[block].instructions.push_back(id);
+    return id;
+}
+
+uint32_t Ir::stringConstant(const string &text)
+{
+    auto inserted = stringIds.emplace(text, uint32_t(strings.size()));
+    if (inserted.second)
+        strings.push_back(text);
+    return constant(TYPE_STRING, inserted.first->second, inserted.first->second, 0);
+}
+
+uint32_t Ir::successors(uint32_t block, uint32_t out[2]) const
+{
+    const IrValue &last = terminator(block);
+    if (last.op == IR_JUMP)
+    {
+        out[0] = last.a;
+        return 1;
+    }
+    if (last.op != IR_BRANCH)
+        return 0;
+    out[0] = last.b;
+    out[1] = last.c;
+    return 2;
+}
+
+void Ir::removeEdge(uint32_t from, uint32_t to)
+{
+    vector<uint32_t> &predecessors = blocks[to].predecessors;
+    size_t k = find(predecessors.begin(), predecessors.end(), from) - predecessors.begin();
+    if (k == predecessors.size())
+        return; // Already gone, with a block removed before this one
+    predecessors.erase(predecessors.begin() + k);
+    for (uint32_t id : blocks[to].instructions)
+    {
+        if (values[id].op != IR_PHI)
+            break;
+        values[id].phi.erase(values[id].phi.begin() + k);
+    }
+}
+
+vector<uint32_t> Ir::reversePostorder() const
+{
+    vector<uint32_t> order;
+    vector<char> visited(blocks.size(), 0);
+    vector<pair<uint32_t, uint32_t>> stack; // (block, successors visited)
+    visited[0] = 1;
+    stack.push_back({0, 0});
+    while (!stack.empty())
+    {
+        uint32_t next[2];
+        uint32_t count = successors(stack.back().first, next);
+        if (stack.back().second == count)
+        {
+            order.push_back(stack.back().first);
+            stack.pop_back();
+            continue;
+        }
+        uint32_t successor = next[stack.back().second++];
+        if (!visited[successor])
+        {
+            visited[successor] = 1;
+            stack.push_back({successor, 0});
+        }
+    }
+    reverse(order.begin(), order.end());
+    return order;
+}
+
+vector<uint32_t> Ir::dominators(const vector<uint32_t> &order) const
+{
+    vector<uint32_t> index(blocks.size(), NO_BLOCK), idom(blocks.size(), NO_BLOCK);
+    for (uint32_t i = 0; i < order.size(); i++)
+        index[order[i]] = i;
+    idom[order[0]] = order[0];
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (size_t i = 1; i < order.size(); i++)
+        {
+            uint32_t dominator = NO_BLOCK;
+            for (uint32_t predecessor : blocks[order[i]].predecessors)
+            {
+                if (idom[predecessor] == NO_BLOCK)
+                    continue; // Not reached yet, or not reachable at all
+                uint32_t x = predecessor, y = dominator;
+                while (y != NO_BLOCK && x != y)
+                {
+                    while (index[x] > index[y])
+                        x = idom[x];
+                    while (index[y] > index[x])
+                        y = idom[y];
+                }
+                dominator = x;
+            }
+            if (idom[order[i]] != dominator)
+            {
+                idom[order[i]] = dominator;
+                changed = true;
+            }
+        }
+    }
+    return idom;
+}
+
+void Ir::dump(ostream &out) const
+{
+    static const char *const opNames[] = {"const", "phi", "copy", "add", "sub", "mul", "div", "concat",
+                                          "neg",   "not", "convert", "eq", "ne", "lt", "le", "jump",
+                                          "branch", "return", "halt"};
+    auto operand = [&](uint32_t id) {
+        const IrValue &value = values[id];
+        if (value.op != IR_CONST)
+            out << "v" << id;
+        else if (value.type == TYPE_BOOL)
+            out << (value.intValue ? "true" : "false");
+        else if (bankOf(value.type) == BANK_INT)
+            out << value.intValue;
+        else if (bankOf(value.type) == BANK_FLOAT)
+            out << showpoint << value.floatValue << noshowpoint;
+        else
+            out << '"' << strings[value.intValue] << '"';
+    };
+    for (uint32_t block = 0; block < blocks.size(); block++)
+    {
+        if (blocks[block].instructions.empty())
+            continue;
+        out << "block" << block << ":";
+        for (size_t i = 0; i < blocks[block].predecessors.size(); i++)
+            out << (i == 0 ? "  ; from block" : ", block") << blocks[block].predecessors[i];
+        out << "\n";
+        for (uint32_t id : blocks[block].instructions)
+        {
+            const IrValue &value = values[id];
+            out << "    ";
+            if (value.type != TYPE_VOID)
+                out << "v" << id << " = ";
+            out << opNames[value.op];
+            if (value.type != TYPE_VOID)
+                out << " " << (value.type == TYPE_BOOL ? "bool" : bankOf(value.type) == BANK_INT ? "int"
+                               : bankOf(value.type) == BANK_FLOAT ? "float" : "string");
+            if (value.op == IR_PHI)
+            {
+                for (size_t i = 0; i < value.phi.size(); i++)
+                {
+                    out << (i == 0 ? " [" : ", [");
+                    operand(value.phi[i]);
+                    out << ", block" << blocks[block].predecessors[i] << "]";
+                }
+            }
+            else if (value.op == IR_JUMP)
+                out << " block" << value.a;
+            else if (value.op == IR_BRANCH)
+            {
+                out << " ";
+                operand(value.a);
+                out << ", block" << value.b << ", block" << value.c;
+            }
+            else if (value.op != IR_HALT)
+            {
+                out << " ";
+                operand(value.a);
+                if (value.op != IR_RETURN && value.b != NO_VALUE)
+                {
+                    out << ", ";
+                    operand(value.b);
+                }
+            }
+            out << "\n";
+        }
+    }
+}
+
+uint32_t IrBuilder::variable(uint32_t declaration)
+{
+    auto inserted = variableIds.emplace(declaration, uint32_t(definitions.size()));
+    if (inserted.second)
+    {
+        definitions.push_back(NO_VALUE);
+        variableTypes.push_back(ast[declaration].type);
+        marks.push_back(0);
+    }
+    return inserted.first->second;
+}
+
+vector<IrBuilder::Definition> IrBuilder::rollback(size_t mark)
+{
+    vector<Definition> changed;
+    stamp++;
+    for (size_t i = undo.size(); i-- > mark;)
+    {
+        uint32_t var = undo[i].variable;
+        if (marks[var] != stamp)
+        {
+            marks[var] = stamp;
+            changed.push_back({var, definitions[var]});
+        }
+        definitions[var] = undo[i].value;
+    }
+    undo.resize(mark);
+    return changed;
+}
+
+uint32_t IrBuilder::expression(uint32_t index)
+{
+    const Node &node = ast[index];
+    if (node.kind == N_NUMBER)
+        return node.type == TYPE_FLOAT ? ir.floatConstant(node.floatValue) : ir.intConstant(TYPE_INT, node.intValue);
+    if (node.kind == N_STRING)
+        return ir.stringConstant(string(names.name(node.symbol)));
+    if (node.kind == N_NAME)
+    {
+        assert(node.a != NO_NODE); // Resolved by the parser
+        return read(variable(node.a));
+    }
+    if (depth >= MAX_EXPRESSION_DEPTH)
+    {
+        tooDeep = true;
+        return ir.zero(node.type);
+    }
+
+    depth++;
+    uint32_t value;
+    if (node.kind == N_UNARY && node.op == T_NOT)
+        value = ir.add(IR_NOT, TYPE_BOOL, current, lineOf(node), convert(expression(node.a), TYPE_BOOL, lineOf(node)));
+    else if (node.kind == N_UNARY)
+        value = ir.add(IR_NEG, node.type, current, lineOf(node), convert(expression(node.a), node.type, lineOf(node)));
+    else if (node.op == T_LOGICAL_AND || node.op == T_LOGICAL_OR)
+    {
+        // The right operand gets a block of its own, which the left one may skip
+        uint32_t left = convert(expression(node.a), TYPE_BOOL, lineOf(node));
+        uint32_t from = current, right = ir.addBlock(), join = ir.addBlock();
+        bool isAnd = node.op == T_LOGICAL_AND;
+        branch(left, isAnd ? right : join, isAnd ? join : right, lineOf(node));
+        current = right;
+        uint32_t rightValue = convert(expression(node.b), TYPE_BOOL, lineOf(node));
+        jump(join, lineOf(node));
+        current = join;
+        uint32_t decided = ir.intConstant(TYPE_BOOL, !isAnd);
+        value = ir.add(IR_PHI, TYPE_BOOL, join, lineOf(node));
+        for (uint32_t predecessor : ir.blocks[join].predecessors)
+            ir.values[value].phi.push_back(predecessor == from ? decided : rightValue);
+    }
+    else if (node.type == TYPE_BOOL) // Comparison
+    {
+        TypeId left = ast[node.a].type, right = ast[node.b].type;
+        TypeId common = left == TYPE_STRING ? TYPE_STRING : max(TYPE_INT, max(left, right));
+        uint32_t a = convert(expression(node.a), common, lineOf(node));
+        uint32_t b = convert(expression(node.b), common, lineOf(node));
+        IrOp op = IR_EQ;
+        switch (node.op)
+        {
+        case T_EQ: op = IR_EQ; break;
+        case T_NEQ: op = IR_NE; break;
+        case T_LT: op = IR_LT; break;
+        case T_LE: op = IR_LE; break;
+        case T_GT: op = IR_LT; swap(a, b); break;
+        default: op = IR_LE; swap(a, b); break; // T_GE
+        }
+        value = ir.add(op, TYPE_BOOL, current, lineOf(node), a, b);
+    }
+    else if (node.type == TYPE_STRING)
+    {
+        uint32_t a = expression(node.a), b = expression(node.b);
+        value = ir.add(IR_CONCAT, TYPE_STRING, current, lineOf(node), a, b);
+    }
+    else
+    {
+        uint32_t a = convert(expression(node.a), node.type, lineOf(node));
+        uint32_t b = convert(expression(node.b), node.type, lineOf(node));
+        IrOp op = node.op == T_PLUS ? IR_ADD : node.op == T_MINUS ? IR_SUB : node.op == T_MUL ? IR_MUL : IR_DIV;
+        value = ir.add(op, node.type, current, lineOf(node), a, b);
+    }
+    depth--;
+    return value;
+}
+
+void IrBuilder::assignedVariables(uint32_t index, vector<uint32_t> &out)
+{
+    // An explicit stack, as a loop body can nest as deep as the program is
+    // long; children are pushed last first, so they are listed in order
+    vector<uint32_t> pending{index};
+    while (!pending.empty())
+    {
+        uint32_t at = pending.back();
+        pending.pop_back();
+        const Node &node = ast[at];
+        uint32_t written = node.kind == N_ASSIGN ? node.b : node.kind == N_DECL ? at : NO_NODE;
+        if (written != NO_NODE && marks[variable(written)] != stamp)
+        {
+            marks[variable(written)] = stamp;
+            out.push_back(variable(written));
+        }
+        switch (node.kind)
+        {
+        case N_BLOCK:
+            for (uint32_t i = node.b; i > 0; i--)
+                pending.push_back(ast.statements(node)[i - 1]);
+            break;
+        case N_IF:
+            if (node.c != NO_NODE)
+                pending.push_back(node.c);
+            pending.push_back(node.b);
+            break;
+        case N_WHILE:
+            pending.push_back(node.b);
+            break;
+        case N_FOR:
+            pending.push_back(node.c);
+            pending.push_back(node.body);
+            pending.push_back(node.a);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void IrBuilder::statement(uint32_t index)
+{
+    const Node &node = ast[index];
+    if (statementDepth >= MAX_STATEMENT_DEPTH)
+    {
+        tooDeep = true;
+        return;
+    }
+    statementDepth++;
+    switch (node.kind)
+    {
+    case N_PROGRAM:
+        for (uint32_t i = 0; i < node.b; i++)
+        {
+            base = ast.statementStarts(node)[i];
+            statement(ast.statements(node)[i]);
+        }
+        base = 0;
+        break;
+    case N_BLOCK:
+        for (uint32_t i = 0; i < node.b; i++)
+            statement(ast.statements(node)[i]);
+        break;
+    case N_DECL:
+    {
+        // The initializer already sees the name, as zero
+        uint32_t var = variable(index);
+        write(var, ir.zero(node.type));
+        if (node.a != NO_NODE)
+            write(var, convert(expression(node.a), node.type, lineOf(node)));
+        break;
+    }
+    case N_ASSIGN:
+        assert(node.b != NO_NODE);
+        write(variable(node.b), convert(expression(node.a), node.type, lineOf(node)));
+        break;
+    case N_IF:
+    {
+        uint32_t test = condition(node.a);
+        uint32_t thenBlock = ir.addBlock();
+        uint32_t elseBlock = node.c != NO_NODE ? ir.addBlock() : NO_BLOCK, join = ir.addBlock();
+        branch(test, thenBlock, elseBlock != NO_BLOCK ? elseBlock : join, lineOf(node));
+        size_t mark = undo.size();
+        current = thenBlock;
+        statement(node.b);
+        uint32_t thenEnd = current;
+        jump(join, lineOf(node));
+        vector<Definition> thenValues = rollback(mark), elseValues;
+        if (elseBlock != NO_BLOCK)
+        {
+            current = elseBlock;
+            statement(node.c);
+            jump(join, lineOf(node));
+            elseValues = rollback(mark);
+        }
+
+        // Each variable either branch wrote gets a phi, unless both ended with the same value
+        current = join;
+        stamp++;
+        vector<uint32_t> merged;
+        for (const vector<Definition> *side : {&thenValues, &elseValues})
+        {
+            for (const Definition &definition : *side)
+            {
+                if (marks[definition.variable] != stamp)
+                {
+                    marks[definition.variable] = stamp;
+                    merged.push_back(definition.variable);
+                }
+            }
+        }
+        unordered_map<uint32_t, uint32_t> thenValue, elseValue;
+        for (const Definition &definition : thenValues)
+            thenValue[definition.variable] = definition.value;
+        for (const Definition &definition : elseValues)
+            elseValue[definition.variable] = definition.value;
+        for (uint32_t var : merged)
+        {
+            uint32_t onThen = thenValue.count(var) ? thenValue[var] : read(var);
+            uint32_t onElse = elseValue.count(var) ? elseValue[var] : read(var);
+            if (onThen == onElse)
+            {
+                write(var, onThen);
+                continue;
+            }
+            uint32_t phi = ir.add(IR_PHI, variableTypes[var], join, lineOf(node));
+            for (uint32_t predecessor : ir.blocks[join].predecessors)
+                ir.values[phi].phi.push_back(predecessor == thenEnd ? onThen : onElse);
+            write(var, phi);
+        }
+        break;
+    }
+    case N_WHILE:
+    case N_FOR:
+    {
+        if (node.kind == N_FOR)
+            statement(node.a);
+        uint32_t test = node.kind == N_FOR ? node.b : node.a;
+        vector<uint32_t> assigned;
+        stamp++;
+        if (node.kind == N_FOR)
+        {
+            assignedVariables(node.body, assigned);
+            assignedVariables(node.c, assigned);
+        }
+        else
+            assignedVariables(node.b, assigned);
+
+        uint32_t enter = condition(test);
+        uint32_t before = current, body = ir.addBlock(), exit = ir.addBlock();
+        branch(enter, body, exit, lineOf(node));
+        current = body;
+        vector<uint32_t> initial, phis;
+        for (uint32_t var : assigned)
+        {
+            initial.push_back(read(var));
+            phis.push_back(ir.add(IR_PHI, variableTypes[var], body, lineOf(node)));
+            ir.values[phis.back()].phi.push_back(initial.back());
+            write(var, phis.back());
+        }
+        if (node.kind == N_FOR)
+        {
+            statement(node.body);
+            statement(node.c);
+        }
+        else
+            statement(node.b);
+        branch(condition(test), body, exit, lineOf(node));
+
+        // Both the body and the exit are entered from before the loop and from its bottom
+        for (size_t i = 0; i < assigned.size(); i++)
+        {
+            uint32_t atBottom = read(assigned[i]); // May add a constant, moving the values
+            ir.values[phis[i]].phi.push_back(atBottom);
+        }
+        current = exit;
+        for (size_t i = 0; i < assigned.size(); i++)
+        {
+            uint32_t atBottom = read(assigned[i]);
+            if (atBottom == initial[i])
+                continue;
+            uint32_t phi = ir.add(IR_PHI, variableTypes[assigned[i]], exit, lineOf(node));
+            for (uint32_t predecessor : ir.blocks[exit].predecessors)
+                ir.values[phi].phi.push_back(predecessor == before ? initial[i] : atBottom);
+            write(assigned[i], phi);
+        }
+        break;
+    }
+    case N_RETURN:
+        ir.add(IR_RETURN, TYPE_VOID, current, lineOf(node), expression(node.a), ast[node.a].type);
+        current = ir.addBlock(); // Whatever follows is unreachable
+        break;
+    default:
+        break; // N_ERROR cannot occur in a tree without errors
+    }
+    statementDepth--;
+}
+
+bool IrBuilder::build(uint32_t root)
+{
+    current = ir.addBlock();
+    statement(root);
+    ir.add(IR_HALT, TYPE_VOID, current, lineOf(ast[root]));
+    return !tooDeep;
+}
+
+// The constant a pure instruction with constant operands x and y (y unused
+// by unary ones) computes, exactly as the VM would compute it. False if it
+// has to be left to run time: an int division by zero must still fail there.
+static bool foldValue(Ir &ir, IrOp op, TypeId type, const IrValue &x, const IrValue &y, uint32_t &result)
+{
+    auto compare = [](IrOp op, auto a, auto b) {
+        return op == IR_EQ ? a == b : op == IR_NE ? a != b : op == IR_LT ? a < b : a <= b;
+    };
+    uint64_t a = uint64_t(x.intValue), b = uint64_t(y.intValue);
+    switch (op)
+    {
+    case IR_ADD:
+        result = type == TYPE_FLOAT ? ir.floatConstant(x.floatValue + y.floatValue) : ir.intConstant(type, int64_t(a + b));
+        return true;
+    case IR_SUB:
+        result = type == TYPE_FLOAT ? ir.floatConstant(x.floatValue - y.floatValue) : ir.intConstant(type, int64_t(a - b));
+        return true;
+    case IR_MUL:
+        result = type == TYPE_FLOAT ? ir.floatConstant(x.floatValue * y.floatValue) : ir.intConstant(type, int64_t(a * b));
+        return true;
+    case IR_DIV:
+        if (type == TYPE_FLOAT)
+            result = ir.floatConstant(x.floatValue / y.floatValue);
+        else if (y.intValue == 0)
+            return false;
+        else
+            result = ir.intConstant(type, y.intValue == -1 ? int64_t(0 - a) : x.intValue / y.intValue);
+        return true;
+    case IR_CONCAT:
+        result = ir.stringConstant(ir.strings[x.intValue] + ir.strings[y.intValue]);
+        return true;
+    case IR_NEG:
+        result = type == TYPE_FLOAT ? ir.floatConstant(-x.floatValue) : ir.intConstant(type, int64_t(0 - a));
+        return true;
+    case IR_NOT:
+        result = ir.intConstant(TYPE_BOOL, x.intValue == 0);
+        return true;
+    case IR_CONVERT:
+        if (type == TYPE_FLOAT)
+            result = ir.floatConstant(double(x.intValue));
+        else if (type == TYPE_INT)
+            result = ir.intConstant(TYPE_INT, floatToInt(x.floatValue));
+        else if (bankOf(x.type) == BANK_FLOAT)
+            result = ir.intConstant(TYPE_BOOL, x.floatValue != 0);
+        else if (bankOf(x.type) == BANK_STRING)
+            result = ir.intConstant(TYPE_BOOL, !ir.strings[x.intValue].empty());
+        else
+            result = ir.intConstant(TYPE_BOOL, x.intValue != 0);
+        return true;
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_LE:
+        if (bankOf(x.type) == BANK_FLOAT)
+            result = ir.intConstant(TYPE_BOOL, compare(op, x.floatValue, y.floatValue));
+        else if (bankOf(x.type) == BANK_STRING)
+            result = ir.intConstant(TYPE_BOOL, compare(op, ir.strings[x.intValue], ir.strings[y.intValue]));
+        else
+            result = ir.intConstant(TYPE_BOOL, compare(op, x.intValue, y.intValue));
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Constant folding and propagation: an instruction whose operands are all
+// constants becomes a copy of its result, so propagating the copy hands the
+// constant on to its users, and a branch on a constant becomes a jump. Int
+// x + 0, x - 0, x * 1, x / 1 and x * 0 are simplified too. Returns the
+// number of instructions changed.
+static size_t foldConstants(Ir &ir)
+{
+    size_t changes = 0;
+    for (uint32_t block = 0; block < ir.blocks.size(); block++)
+    {
+        for (uint32_t id : ir.blocks[block].instructions)
+        {
+            IrValue &value = ir.values[id];
+            if (value.op == IR_BRANCH && ir.isConstant(ir.resolve(value.a)))
+            {
+                bool taken = ir.values[ir.resolve(value.a)].intValue != 0;
+                uint32_t target = taken ? value.b : value.c, dropped = taken ? value.c : value.b;
+                value.op = IR_JUMP;
+                value.a = target;
+                ir.removeEdge(block, dropped);
+                changes++;
+                continue;
+            }
+            if (value.op < IR_ADD || value.op > IR_LE)
+                continue;
+
+            IrOp op = value.op;
+            TypeId type = value.type;
+            uint32_t a = ir.resolve(value.a), b = value.b != NO_VALUE ? ir.resolve(value.b) : a;
+            uint32_t result = NO_VALUE;
+            if (ir.isConstant(a) && ir.isConstant(b))
+            {
+                // Copied first: new constants may move the values vector
+                IrValue x = ir.values[a], y = ir.values[b];
+                if (!foldValue(ir, op, type, x, y, result))
+                    continue;
+            }
+            else if (type == TYPE_INT && op >= IR_ADD && op <= IR_DIV)
+            {
+                auto is = [&](uint32_t operand, int64_t n) {
+                    return ir.isConstant(operand) && ir.values[operand].intValue == n;
+                };
+                if ((op == IR_ADD && is(a, 0)) || (op == IR_MUL && is(a, 1)))
+                    result = b;
+                else if ((op != IR_MUL && op != IR_DIV && is(b, 0)) || (op >= IR_MUL && is(b, 1)))
+                    result = a;
+                else if (op == IR_MUL && (is(a, 0) || is(b, 0)))
+                    result = ir.intConstant(TYPE_INT, 0);
+                else
+                    continue;
+            }
+            else
+                continue;
+            ir.values[id].op = IR_COPY;
+            ir.values[id].a = result;
+            ir.values[id].b = NO_VALUE;
+            changes++;
+        }
+    }
+    return changes;
+}
+
+// Copy propagation: every operand that names a copy is pointed at the
+// copied value instead, and the copies are dropped. A phi whose operands
+// are all one value, or itself, is such a copy too. Returns the number of
+// copies removed.
+static size_t propagateCopies(Ir &ir)
+{
+    for (bool again = true; again;)
+    {
+        again = false;
+        for (IrBlock &block : ir.blocks)
+        {
+            for (uint32_t id : block.instructions)
+            {
+                if (ir.values[id].op != IR_PHI)
+                    break;
+                uint32_t same = NO_VALUE;
+                bool trivial = true;
+                for (uint32_t operand : ir.values[id].phi)
+                {
+                    operand = ir.resolve(operand);
+                    if (operand == id || operand == same)
+                        continue;
+                    trivial = same == NO_VALUE;
+                    same = operand;
+                    if (!trivial)
+                        break;
+                }
+                if (trivial && same != NO_VALUE)
+                {
+                    ir.values[id].op = IR_COPY;
+                    ir.values[id].a = same;
+                    ir.values[id].phi.clear();
+                    again = true;
+                }
+            }
+        }
+    }
+
+    size_t changes = 0;
+    for (IrBlock &block : ir.blocks)
+    {
+        for (uint32_t id : block.instructions)
+            Ir::forEachOperand(ir.values[id], [&](uint32_t &operand) { operand = ir.resolve(operand); });
+        size_t before = block.instructions.size();
+        block.instructions.erase(remove_if(block.instructions.begin(), block.instructions.end(),
+                                           [&](uint32_t id) { return ir.values[id].op == IR_COPY; }),
+                                 block.instructions.end());
+        changes += before - block.instructions.size();
+    }
+    return changes;
+}
+
+// Common subexpression elimination over the dominator tree: an instruction
+// that repeats the operation and operands of one in a dominating position
+// becomes a copy of it. The operands of commutative operations are put in
+// order first, so a + b and b + a match. Returns the number of instructions
+// replaced.
+static size_t eliminateCommonSubexpressions(Ir &ir)
+{
+    vector<uint32_t> order = ir.reversePostorder();
+    vector<uint32_t> idom = ir.dominators(order);
+    vector<vector<uint32_t>> children(ir.blocks.size());
+    for (size_t i = 1; i < order.size(); i++)
+        children[idom[order[i]]].push_back(order[i]);
+
+    // Walked depth first with an explicit stack, as the tree can be as deep as the program is long
+    map<array<uint32_t, 4>, uint32_t> available; // (op, type, a, b) -> value
+    vector<array<uint32_t, 4>> added;
+    vector<pair<uint32_t, size_t>> stack; // (block, entries of added before it)
+    stack.push_back({order[0], 0});
+    size_t changes = 0;
+    vector<size_t> nextChild(ir.blocks.size(), 0);
+    while (!stack.empty())
+    {
+        uint32_t block = stack.back().first;
+        if (nextChild[block] == 0)
+        {
+            for (uint32_t id : ir.blocks[block].instructions)
+            {
+                IrValue &value = ir.values[id];
+                if (value.op < IR_ADD || value.op > IR_LE)
+                    continue;
+                uint32_t a = ir.resolve(value.a), b = value.b != NO_VALUE ? ir.resolve(value.b) : NO_VALUE;
+                bool commutative = value.op == IR_ADD || value.op == IR_MUL || value.op == IR_EQ || value.op == IR_NE;
+                if (commutative && a > b)
+                    swap(a, b);
+                array<uint32_t, 4> key = {uint32_t(value.op), value.type, a, b};
+                auto inserted = available.emplace(key, id);
+                if (inserted.second)
+                    added.push_back(key);
+                else
+                {
+                    value.op = IR_COPY;
+                    value.a = inserted.first->second;
+                    value.b = NO_VALUE;
+                    changes++;
+                }
+            }
+        }
+        if (nextChild[block] < children[block].size())
+        {
+            stack.push_back({children[block][nextChild[block]++], added.size()});
+            continue;
+        }
+        while (added.size() > stack.back().second)
+        {
+            available.erase(added.back());
+            added.pop_back();
+        }
+        stack.pop_back();
+    }
+    return changes;
+}
+
+// Dead code elimination. Blocks control cannot reach are removed, which
+// takes the statements after a return with them, and then every
+// instruction whose value nothing needs: an instruction is needed if it
+// ends a block, may stop the program with a runtime error, or computes an
+// operand of one that is. Returns the number of instructions removed.
+static size_t eliminateDeadCode(Ir &ir)
+{
+    size_t removed = 0;
+    vector<char> reachable(ir.blocks.size(), 0);
+    for (uint32_t block : ir.reversePostorder())
+        reachable[block] = 1;
+    for (uint32_t block = 0; block < ir.blocks.size(); block++)
+    {
+        if (reachable[block] || ir.blocks[block].instructions.empty())
+            continue;
+        uint32_t next[2];
+        uint32_t count = ir.successors(block, next);
+        for (uint32_t i = 0; i < count; i++)
+            ir.removeEdge(block, next[i]);
+        removed += ir.blocks[block].instructions.size();
+        ir.blocks[block].instructions.clear();
+        ir.blocks[block].predecessors.clear();
+    }
+
+    vector<char> needed(ir.values.size(), 0);
+    vector<uint32_t> work;
+    for (IrBlock &block : ir.blocks)
+    {
+        for (uint32_t id : block.instructions)
+        {
+            const IrValue &value = ir.values[id];
+            bool mayFail = value.op == IR_DIV && value.type != TYPE_FLOAT &&
+                           !(ir.isConstant(value.b) && ir.values[value.b].intValue != 0);
+            if (value.op >= IR_JUMP || mayFail)
+            {
+                needed[id] = 1;
+                work.push_back(id);
+            }
+        }
+    }
+    while (!work.empty())
+    {
+        uint32_t id = work.back();
+        work.pop_back();
+        Ir::forEachOperand(ir.values[id], [&](uint32_t &operand) {
+            if (!needed[operand])
+            {
+                needed[operand] = 1;
+                work.push_back(operand);
+            }
+        });
+    }
+    for (IrBlock &block : ir.blocks)
+    {
+        size_t before = block.instructions.size();
+        block.instructions.erase(remove_if(block.instructions.begin(), block.instructions.end(),
+                                           [&](uint32_t id) { return !needed[id]; }),
+                                 block.instructions.end());
+        removed += before - block.instructions.size();
+    }
+    return removed;
+}
+
+void PassManager::run(Ir &ir)
+{
+    TIME_SCOPE("optimize");
+    for (rounds = 0; rounds < MAX_ROUNDS;)
+    {
+        rounds++;
+        size_t changes = 0;
+        for (Pass &pass : passes)
+        {
+            TIME_SCOPE(pass.name);
+            size_t changed = pass.run(ir);
+            pass.changes += changed;
+            changes += changed;
+        }
+        if (changes == 0)
+            break;
+    }
+}
+
+void PassManager::report(ostream &out) const
+{
+    out << "; " << rounds << " round(s)";
+    for (const Pass &pass : passes)
+        out << ", " << pass.name << ": " << pass.changes;
+    out << "\n";
+}
+
+PassManager PassManager::standard()
+{
+    PassManager manager;
+    manager.add("constant folding", foldConstants);
+    manager.add("copy propagation", propagateCopies);
+    manager.add("common subexpressions", eliminateCommonSubexpressions);
+    manager.add("dead code", eliminateDeadCode);
+    return manager;
+}
+
+void LiveRanges::computeLiveness()
+{
+    liveIn.assign(ir.blocks.size(), {});
+    liveOut.assign(ir.blocks.size(), {});
+    vector<pair<uint32_t, uint32_t>> uses; // (value, block << 1 | 1 if used at its end)
+    for (uint32_t block : order)
+    {
+        for (uint32_t id : ir.blocks[block].instructions)
+        {
+            const IrValue &value = ir.values[id];
+            if (value.op == IR_PHI)
+            {
+                for (size_t k = 0; k < value.phi.size(); k++)
+                {
+                    if (!ir.isConstant(value.phi[k]))
+                        uses.push_back({value.phi[k], ir.blocks[block].predecessors[k] << 1 | 1});
+                }
+                continue;
+            }
+            Ir::forEachOperand(value, [&](uint32_t operand) {
+                if (!ir.isConstant(operand) && ir.values[operand].block != block)
+                    uses.push_back({operand, block << 1});
+            });
+        }
+    }
+    sort(uses.begin(), uses.end());
+
+    // Values are walked in increasing order, so the sets come out sorted
+    vector<uint32_t> inMark(ir.blocks.size(), NO_VALUE), outMark(ir.blocks.size(), NO_VALUE), work;
+    for (const pair<uint32_t, uint32_t> &use : uses)
+    {
+        uint32_t value = use.first;
+        work.push_back(use.second);
+        while (!work.empty())
+        {
+            uint32_t block = work.back() >> 1;
+            bool atEnd = work.back() & 1;
+            work.pop_back();
+            if (atEnd && outMark[block] != value)
+            {
+                outMark[block] = value;
+                liveOut[block].push_back(value);
+                if (ir.values[value].block != block)
+                    work.push_back(block << 1);
+            }
+            else if (!atEnd && inMark[block] != value)
+            {
+                inMark[block] = value;
+                liveIn[block].push_back(value);
+                for (uint32_t predecessor : ir.blocks[block].predecessors)
+                    work.push_back(predecessor << 1 | 1);
+            }
+        }
+    }
+}
+
+void LiveRanges::numberDominatorTree()
+{
+    vector<uint32_t> idom = ir.dominators(order);
+    vector<vector<uint32_t>> children(ir.blocks.size());
+    for (size_t i = 1; i < order.size(); i++)
+        children[idom[order[i]]].push_back(order[i]);
+    preorder.assign(ir.blocks.size(), 0);
+    postorder.assign(ir.blocks.size(), 0);
+    uint32_t counter = 0;
+    vector<pair<uint32_t, size_t>> stack = {{order[0], 0}};
+    preorder[order[0]] = counter++;
+    while (!stack.empty())
+    {
+        pair<uint32_t, size_t> &top = stack.back();
+        if (top.second < children[top.first].size())
+        {
+            uint32_t child = children[top.first][top.second++];
+            preorder[child] = counter++;
+            stack.push_back({child, 0});
+            continue;
+        }
+        postorder[top.first] = counter++;
+        stack.pop_back();
+    }
+}
+
+bool LiveRanges::definedBefore(uint32_t a, uint32_t b) const
+{
+    uint32_t x = ir.values[a].block, y = ir.values[b].block;
+    if (x == y)
+        return position[a] < position[b];
+    return preorder[x] <= preorder[y] && postorder[y] <= postorder[x];
+}
+
+bool LiveRanges::liveAfter(uint32_t a, uint32_t b) const
+{
+    const IrValue &defined = ir.values[b];
+    if (defined.op == IR_PHI) // Phis of one block all take their values at once
+        return (ir.values[a].op == IR_PHI && ir.values[a].block == defined.block) ||
+               binary_search(liveIn[defined.block].begin(), liveIn[defined.block].end(), a);
+    if (binary_search(liveOut[defined.block].begin(), liveOut[defined.block].end(), a))
+        return true;
+    const vector<uint32_t> &instructions = ir.blocks[defined.block].instructions;
+    bool used = false;
+    for (size_t i = position[b] + 1; i < instructions.size() && !used; i++)
+        Ir::forEachOperand(ir.values[instructions[i]], [&](uint32_t operand) { used |= operand == a; });
+    return used;
+}
+
+void LiveRanges::coalesce(uint32_t x, uint32_t y)
+{
+    x = group(x);
+    y = group(y);
+    if (x == y || bankOf(ir.values[x].type) != bankOf(ir.values[y].type) ||
+        members[x].size() * members[y].size() > MAX_COALESCE_CHECKS)
+        return;
+    for (uint32_t a : members[x])
+    {
+        for (uint32_t b : members[y])
+        {
+            if (interfere(a, b))
+                return;
+        }
+    }
+    if (members[x].size() < members[y].size())
+        swap(x, y);
+    members[x].insert(members[x].end(), members[y].begin(), members[y].end());
+    members[y].clear();
+    groups[y] = x;
+}
+
+LiveRanges::LiveRanges(const Ir &ir) : ir(ir)
+{
+    order = ir.reversePostorder();
+    position.assign(ir.values.size(), 0);
+    for (uint32_t block : order)
+    {
+        for (uint32_t i = 0; i < ir.blocks[block].instructions.size(); i++)
+            position[ir.blocks[block].instructions[i]] = i;
+    }
+    computeLiveness();
+    numberDominatorTree();
+    groups.resize(ir.values.size());
+    iota(groups.begin(), groups.end(), 0);
+    members.assign(ir.values.size(), {});
+    for (uint32_t block : order)
+    {
+        for (uint32_t id : ir.blocks[block].instructions)
+            members[id].push_back(id);
+    }
+    for (uint32_t block : order)
+    {
+        for (uint32_t id : ir.blocks[block].instructions)
+        {
+            if (ir.values[id].op != IR_PHI)
+                break;
+            for (uint32_t operand : ir.values[id].phi)
+            {
+                if (!ir.isConstant(operand))
+                    coalesce(id, operand);
+            }
+        }
+    }
+}
@@ -0,0 +1,361 @@
+#ifndef COMPILER_IR_H
+#define COMPILER_IR_H
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "Token.h"
+#include "Ast.h"
+#include "Bytecode.h"
+
+// SSA intermediate representation, between the checked AST and the
+// backends. The program is a graph of basic blocks; every value is defined
+// exactly once, by an instruction in a block or as a constant outside all
+// blocks, and where control flow joins a phi picks the value that arrived
+// along each predecessor. Values and blocks are numbered, and operands are
+// those numbers; a block whose instruction list is empty has been removed.
+const uint32_t NO_VALUE = 0xFFFFFFFF;
+
+const uint32_t NO_BLOCK = 0xFFFFFFFF;
+
+enum IrOp : uint8_t
+{
+    IR_CONST,   // intValue, or floatValue for floats; a string's intValue indexes Ir::strings
+    IR_PHI,     // One operand per predecessor of the block, in the same order; phis come first
+    IR_COPY,    // a; left by folding and CSE, for copy propagation to remove
+    IR_ADD,     // a op b, computed in the type of the result
+    IR_SUB,
+    IR_MUL,
+    IR_DIV,
+    IR_CONCAT,
+    IR_NEG,     // -a
+    IR_NOT,     // !a, where a is a bool
+    IR_CONVERT, // a converted to the type of the result
+    IR_EQ,      // a op b, compared in the type of a; > and >= are built with the operands swapped
+    IR_NE,
+    IR_LT,
+    IR_LE,
+    IR_JUMP,    // Terminators, one at the end of every block. Go to block a
+    IR_BRANCH,  // Go to block b if a (an int or bool) is nonzero, else to block c
+    IR_RETURN,  // Stop with value a, whose TypeId is b
+    IR_HALT     // Stop without a value
+};
+
+struct IrValue
+{
+    IrOp op;
+    TypeId type;    // TYPE_VOID for terminators
+    uint32_t block; // NO_BLOCK for constants
+    uint32_t line;
+    uint32_t a, b, c;
+    int64_t intValue;
+    double floatValue;
+    std::vector<uint32_t> phi;
+};
+
+struct IrBlock
+{
+    std::vector<uint32_t> instructions;
+    std::vector<uint32_t> predecessors;
+};
+
+class Ir
+{
+public:
+    std::vector<IrValue> values;
+    std::vector<IrBlock> blocks; // blocks[0] is the entry
+    std::vector<std::string> strings; // Texts of string constants
+
+private:
+    std::map<std::pair<TypeId, uint64_t>, uint32_t> constants; // (type, bits of the value) -> constant
+    std::unordered_map<std::string, uint32_t> stringIds;
+
+    uint32_t constant(TypeId type, uint64_t bits, int64_t intValue, double floatValue);
+
+public:
+    uint32_t add(IrOp op, TypeId type, uint32_t block, uint32_t line, uint32_t a = NO_VALUE, uint32_t b = NO_VALUE,
+                 uint32_t c = NO_VALUE);
+
+    uint32_t addBlock()
+    {
+        blocks.emplace_back();
+        return uint32_t(blocks.size() - 1);
+    }
+
+    // An int or bool constant
+    uint32_t intConstant(TypeId type, int64_t value) { return constant(type, uint64_t(value), value, 0); }
+
+    uint32_t floatConstant(double value)
+    {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof bits);
+        return constant(TYPE_FLOAT, bits, 0, value);
+    }
+
+    uint32_t stringConstant(const std::string &text);
+
+    // The value a declaration without an initializer gives
+    uint32_t zero(TypeId type)
+    {
+        if (bankOf(type) == BANK_FLOAT)
+            return floatConstant(0.0);
+        return bankOf(type) == BANK_STRING ? stringConstant("") : intConstant(type, 0);
+    }
+
+    bool isConstant(uint32_t value) const { return values[value].op == IR_CONST; }
+
+    // The value a copy chain ends in
+    uint32_t resolve(uint32_t value) const
+    {
+        while (values[value].op == IR_COPY)
+            value = values[value].a;
+        return value;
+    }
+
+    const IrValue &terminator(uint32_t block) const { return values[blocks[block].instructions.back()]; }
+
+    // Writes the blocks control can go to from block into out; returns how many
+    uint32_t successors(uint32_t block, uint32_t out[2]) const;
+
+    // Forgets that from is a predecessor of to, with the phi operands that came from it
+    void removeEdge(uint32_t from, uint32_t to);
+
+    // Calls f on a reference to every value operand of an instruction
+    template <typename Value, typename F>
+    static void forEachOperand(Value &value, F f)
+    {
+        switch (value.op)
+        {
+        case IR_PHI:
+            for (auto &operand : value.phi)
+                f(operand);
+            break;
+        case IR_ADD:
+        case IR_SUB:
+        case IR_MUL:
+        case IR_DIV:
+        case IR_CONCAT:
+        case IR_EQ:
+        case IR_NE:
+        case IR_LT:
+        case IR_LE:
+            f(value.a);
+            f(value.b);
+            break;
+        case IR_COPY:
+        case IR_NEG:
+        case IR_NOT:
+        case IR_CONVERT:
+        case IR_BRANCH:
+        case IR_RETURN:
+            f(value.a);
+            break;
+        default:
+            break; // Constants, jumps and halt
+        }
+    }
+
+    // Blocks reachable from the entry, each after all its predecessors except along loop back edges
+    std::vector<uint32_t> reversePostorder() const;
+
+    // Immediate dominator of each block in order (a reversePostorder), by the
+    // iterative algorithm of Cooper, Harvey and Kennedy; NO_BLOCK for the
+    // blocks that are not in order, and the entry is its own
+    std::vector<uint32_t> dominators(const std::vector<uint32_t> &order) const;
+
+    // Prints the blocks of the program, for --dump-ir
+    void dump(std::ostream &out) const;
+};
+
+// Builds the Ir of a checked AST. Variables are their declaration nodes,
+// which the parser's symbol table already resolved every name to, so
+// scoping needs no more work here. The current SSA value of each variable
+// is tracked while the statements are walked in order: at the end of an
+// if's branches the values they wrote are rolled back and merged with phis
+// at the join, and a loop gives every variable its body may assign a phi at
+// the top of the body before the body is built. Loops are rotated, with
+// the condition both before the loop and at the bottom of the body.
+class IrBuilder
+{
+private:
+    static const size_t MAX_EXPRESSION_DEPTH = 10000; // As in BytecodeCompiler
+    static const size_t MAX_STATEMENT_DEPTH = 10000;
+
+    struct Definition
+    {
+        uint32_t variable;
+        uint32_t value;
+    };
+
+    const Ast &ast;
+    const StringInterner &names;
+    LineIndex &lines;
+    Ir &ir;
+    uint32_t current = 0; // Block being filled
+    std::unordered_map<uint32_t, uint32_t> variableIds; // Declaration node -> variable
+    std::vector<uint32_t> definitions; // Current value of each variable; NO_VALUE before any write
+    std::vector<TypeId> variableTypes;
+    std::vector<Definition> undo;      // Values overwritten by each write, to roll branches back
+    std::vector<uint32_t> marks;       // Stamps, so a variable is only listed once per scan
+    uint32_t stamp = 0;
+    size_t depth = 0;
+    size_t statementDepth = 0;
+    bool tooDeep = false;
+    uint32_t base = 0; // Start of the top-level statement being built, which node offsets count from
+
+    uint32_t lineOf(const Node &node) { return lines.line(base + node.offset); }
+
+    uint32_t variable(uint32_t declaration);
+
+    // A variable read where no write reaches it (code after a return, or an
+    // unbraced declaration in a branch that did not run) reads as zero
+    uint32_t read(uint32_t var) { return definitions[var] != NO_VALUE ? definitions[var] : ir.zero(variableTypes[var]); }
+
+    void write(uint32_t var, uint32_t value)
+    {
+        undo.push_back({var, definitions[var]});
+        definitions[var] = value;
+    }
+
+    // Undoes the writes made since mark; returns each variable they changed with its latest value
+    std::vector<Definition> rollback(size_t mark);
+
+    void jump(uint32_t to, uint32_t line)
+    {
+        ir.add(IR_JUMP, TYPE_VOID, current, line, to);
+        ir.blocks[to].predecessors.push_back(current);
+    }
+
+    void branch(uint32_t condition, uint32_t ifTrue, uint32_t ifFalse, uint32_t line)
+    {
+        ir.add(IR_BRANCH, TYPE_VOID, current, line, condition, ifTrue, ifFalse);
+        ir.blocks[ifTrue].predecessors.push_back(current);
+        ir.blocks[ifFalse].predecessors.push_back(current);
+    }
+
+    uint32_t convert(uint32_t value, TypeId to, uint32_t line)
+    {
+        if (sameRepresentation(to, ir.values[value].type))
+            return value;
+        return ir.add(IR_CONVERT, to, current, line, value);
+    }
+
+    // An int or bool that is nonzero when the condition at index holds
+    uint32_t condition(uint32_t index)
+    {
+        uint32_t value = expression(index);
+        return bankOf(ast[index].type) == BANK_INT ? value : convert(value, TYPE_BOOL, lineOf(ast[index]));
+    }
+
+    uint32_t expression(uint32_t index);
+
+    // Lists the variables the statement at index may write, in the order first written
+    void assignedVariables(uint32_t index, std::vector<uint32_t> &out);
+
+    void statement(uint32_t index);
+
+public:
+    IrBuilder(const Ast &ast, const StringInterner &names, LineIndex &lines, Ir &ir)
+        : ast(ast), names(names), lines(lines), ir(ir) {}
+
+    // Builds the N_PROGRAM node; false if expressions or statements nest too deeply
+    bool build(uint32_t root);
+};
+
+// Runs optimization passes over an Ir in order, round after round, until a
+// whole round changes nothing, and counts what each pass changed
+class PassManager
+{
+private:
+    struct Pass
+    {
+        const char *name;
+        size_t (*run)(Ir &);
+        size_t changes;
+    };
+
+    static const size_t MAX_ROUNDS = 16; // Every round shrinks the program, but not always by much
+
+    std::vector<Pass> passes;
+    size_t rounds = 0;
+
+public:
+    void add(const char *name, size_t (*run)(Ir &)) { passes.push_back({name, run, 0}); }
+
+    void run(Ir &ir);
+
+    // Prints the counts as comments, after the --dump-ir listing
+    void report(std::ostream &out) const;
+
+    // The passes --optimize runs
+    static PassManager standard();
+};
+
+// Liveness of the values of an Ir, and groups of values that can share one
+// location: each phi with the values flowing into it, wherever their live
+// ranges do not overlap. A variable updated in a loop thus keeps a single
+// location, and most phis need no copies at all. Blocks are ordered in
+// reverse postorder, the layout the backends use.
+class LiveRanges
+{
+private:
+    static const size_t MAX_COALESCE_CHECKS = 4096; // Pairs compared before two groups are merged
+
+    const Ir &ir;
+    std::vector<uint32_t> preorder, postorder; // Dominator tree numbering
+    std::vector<uint32_t> groups;              // Union-find over the values that share a location
+    std::vector<std::vector<uint32_t>> members;     // Values of each group, kept at its root
+
+public:
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> position;        // Index of each instruction in its block
+    std::vector<std::vector<uint32_t>> liveIn;  // Sorted values live on entry to each block, besides its phis
+    std::vector<std::vector<uint32_t>> liveOut; // Sorted values live on exit, with the phi operands it supplies
+
+private:
+    // Liveness, one value at a time: from every use outside its block, walk
+    // back through predecessors until the block that defines it. A phi uses
+    // its operand at the end of the predecessor it comes from.
+    void computeLiveness();
+
+    void numberDominatorTree();
+
+    // Whether the definition of a comes before that of b on every path to b
+    bool definedBefore(uint32_t a, uint32_t b) const;
+
+    // Whether a, defined before b, is still live right after b is defined
+    bool liveAfter(uint32_t a, uint32_t b) const;
+
+    // In SSA form two live ranges overlap only if one value is live where the other is defined
+    bool interfere(uint32_t a, uint32_t b) const
+    {
+        if (definedBefore(a, b))
+            return liveAfter(a, b);
+        return definedBefore(b, a) && liveAfter(b, a);
+    }
+
+    // Puts x and y, and everything already grouped with either, in one group if none of them interfere
+    void coalesce(uint32_t x, uint32_t y);
+
+public:
+    explicit LiveRanges(const Ir &ir);
+
+    // The value that stands for the group of value
+    uint32_t group(uint32_t value)
+    {
+        while (groups[value] != value)
+            value = groups[value] = groups[groups[value]];
+        return value;
+    }
+};
+
+#endif
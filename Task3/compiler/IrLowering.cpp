@@ -0,0 +1,204 @@
+#include "IrLowering.h"
+
+using namespace std;
+
+uint32_t IrLowering::allocate(Bank bank)
+{
+    if (bank == BANK_INT)
+    {
+        program.ints.push_back(0);
+        return uint32_t(program.ints.size() - 1);
+    }
+    if (bank == BANK_FLOAT)
+    {
+        program.floats.push_back(0.0);
+        return uint32_t(program.floats.size() - 1);
+    }
+    program.strings.emplace_back();
+    return uint32_t(program.strings.size() - 1);
+}
+
+void IrLowering::assignRegisters()
+{
+    registers.assign(ir.values.size(), NO_VALUE);
+    for (uint32_t block : ranges.order)
+    {
+        for (uint32_t id : ir.blocks[block].instructions)
+        {
+            Ir::forEachOperand(ir.values[id], [&](uint32_t operand) {
+                const IrValue &value = ir.values[operand];
+                if (value.op != IR_CONST || registers[operand] != NO_VALUE)
+                    return;
+                if (bankOf(value.type) == BANK_INT)
+                    program.ints.push_back(value.intValue);
+                else if (bankOf(value.type) == BANK_FLOAT)
+                    program.floats.push_back(value.floatValue);
+                else
+                    program.strings.push_back(ir.strings[value.intValue]);
+                registers[operand] = uint32_t(bankOf(value.type) == BANK_INT     ? program.ints.size() - 1
+                                              : bankOf(value.type) == BANK_FLOAT ? program.floats.size() - 1
+                                                                                 : program.strings.size() - 1);
+            });
+        }
+    }
+    program.constants = {uint32_t(program.ints.size()), uint32_t(program.floats.size()),
+                         uint32_t(program.strings.size())};
+    for (uint32_t block : ranges.order)
+    {
+        for (uint32_t id : ir.blocks[block].instructions)
+        {
+            if (ir.values[id].type == TYPE_VOID)
+                continue;
+            uint32_t root = ranges.group(id);
+            if (registers[root] == NO_VALUE)
+                registers[root] = allocate(bankOf(ir.values[root].type));
+            registers[id] = registers[root];
+        }
+    }
+}
+
+vector<Copy> IrLowering::edgeCopies(uint32_t from, uint32_t to) const
+{
+    vector<Copy> copies;
+    const IrBlock &target = ir.blocks[to];
+    size_t k = find(target.predecessors.begin(), target.predecessors.end(), from) - target.predecessors.begin();
+    for (uint32_t id : target.instructions)
+    {
+        const IrValue &phi = ir.values[id];
+        if (phi.op != IR_PHI)
+            break;
+        if (registers[phi.phi[k]] != registers[id])
+            copies.push_back({bankOf(phi.type), registers[id], registers[phi.phi[k]]});
+    }
+    return copies;
+}
+
+void IrLowering::emitCopies(const vector<Copy> &copies, uint32_t line)
+{
+    static const Opcode moves[] = {OP_MOVE_I, OP_MOVE_F, OP_MOVE_S};
+    sequenceCopies(
+        copies,
+        [&](Bank bank) {
+            if (scratch[bank] == NO_VALUE)
+                scratch[bank] = allocate(bank);
+            return scratch[bank];
+        },
+        [&](Bank bank, uint32_t to, uint32_t from) { emit(moves[bank], line, to, from); });
+}
+
+void IrLowering::emitInstruction(uint32_t id)
+{
+    static const Opcode moves[] = {OP_MOVE_I, OP_MOVE_F, OP_MOVE_S};
+    static const Opcode toBool[] = {OP_INT_TO_BOOL, OP_FLOAT_TO_BOOL, OP_STRING_TO_BOOL};
+    const IrValue &value = ir.values[id];
+    uint32_t dest = registers[id], a = value.a != NO_VALUE ? registers[value.a] : 0;
+    uint32_t b = value.b != NO_VALUE ? registers[value.b] : 0;
+    Bank operandBank = value.a != NO_VALUE ? bankOf(ir.values[value.a].type) : BANK_INT;
+    switch (value.op)
+    {
+    case IR_COPY:
+        if (dest != a)
+            emit(moves[bankOf(value.type)], value.line, dest, a);
+        break;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+    case IR_DIV:
+        emit(Opcode((value.type == TYPE_FLOAT ? OP_ADD_F : OP_ADD_I) + (value.op - IR_ADD)), value.line, dest, a, b);
+        break;
+    case IR_CONCAT:
+        emit(OP_CONCAT, value.line, dest, a, b);
+        break;
+    case IR_NEG:
+        emit(value.type == TYPE_FLOAT ? OP_NEG_F : OP_NEG_I, value.line, dest, a);
+        break;
+    case IR_NOT:
+        emit(OP_NOT, value.line, dest, a);
+        break;
+    case IR_CONVERT:
+        if (value.type == TYPE_FLOAT)
+            emit(OP_INT_TO_FLOAT, value.line, dest, a);
+        else if (value.type == TYPE_INT)
+            emit(OP_FLOAT_TO_INT, value.line, dest, a);
+        else
+            emit(toBool[operandBank], value.line, dest, a);
+        break;
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_LE:
+        emit(Opcode(OP_EQ_I + 4 * operandBank + (value.op - IR_EQ)), value.line, dest, a, b);
+        break;
+    default:
+        break; // Phis are made by edgeCopies
+    }
+}
+
+void IrLowering::lower()
+{
+    assignRegisters();
+
+    // Jump targets are block numbers, and trampolines numbered after the
+    // blocks, until every address is known
+    struct Trampoline
+    {
+        uint32_t from, to;
+    };
+    vector<Trampoline> trampolines;
+    vector<uint32_t> address(ir.blocks.size(), 0);
+    vector<size_t> jumps;
+    auto target = [&](uint32_t from, uint32_t to) {
+        if (edgeCopies(from, to).empty())
+            return to;
+        trampolines.push_back({from, to});
+        return uint32_t(ir.blocks.size() + trampolines.size() - 1);
+    };
+    static const Opcode returns[] = {OP_RETURN_I, OP_RETURN_F, OP_RETURN_S};
+    const vector<uint32_t> &order = ranges.order;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        uint32_t block = order[i], next = i + 1 < order.size() ? order[i + 1] : NO_BLOCK;
+        address[block] = uint32_t(program.code.size());
+        for (uint32_t id : ir.blocks[block].instructions)
+        {
+            if (ir.values[id].op < IR_JUMP)
+                emitInstruction(id);
+        }
+        const IrValue &last = ir.terminator(block);
+        if (last.op == IR_JUMP)
+        {
+            emitCopies(edgeCopies(block, last.a), last.line);
+            if (last.a != next)
+                jumps.push_back(emit(OP_JUMP, last.line, last.a));
+        }
+        else if (last.op == IR_BRANCH)
+        {
+            uint32_t onTrue = target(block, last.b), onFalse = target(block, last.c);
+            if (onFalse == next)
+                jumps.push_back(emit(OP_JUMP_IF_TRUE, last.line, registers[last.a], onTrue));
+            else
+            {
+                jumps.push_back(emit(OP_JUMP_IF_FALSE, last.line, registers[last.a], onFalse));
+                if (onTrue != next)
+                    jumps.push_back(emit(OP_JUMP, last.line, onTrue));
+            }
+        }
+        else if (last.op == IR_RETURN)
+            emit(returns[bankOf(last.b)], last.line, registers[last.a], last.b);
+        else
+            emit(OP_HALT, last.line, 0);
+    }
+    for (const Trampoline &trampoline : trampolines)
+    {
+        uint32_t line = ir.terminator(trampoline.from).line;
+        address.push_back(uint32_t(program.code.size()));
+        emitCopies(edgeCopies(trampoline.from, trampoline.to), line);
+        jumps.push_back(emit(OP_JUMP, line, trampoline.to));
+    }
+    for (size_t index : jumps)
+    {
+        Instruction &jump = program.code[index];
+        uint32_t &to = jump.op == OP_JUMP ? jump.a : jump.b;
+        to = address[to];
+    }
+}
@@ -0,0 +1,94 @@
+#ifndef COMPILER_IR_LOWERING_H
+#define COMPILER_IR_LOWERING_H
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "Bytecode.h"
+#include "Ir.h"
+
+// A move between two locations of one bank, one of the copies that give
+// the phis of a block the values they receive along an edge
+struct Copy
+{
+    Bank bank;
+    uint32_t to, from;
+};
+
+// Emits copies that act as if made at once: none overwrites a location
+// another has still to read. A cycle is broken by saving one location it
+// reads in scratch(bank). move(bank, to, from) emits a single move.
+template <typename Scratch, typename Move>
+void sequenceCopies(std::vector<Copy> copies, Scratch scratch, Move move)
+{
+    while (!copies.empty())
+    {
+        size_t ready = 0;
+        for (; ready < copies.size(); ready++)
+        {
+            bool read = false;
+            for (const Copy &other : copies)
+                read |= other.bank == copies[ready].bank && other.from == copies[ready].to;
+            if (!read)
+                break;
+        }
+        if (ready < copies.size())
+        {
+            move(copies[ready].bank, copies[ready].to, copies[ready].from);
+            copies.erase(copies.begin() + ready);
+            continue;
+        }
+
+        // Only cycles are left: save a location they read, and read it from there
+        Copy first = copies[0];
+        uint32_t saved = scratch(first.bank);
+        move(first.bank, saved, first.to);
+        for (Copy &copy : copies)
+        {
+            if (copy.bank == first.bank && copy.from == first.to)
+                copy.from = saved;
+        }
+    }
+}
+
+// Lowers an Ir to Bytecode: one register per group of LiveRanges. The phi
+// copies that remain are made on the incoming edge, through a trampoline
+// after the code when the edge leaves a branch. A jump to the block that
+// follows is left out.
+class IrLowering
+{
+private:
+    const Ir &ir;
+    Bytecode &program;
+    LiveRanges ranges;
+    std::vector<uint32_t> registers; // Register of each value
+    std::array<uint32_t, 3> scratch = {NO_VALUE, NO_VALUE, NO_VALUE}; // Breaks cycles of phi copies
+
+    uint32_t allocate(Bank bank);
+
+    size_t emit(Opcode op, uint32_t line, uint32_t a, uint32_t b = 0, uint32_t c = 0)
+    {
+        program.code.push_back(Instruction{op, a, b, c});
+        program.lines.push_back(line);
+        return program.code.size() - 1;
+    }
+
+    // Constants get the registers at the start of each bank, which the Bytecode preloads
+    void assignRegisters();
+
+    // The moves that give the phis of to the values they receive from from
+    std::vector<Copy> edgeCopies(uint32_t from, uint32_t to) const;
+
+    void emitCopies(const std::vector<Copy> &copies, uint32_t line);
+
+    void emitInstruction(uint32_t id);
+
+public:
+    IrLowering(const Ir &ir, Bytecode &program) : ir(ir), program(program), ranges(ir) {}
+
+    void lower();
+};
+
+#endif
@@ -0,0 +1,123 @@
+#include "Lexer.h"
+
+#include <cstring>
+
+using namespace std;
+
+size_t TokenBuffer::countSymbols(size_t from, size_t to) const
+{
+    size_t count = 0;
+    for (size_t i = from; i < to; i++)
+        count += hasSymbol(kinds[i]);
+    return count;
+}
+
+void TokenBuffer::reset(string_view source, const StringInterner &interner)
+{
+    src = source;
+    names = &interner;
+    kinds.clear();
+    offsets.clear();
+    symbols.clear();
+    symbolsBefore.clear();
+    counted = 0;
+}
+
+void TokenBuffer::add(const Token &token)
+{
+    if (kinds.size() % BLOCK == 0)
+    {
+        countBlocks(symbolsBefore.size());
+        symbolsBefore.push_back(uint32_t(symbols.size()));
+        counted++;
+    }
+    kinds.push_back(uint8_t(token.type));
+    offsets.push_back(uint32_t(token.value.data() - src.data()));
+    if (token.symbol != NO_SYMBOL)
+        symbols.push_back(token.symbol);
+}
+
+size_t TokenBuffer::firstStartingAt(size_t offset) const
+{
+    size_t low = 0, high = size();
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if (start(middle) < offset)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+Token TokenBuffer::token(size_t i, size_t symbolIndex) const
+{
+    uint8_t kind = kinds[i];
+    size_t offset = offsets[i], length;
+    uint32_t symbol = hasSymbol(kind) ? symbols[symbolIndex] : NO_SYMBOL;
+    if (hasSymbol(kind))
+        length = names->name(symbol).size();
+    else if (kind == T_NUM)
+        length = numberEnd(src, offset) - offset;
+    else if (kind == T_EOF)
+        length = 0;
+    else if (classOf(src[offset]) & CC_IDENT_START)
+        length = wordEnd(src, offset) - offset;
+    else
+        length = strlen(tokenText(TokenType(kind)));
+    return Token(type(i), src.substr(offset, length), symbol);
+}
+
+void TokenBuffer::splice(size_t from, size_t to, const TokenBuffer &replacement)
+{
+    size_t symbolFrom = symbolIndex(from), symbolTo = symbolIndex(to);
+    kinds.splice(from, to, replacement.kinds);
+    offsets.splice(from, to, replacement.offsets);
+    symbols.splice(symbolFrom, symbolTo, replacement.symbols);
+
+    // Entries up to the block holding from count only tokens before it
+    symbolsBefore.resize((kinds.size() + BLOCK - 1) / BLOCK);
+    counted = min(counted, from / BLOCK + 1);
+}
+
+void TokenBuffer::countBlocks(size_t block) const
+{
+    for (; counted <= block && counted < symbolsBefore.size(); counted++)
+    {
+        size_t begin = (counted - 1) * BLOCK;
+        symbolsBefore[counted] = uint32_t(symbolsBefore[counted - 1] + countSymbols(begin, begin + BLOCK));
+    }
+}
+
+string_view Lexer::consumeString()
+{
+    size_t start = ++pos; // Skip the opening quote (")
+    while (pos < src.size() && src[pos] != '"')
+    {
+        if (src[pos] == '\\' && pos + 1 < src.size())
+        {             // Handle escape sequences
+            pos += 2; // Skip the escape character and the next character
+            continue;
+        }
+        pos++; // Consume the character
+    }
+    string_view text = src.substr(start, pos - start);
+    if (pos < src.size())
+        pos++; // Skip the closing quote
+    else
+        diagnostics.error(start - 1, "Error: Unterminated string literal");
+    return text;
+}
+
+void Lexer::tokenize(TokenBuffer &tokens)
+{
+    TIME_SCOPE("lex");
+    tokens.reset(src, names);
+    Token token;
+    do
+    {
+        token = nextToken();
+        tokens.add(token);
+    } while (token.type != T_EOF);
+}
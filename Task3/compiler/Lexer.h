@@ -0,0 +1,247 @@
+#ifndef COMPILER_LEXER_H
+#define COMPILER_LEXER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "TimeReport.h"
+#include "Token.h"
+#include "Diagnostics.h"
+#include "../../common/CharScan.h"
+
+// Where the number literal starting at pos ends: digits with at most one '.'
+inline size_t numberEnd(std::string_view src, size_t pos)
+{
+    const char *begin = src.data(), *end = begin + src.size();
+    pos = scanDigits(begin + pos, end) - begin;
+    if (pos < src.size() && src[pos] == '.')
+        pos = scanDigits(begin + pos + 1, end) - begin;
+    return pos;
+}
+
+// Where the identifier or keyword starting at pos ends
+inline size_t wordEnd(std::string_view src, size_t pos)
+{
+    return scanIdentifier(src.data() + pos, src.data() + src.size()) - src.data();
+}
+
+// The tokens of a whole source, kept as parallel arrays rather than as
+// Tokens: a kind byte and a 32-bit offset per token, and the symbols of
+// identifiers and string literals in an array of their own. Dispatching on
+// kinds reads one byte per token. A Token is only put back together when
+// one is asked for; identifiers and string literals take their length from
+// the interner, numbers and keywords (which have localized spellings) are
+// scanned again, and every other kind has a fixed spelling. On generated
+// sources that comes to about 6.1 bytes a token, against 24 for a Token.
+// Lines are not stored either. Sources must be under 4 GiB.
+class TokenBuffer
+{
+private:
+    static const size_t BLOCK = 64; // Tokens per entry of symbolsBefore
+
+    std::string_view src;
+    const StringInterner *names = nullptr;
+    GapVector<uint8_t> kinds;
+    MovingOffsets offsets;         // Where the text starts: after the quote of a string literal
+    GapVector<uint32_t> symbols;   // Of the tokens that have one, in token order
+    // Entry b counts the symbols of tokens [0, b * BLOCK). Only the first
+    // counted entries are right; a splice leaves the ones after it to be
+    // recounted when asked for, so it does not recount the rest of the file.
+    mutable std::vector<uint32_t> symbolsBefore;
+    mutable size_t counted = 0;
+
+    static bool hasSymbol(uint8_t kind) { return kind == T_ID || kind == T_STRING_LITERAL; }
+
+    size_t countSymbols(size_t from, size_t to) const;
+
+    // Recounts the entries of symbolsBefore up to block
+    void countBlocks(size_t block) const;
+
+public:
+    static const size_t MAX_SOURCE = UINT32_MAX;
+
+    // Empties the buffer for the tokens of src, whose names are in names
+    void reset(std::string_view source, const StringInterner &interner);
+
+    // The same text has moved, or been edited around the tokens kept
+    void setSource(std::string_view source) { src = source; }
+
+    void add(const Token &token);
+
+    size_t size() const { return kinds.size(); }
+    TokenType type(size_t i) const { return TokenType(kinds[i]); }
+
+    // Offset of the first character of token i; string literals start at their quote
+    size_t start(size_t i) const { return offsets[i] - (kinds[i] == T_STRING_LITERAL); }
+    size_t startOf(const Token &token) const
+    {
+        return size_t(token.value.data() - src.data()) - (token.type == T_STRING_LITERAL);
+    }
+
+    // The first token starting at or after offset
+    size_t firstStartingAt(size_t offset) const;
+
+    // Where the symbol of token i is, or would be, in symbols
+    size_t symbolIndex(size_t i) const
+    {
+        size_t block = i / BLOCK;
+        if (block >= symbolsBefore.size())
+            return symbols.size();
+        if (block >= counted)
+            countBlocks(block);
+        return symbolsBefore[block] + countSymbols(block * BLOCK, i);
+    }
+
+    // Steps a symbolIndex() result from token i to token i + 1
+    size_t nextSymbolIndex(size_t i, size_t symbolIndex) const { return symbolIndex + hasSymbol(kinds[i]); }
+
+    // Token i, given its symbolIndex()
+    Token token(size_t i, size_t symbolIndex) const;
+
+    Token token(size_t i) const { return token(i, symbolIndex(i)); }
+
+    // Moves the tokens from from on by delta bytes, past an edit before them
+    void shift(size_t from, ptrdiff_t delta) { offsets.shift(from, delta); }
+
+    // Replaces tokens [from, to) with those of replacement, which reads the same source
+    void splice(size_t from, size_t to, const TokenBuffer &replacement);
+};
+
+class Lexer
+{
+private:
+    std::string_view src; // Not a copy: the caller keeps the source alive while tokens are in use
+    size_t pos;
+    StringInterner &names;
+    Diagnostics &diagnostics;
+
+public:
+    Lexer(std::string_view src, StringInterner &names, Diagnostics &diagnostics)
+        : src(src), pos(0), names(names), diagnostics(diagnostics) {}
+
+    // Continues lexing from offset; the lexer keeps no state between tokens
+    void seek(size_t offset) { pos = offset; }
+
+    std::string_view consumeNumber()
+    {
+        size_t start = pos;
+        pos = numberEnd(src, pos);
+        return src.substr(start, pos - start);
+    }
+
+    std::string_view consumeWord()
+    {
+        size_t start = pos;
+        pos = wordEnd(src, pos);
+        return src.substr(start, pos - start);
+    }
+
+    std::string_view consumeString();
+
+    Token nextToken()
+    {
+        TIME_COUNT(COUNTER_TOKENS, 1);
+        while (true) // Unrecognized characters are reported and skipped
+        {
+            pos = skipSpaces(src.data() + pos, src.data() + src.size()) - src.data();
+
+            if (pos == src.size())
+                return {T_EOF, src.substr(pos, 0)};
+
+            char current = src[pos];
+            uint8_t cls = classOf(current);
+
+            if (cls & CC_DIGIT)
+                return {T_NUM, consumeNumber()};
+            else if (cls & CC_IDENT_START)
+            {
+                std::string_view word = consumeWord();
+                TokenType type = lookupKeyword(word);
+                return {type, word, type == T_ID ? names.intern(word) : NO_SYMBOL};
+            }
+            else if (current == '"')
+            {
+                std::string_view text = consumeString();
+                return {T_STRING_LITERAL, text, names.intern(text)};
+            }
+
+            // Handle operators and punctuation
+            size_t start = pos++; // Every case below consumes at least the current character
+            switch (current)
+            {
+            case '=':
+                if (pos < src.size() && src[pos] == '=')
+                {
+                    pos++; // Skip the second character of '=='
+                    return {T_EQ, src.substr(start, pos - start)};
+                }
+                return {T_ASSIGN, src.substr(start, pos - start)};
+            case '+':
+                return {T_PLUS, src.substr(start, pos - start)};
+            case '-':
+                return {T_MINUS, src.substr(start, pos - start)};
+            case '*':
+                return {T_MUL, src.substr(start, pos - start)};
+            case '/':
+                return {T_DIV, src.substr(start, pos - start)};
+            case '(':
+                return {T_LPAREN, src.substr(start, pos - start)};
+            case ')':
+                return {T_RPAREN, src.substr(start, pos - start)};
+            case '{':
+                return {T_LBRACE, src.substr(start, pos - start)};
+            case '}':
+                return {T_RBRACE, src.substr(start, pos - start)};
+            case ';':
+                return {T_SEMICOLON, src.substr(start, pos - start)};
+            case '>':
+                if (pos < src.size() && src[pos] == '=')
+                {
+                    pos++; // Skip the second character of '>='
+                    return {T_GE, src.substr(start, pos - start)};
+                }
+                return {T_GT, src.substr(start, pos - start)};
+            case '<':
+                if (pos < src.size() && src[pos] == '=')
+                {
+                    pos++; // Skip the second character of '<='
+                    return {T_LE, src.substr(start, pos - start)};
+                }
+                return {T_LT, src.substr(start, pos - start)};
+            case '!':
+                if (pos < src.size() && src[pos] == '=')
+                {
+                    pos++; // Skip the second character of '!='
+                    return {T_NEQ, src.substr(start, pos - start)};
+                }
+                return {T_NOT, src.substr(start, pos - start)};
+            case '&':
+                if (pos < src.size() && src[pos] == '&')
+                {
+                    pos++; // Skip the second character of '&&'
+                    return {T_LOGICAL_AND, src.substr(start, pos - start)};
+                }
+                break;
+            case '|':
+                if (pos < src.size() && src[pos] == '|')
+                {
+                    pos++; // Skip the second character of '||'
+                    return {T_LOGICAL_OR, src.substr(start, pos - start)};
+                }
+                break;
+            case '\0':
+                return {T_EOF, src.substr(start, 0)}; // End of file
+            }
+
+            diagnostics.error(start, std::string("Error: Unrecognized character '") + current + "'");
+        }
+    }
+
+    // Fills tokens, reusing their storage
+    void tokenize(TokenBuffer &tokens);
+};
+
+#endif
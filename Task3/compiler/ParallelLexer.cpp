@@ -0,0 +1,148 @@
+#include "ParallelLexer.h"
+
+#include <cstdint>
+#include <memory>
+
+#include "TimeReport.h"
+
+using namespace std;
+
+bool WorkStealingPool::take(size_t worker, size_t &job)
+{
+    {
+        lock_guard<mutex> guard(queues[worker].lock);
+        if (!queues[worker].jobs.empty())
+        {
+            job = queues[worker].jobs.back();
+            queues[worker].jobs.pop_back();
+            return true;
+        }
+    }
+    for (size_t k = 1; k < queues.size(); k++)
+    {
+        Queue &victim = queues[(worker + k) % queues.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.jobs.empty())
+        {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false; // Jobs never add jobs, so every deque is empty for good
+}
+
+void tokenizeParallel(string_view src, StringInterner &names, Diagnostics &diagnostics, size_t threads,
+                      TokenBuffer &tokens, size_t minChunk)
+{
+    TIME_SCOPE("lex in parallel");
+    struct Chunk
+    {
+        size_t begin, end;
+        TokenBuffer tokens;        // Tokens starting before end, plus T_EOF if the file ends here
+        size_t next = SIZE_MAX;    // Start of the first token at or after end
+        unique_ptr<StringInterner> names;
+        unique_ptr<Diagnostics> errors;
+    };
+
+    size_t count = min(threads * 4, max(src.size() / minChunk, size_t(1)));
+    vector<Chunk> chunks;
+    for (size_t begin = 0; begin < src.size() || chunks.empty();)
+    {
+        size_t end = min(src.size(), max(begin + 1, src.size() * (chunks.size() + 1) / count));
+        while (end < src.size() && src[end - 1] != '\n')
+            end++;
+        chunks.push_back(Chunk{begin, end, {}, SIZE_MAX, make_unique<StringInterner>(), make_unique<Diagnostics>(src, 0)});
+        begin = end;
+    }
+
+    auto tokenStart = [&](const Token &token) {
+        size_t offset = size_t(token.value.data() - src.data());
+        return token.type == T_STRING_LITERAL ? offset - 1 : offset;
+    };
+
+    WorkStealingPool pool(threads);
+    pool.run(chunks.size(), [&](size_t index, size_t) {
+        TIME_SCOPE("lex chunk");
+        Chunk &chunk = chunks[index];
+        chunk.tokens.reset(src, *chunk.names);
+        Lexer lexer(src, *chunk.names, *chunk.errors);
+        lexer.seek(chunk.begin);
+        while (true)
+        {
+            Token token = lexer.nextToken();
+            if (token.type != T_EOF && tokenStart(token) >= chunk.end)
+            {
+                chunk.next = tokenStart(token);
+                break;
+            }
+            chunk.tokens.add(token);
+            if (token.type == T_EOF)
+                break;
+        }
+    });
+
+    // Join the chunks. next is where the serial lexer's next token starts.
+    TIME_SCOPE("join chunks");
+    tokens.reset(src, names);
+    Diagnostics seamErrors(src, 0);
+    Lexer seamLexer(src, names, seamErrors);
+    size_t next = 0;
+    vector<uint32_t> ids; // Chunk-local name id -> id in names
+    for (Chunk &chunk : chunks)
+    {
+        if (next >= chunk.next)
+            continue; // An earlier token covers the whole chunk
+        size_t first = chunk.tokens.firstStartingAt(next);
+        if (first == chunk.tokens.size() || chunk.tokens.start(first) != next)
+        {
+            // The chunk began inside a token: lex the seam until it lines up
+            size_t seamStart = next;
+            bool ended = false;
+            seamErrors.clear();
+            seamLexer.seek(next);
+            while (true)
+            {
+                Token token = seamLexer.nextToken();
+                size_t start = tokenStart(token);
+                while (first < chunk.tokens.size() && chunk.tokens.start(first) < start)
+                    first++;
+                if (token.type == T_EOF || start >= chunk.next ||
+                    (first < chunk.tokens.size() && chunk.tokens.start(first) == start))
+                {
+                    ended = token.type == T_EOF;
+                    if (ended)
+                        tokens.add(token);
+                    next = start;
+                    break;
+                }
+                tokens.add(token);
+            }
+            diagnostics.append(seamErrors, seamStart, ended ? SIZE_MAX : next);
+            if (ended)
+                return;
+            if (first == chunk.tokens.size() || chunk.tokens.start(first) != next)
+                continue; // Lined up at or past the chunk's end instead
+        }
+
+        // From here on the chunk's tokens are the serial ones; map its names to the shared ids
+        ids.assign(chunk.names->size(), NO_SYMBOL);
+        size_t symbol = chunk.tokens.symbolIndex(first);
+        for (size_t i = first; i < chunk.tokens.size(); i++)
+        {
+            Token token = chunk.tokens.token(i, symbol);
+            symbol = chunk.tokens.nextSymbolIndex(i, symbol);
+            if (token.symbol != NO_SYMBOL)
+            {
+                if (ids[token.symbol] == NO_SYMBOL)
+                    ids[token.symbol] = names.intern(chunk.names->name(token.symbol));
+                token.symbol = ids[token.symbol];
+            }
+            tokens.add(token);
+        }
+        diagnostics.append(*chunk.errors, next, chunk.next);
+        if (tokens.type(tokens.size() - 1) == T_EOF)
+            return;
+        next = chunk.next;
+    }
+}
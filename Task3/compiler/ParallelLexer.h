@@ -0,0 +1,83 @@
+#ifndef COMPILER_PARALLEL_LEXER_H
+#define COMPILER_PARALLEL_LEXER_H
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "Token.h"
+#include "Diagnostics.h"
+#include "Lexer.h"
+#include "TimeReport.h"
+
+// Runs jobs 0..count-1 on a fixed set of threads. Every worker owns a deque
+// of job indices, seeded with a contiguous share of them; it takes work from
+// the back of its own deque and, once that runs dry, steals from the front
+// of the others'. A job is a whole file, so one mutex per deque is cheap
+// next to the work it guards. The workers' phases count toward the phase
+// run() is called in.
+class WorkStealingPool
+{
+private:
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<size_t> jobs;
+    };
+
+    std::vector<Queue> queues; // One per worker
+
+    bool take(size_t worker, size_t &job);
+
+public:
+    explicit WorkStealingPool(size_t workers) : queues(std::max(workers, size_t(1))) {}
+
+    size_t workers() const { return queues.size(); }
+
+    // Calls job(index, worker) once for every index; worker identifies the
+    // calling thread's slot for per-thread state. Returns when all are done.
+    template <typename Job>
+    void run(size_t count, Job job)
+    {
+        size_t workerCount = queues.size();
+        for (size_t worker = 0; worker < workerCount; worker++)
+        {
+            for (size_t i = count * worker / workerCount; i < count * (worker + 1) / workerCount; i++)
+                queues[worker].jobs.push_back(i);
+        }
+
+        auto work = [&](size_t worker) {
+            size_t index;
+            while (take(worker, index))
+                job(index, worker);
+        };
+        auto phase = TIME_CURRENT_PHASE();
+        std::vector<std::thread> threads;
+        for (size_t worker = 1; worker < workerCount; worker++)
+            threads.emplace_back([&work, phase, worker] {
+                TIME_INHERIT(phase);
+                work(worker);
+            });
+        work(0);
+        for (std::thread &running : threads)
+            running.join();
+    }
+};
+
+// Lexes one large buffer on several threads. The buffer is cut into chunks
+// at newlines and every chunk is lexed on its own, speculating that no token
+// crosses into it. The chunks are then joined in order: the serial lexer's
+// next token start is carried from chunk to chunk, and a chunk's tokens are
+// taken from the first one that starts there. A chunk that starts inside a
+// string literal or other token has no such token; the seam is lexed again
+// serially until it lines up with the chunk. The lexer keeps no state
+// between tokens, so the result is exactly what tokenize() produces, ids of
+// interned names included.
+void tokenizeParallel(std::string_view src, StringInterner &names, Diagnostics &diagnostics, size_t threads,
+                      TokenBuffer &tokens, size_t minChunk = 1 << 20);
+
+#endif
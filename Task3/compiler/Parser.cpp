@@ -0,0 +1,517 @@
+#include "Parser.h"
+
+#include <charconv>
+#include <iomanip>
+#include <string_view>
+#include <system_error>
+
+#include "TimeReport.h"
+
+using namespace std;
+
+Token TokenStream::pull()
+{
+    if (ended) // Past the end the lexer would keep reading after a '\0'
+        return ring[(filled - 1) % RING];
+    Token token = lexer->nextToken();
+    ended = token.type == T_EOF;
+    return token;
+}
+
+const Token &TokenStream::load(size_t index)
+{
+    size_t i = min(index, tokens->size() - 1);
+    if (i < cursor || i - cursor > 64)
+        cursorSymbol = tokens->symbolIndex(i);
+    else
+    {
+        for (; cursor < i; cursor++)
+            cursorSymbol = tokens->nextSymbolIndex(cursor, cursorSymbol);
+    }
+    cursor = i;
+    return ring[index % RING] = tokens->token(i, cursorSymbol);
+}
+
+const Token &TokenStream::peek(size_t ahead)
+{
+    if (tokens)
+        return load(pos + ahead);
+    fill(pos + ahead);
+    return ring[(pos + ahead) % RING];
+}
+
+const Token &TokenStream::previous()
+{
+    if (tokens)
+        return load(pos - 1);
+    fill(pos);
+    return ring[(pos - 1) % RING];
+}
+
+// Binding strength of each binary operator, indexed by TokenType; 0 means the
+// token does not continue an expression. Every level is left-associative.
+// Prefix - and ! bind tighter than any binary operator.
+constexpr array<uint8_t, T_EOF + 1> makePrecedenceTable()
+{
+    array<uint8_t, T_EOF + 1> table{};
+    table[T_LOGICAL_OR] = 1;
+    table[T_LOGICAL_AND] = 2;
+    table[T_EQ] = table[T_NEQ] = 3;
+    table[T_LT] = table[T_GT] = table[T_LE] = table[T_GE] = 4;
+    table[T_PLUS] = table[T_MINUS] = 5;
+    table[T_MUL] = table[T_DIV] = 6;
+    return table;
+}
+
+static constexpr array<uint8_t, T_EOF + 1> binaryPrecedence = makePrecedenceTable();
+
+uint32_t Parser::parseProgram(ostream &out)
+{
+    TIME_SCOPE("parse");
+    uint32_t program = ast.add(N_PROGRAM, offsetOf(stream.current()));
+    parseStatementList(program, T_EOF);
+    if (diagnostics.count() == 0)
+    {
+        out << "Parsing completed successfully! No Syntax Error" << endl;
+        displaySymbolTable(out);
+    }
+    return program;
+}
+
+void Parser::syntaxError(const Token &token, const string &message)
+{
+    if (panicking || abandoned)
+        return;
+    panicking = true;
+    diagnostics.error(offsetOf(token), "Syntax error: " + message);
+}
+
+void Parser::synchronize()
+{
+    panicking = false;
+    if (stream.position() > 0 && (stream.previousType() == T_SEMICOLON || stream.previousType() == T_RBRACE))
+        return; // The failed statement already ended at one
+    while (stream.type() != T_EOF)
+    {
+        if (stream.type() == T_SEMICOLON)
+        {
+            stream.advance();
+            return;
+        }
+        if (stream.type() == T_RBRACE)
+            return;
+        stream.advance();
+    }
+}
+
+void Parser::parseStatementList(uint32_t block, TokenType end)
+{
+    size_t start = pendingStatements.size();
+    while (stream.type() != end && stream.type() != T_EOF && !diagnostics.full())
+    {
+        uint32_t statement = parseListedStatement(); // May push and pop nested blocks' statements
+        pendingStatements.push_back(statement);
+        if (ast[block].kind == N_PROGRAM)
+            pendingStarts.push_back(statementStart);
+    }
+    uint32_t count = uint32_t(pendingStatements.size() - start);
+    ast[block].a = ast.addList(pendingStatements.data() + start, count);
+    ast[block].b = count;
+    pendingStatements.resize(start);
+    if (ast[block].kind == N_PROGRAM)
+    {
+        ast[block].c = ast.addList(pendingStarts.data(), count);
+        pendingStarts.clear();
+    }
+}
+
+uint32_t Parser::parseListedStatement()
+{
+    size_t first = stream.position();
+    uint32_t statement = parseStatement();
+    if (panicking)
+    {
+        synchronize();
+        if (stream.position() == first)
+            stream.advance(); // A stray '}' at the outermost level starts no statement
+    }
+    return statement;
+}
+
+uint32_t Parser::parseStatement()
+{
+    if (statementDepth >= MAX_STATEMENT_DEPTH)
+    {
+        // Recovering inside the nesting would only report it again, so parsing ends here
+        syntaxError(stream.current(), "statements are nested too deeply");
+        abandoned = true;
+        uint32_t node = errorNode();
+        while (stream.type() != T_EOF)
+            stream.advance();
+        return node;
+    }
+    if (statementDepth == 1)
+        statementStart = offsetOf(stream.current());
+    statementDepth++;
+    uint32_t statement = parseStatementKind();
+    statementDepth--;
+    return statement;
+}
+
+uint32_t Parser::parseStatementKind()
+{
+    if (stream.type() == T_INT || stream.type() == T_FLOAT || stream.type() == T_STRING ||
+        stream.type() == T_BOOL)
+    {
+        return parseDeclaration();
+    }
+    else if (stream.type() == T_ID)
+    {
+        return parseAssignment();
+    }
+    else if (stream.type() == T_IF)
+    {
+        return parseIfStatement();
+    }
+    else if (stream.type() == T_WHILE)
+    {
+        return parseWhileLoop();
+    }
+    else if (stream.type() == T_FOR)
+    {
+        return parseForLoop();
+    }
+    else if (stream.type() == T_RETURN)
+    {
+        return parseReturnStatement();
+    }
+    else if (stream.type() == T_LBRACE)
+    {
+        return parseBlock();
+    }
+    else
+    {
+        syntaxError(stream.current(), "unexpected token " + found(stream.current()));
+        return errorNode();
+    }
+}
+
+uint32_t Parser::parseBlock()
+{
+    uint32_t block = ast.add(N_BLOCK, nodeOffset(stream.current()));
+    expect(T_LBRACE);
+    symbolTable.enterScope(); // Names declared in the block go away at its '}'
+    parseStatementList(block, T_RBRACE);
+    symbolTable.exitScope();
+    expect(T_RBRACE);
+    return block;
+}
+
+uint32_t Parser::parseDeclaration()
+{
+    TypeId dataType = TypeTable::primitive(tokenText(stream.type())); // Get the data type
+    stream.advance();                                                      // Move to the next token
+
+    if (stream.type() == T_ID)
+    {
+        uint32_t varName = stream.current().symbol;
+        uint32_t declaration = ast.add(N_DECL, nodeOffset(stream.current()), dataType);
+        ast[declaration].symbol = varName;
+        stream.advance(); // Move to the next token
+
+        // Add the variable to the symbol table, rejecting a duplicate in the same scope
+        uint32_t nameOffset = offsetOf(stream.previous());
+        if (!addToSymbolTable(varName, dataType, declaration))
+            semanticError(nameOffset, "Error: Variable '" + string(names.name(varName)) + "' is already declared");
+
+        // Check if there's an assignment during declaration
+        if (stream.type() == T_ASSIGN)
+        {
+            stream.advance();
+            uint32_t value = parseExpression(); // Handle assignment
+            checkAssignable(varName, dataType, ast[value].type, nameOffset);
+            ast[declaration].a = value;
+        }
+
+        expect(T_SEMICOLON); // Ensure semicolon is present
+        return declaration;
+    }
+    else
+    {
+        syntaxError(stream.current(), "expected variable name but found " + found(stream.current()));
+        return errorNode();
+    }
+}
+
+void Parser::displaySymbolTable(ostream &out)
+{
+    out << "\nSymbol Table:\n";
+    out << "-----------------------------------\n";
+    out << "| Variable Name |    Data Type   |\n";
+    out << "-----------------------------------\n";
+    for (const Symbol &symbol : symbolTable.live())
+    {
+        out << "| " << setw(14) << left << names.name(symbol.name)
+             << "| " << setw(15) << left << types.name(symbol.type) << "|\n";
+    }
+    out << "-----------------------------------\n";
+}
+
+uint32_t Parser::parseAssignmentExpression()
+{
+    uint32_t nameOffset = offsetOf(stream.current());
+    uint32_t varName = stream.current().symbol;
+    if (!expect(T_ID))
+        return errorNode();
+
+    const Symbol *symbol = symbolTable.lookup(varName);
+    if (!symbol)
+        semanticError(nameOffset, "Error: Variable '" + string(names.name(varName)) + "' is not declared");
+
+    uint32_t assignment = ast.add(N_ASSIGN, nameOffset - statementStart, symbol ? symbol->type : TYPE_ERROR);
+    ast[assignment].symbol = varName;
+    ast[assignment].b = symbol ? symbol->declaration : NO_NODE;
+
+    expect(T_ASSIGN);
+    uint32_t value = parseExpression(); // Parse the right-hand side of the assignment
+    checkAssignable(varName, ast[assignment].type, ast[value].type, nameOffset);
+    ast[assignment].a = value;
+    return assignment;
+}
+
+void Parser::checkAssignable(uint32_t varName, TypeId target, TypeId value, uint32_t offset)
+{
+    if (!TypeTable::assignable(target, value))
+    {
+        semanticError(offset, "Type error: cannot assign " + types.name(value) + " to " + types.name(target) +
+                                  " variable '" + string(names.name(varName)) + "'");
+    }
+}
+
+uint32_t Parser::makeBinary(TokenType op, uint32_t left, uint32_t right, uint32_t offset)
+{
+    TypeId leftType = ast[left].type, rightType = ast[right].type;
+    TypeId result = TypeTable::binaryResult(operatorText(op), leftType, rightType);
+    if (result == TYPE_ERROR && leftType != TYPE_ERROR && rightType != TYPE_ERROR)
+    {
+        semanticError(offset, string("Type error: operator ") + operatorText(op) + " cannot be applied to " +
+                                  types.name(leftType) + " and " + types.name(rightType));
+    }
+
+    uint32_t node = ast.add(N_BINARY, offset - statementStart, result);
+    ast[node].op = op;
+    ast[node].a = left;
+    ast[node].b = right;
+    return node;
+}
+
+uint32_t Parser::makeUnary(TokenType op, uint32_t operand, uint32_t offset)
+{
+    TypeId operandType = ast[operand].type;
+    TypeId result = TypeTable::unaryResult(operatorText(op), operandType);
+    if (result == TYPE_ERROR && operandType != TYPE_ERROR)
+    {
+        semanticError(offset, string("Type error: operator ") + operatorText(op) + " cannot be applied to " +
+                                  types.name(operandType));
+    }
+
+    uint32_t node = ast.add(N_UNARY, offset - statementStart, result);
+    ast[node].op = op;
+    ast[node].a = operand;
+    return node;
+}
+
+uint32_t Parser::parseIfStatement()
+{
+    uint32_t node = ast.add(N_IF, nodeOffset(stream.current()));
+    expect(T_IF);
+    expect(T_LPAREN);
+    ast[node].a = parseExpression();
+    expect(T_RPAREN);
+    ast[node].b = parseStatement();
+    if (stream.type() == T_ELSE)
+    {
+        expect(T_ELSE);
+        ast[node].c = parseStatement();
+    }
+    return node;
+}
+
+uint32_t Parser::parseWhileLoop()
+{
+    uint32_t node = ast.add(N_WHILE, nodeOffset(stream.current()));
+    expect(T_WHILE);
+    expect(T_LPAREN);
+    ast[node].a = parseExpression();
+    expect(T_RPAREN);
+    ast[node].b = parseStatement();
+    return node;
+}
+
+uint32_t Parser::parseForLoop()
+{
+    uint32_t node = ast.add(N_FOR, nodeOffset(stream.current()));
+    expect(T_FOR);
+    expect(T_LPAREN);
+    // For now, we'll only support a simple for loop structure: for (init; condition; increment)
+    ast[node].a = parseAssignmentExpression(); // Init assigns an already declared variable
+    expect(T_SEMICOLON);
+    ast[node].b = parseExpression(); // condition
+    expect(T_SEMICOLON);
+    ast[node].c = parseAssignmentExpression(); // Increment is an assignment too
+    expect(T_RPAREN);
+    ast[node].body = parseStatement();
+    return node;
+}
+
+uint32_t Parser::parseReturnStatement()
+{
+    uint32_t node = ast.add(N_RETURN, nodeOffset(stream.current()));
+    expect(T_RETURN);
+    ast[node].a = parseExpression();
+    expect(T_SEMICOLON);
+    return node;
+}
+
+uint32_t Parser::parseExpression()
+{
+    size_t operatorBase = operatorStack.size(), operandBase = operandStack.size();
+    size_t openParens = 0;
+    bool expectOperand = true;
+
+    while (true)
+    {
+        TokenType type = stream.type();
+        if (expectOperand)
+        {
+            if (type == T_LPAREN)
+            {
+                operatorStack.push_back(PendingOperator{T_LPAREN, 0, false, offsetOf(stream.current())});
+                stream.advance();
+                openParens++;
+            }
+            else if (type == T_MINUS || type == T_NOT)
+            {
+                operatorStack.push_back(
+                    PendingOperator{type, PREFIX_PRECEDENCE, true, offsetOf(stream.current())});
+                stream.advance();
+            }
+            else
+            {
+                operandStack.push_back(parsePrimary());
+                expectOperand = false;
+            }
+        }
+        else if (binaryPrecedence[type] > 0)
+        {
+            uint8_t precedence = binaryPrecedence[type];
+            while (operatorStack.size() > operatorBase && operatorStack.back().precedence >= precedence)
+                reduceOperator();
+            operatorStack.push_back(PendingOperator{type, precedence, false, offsetOf(stream.current())});
+            stream.advance();
+            expectOperand = true;
+        }
+        else if (type == T_RPAREN && openParens > 0)
+        {
+            while (operatorStack.back().op != T_LPAREN || operatorStack.back().precedence != 0)
+                reduceOperator();
+            operatorStack.pop_back();
+            openParens--;
+            stream.advance();
+        }
+        else
+        {
+            break; // Anything else ends the expression
+        }
+    }
+
+    if (openParens > 0)
+        expect(T_RPAREN); // Reports the missing ')'
+    while (operatorStack.size() > operatorBase)
+    {
+        if (operatorStack.back().precedence == 0)
+            operatorStack.pop_back(); // A '(' left open by the error above
+        else
+            reduceOperator();
+    }
+
+    uint32_t result = operandStack.back();
+    operandStack.resize(operandBase);
+    return result;
+}
+
+void Parser::reduceOperator()
+{
+    PendingOperator pending = operatorStack.back();
+    operatorStack.pop_back();
+    uint32_t right = operandStack.back();
+    if (pending.prefix)
+    {
+        operandStack.back() = makeUnary(pending.op, right, pending.offset);
+        return;
+    }
+    operandStack.pop_back();
+    operandStack.back() = makeBinary(pending.op, operandStack.back(), right, pending.offset);
+}
+
+uint32_t Parser::parsePrimary()
+{
+    const Token &token = stream.current();
+    if (token.type == T_NUM)
+    {
+        const char *first = token.value.data(), *last = first + token.value.size();
+        uint32_t node;
+        from_chars_result parsed;
+        if (token.value.find('.') != string_view::npos)
+        {
+            node = ast.add(N_NUMBER, nodeOffset(token), TYPE_FLOAT);
+            parsed = from_chars(first, last, ast[node].floatValue);
+        }
+        else
+        {
+            node = ast.add(N_NUMBER, nodeOffset(token), TYPE_INT);
+            parsed = from_chars(first, last, ast[node].intValue);
+        }
+        // The lexer only lets digits and at most one '.' through, so the one
+        // way to fail is a value that does not fit
+        if (parsed.ec != errc() || parsed.ptr != last)
+            semanticError(offsetOf(token), string("Error: ") + (ast[node].type == TYPE_FLOAT ? "float" : "integer") +
+                                               " literal out of range");
+        stream.advance();
+        return node;
+    }
+    else if (token.type == T_ID)
+    {
+        const Symbol *symbol = symbolTable.lookup(token.symbol);
+        if (!symbol)
+            semanticError(offsetOf(token), "Error: Variable '" + string(token.value) + "' is not declared");
+        uint32_t node = ast.add(N_NAME, nodeOffset(token), symbol ? symbol->type : TYPE_ERROR);
+        ast[node].symbol = token.symbol;
+        ast[node].a = symbol ? symbol->declaration : NO_NODE;
+        stream.advance();
+        return node;
+    }
+    else if (token.type == T_STRING_LITERAL)
+    {
+        uint32_t node = ast.add(N_STRING, nodeOffset(token), TYPE_STRING);
+        ast[node].symbol = token.symbol;
+        stream.advance();
+        return node;
+    }
+    else
+    {
+        syntaxError(token, "expected an expression but found " + found(token));
+        return errorNode();
+    }
+}
+
+bool Parser::expect(TokenType type)
+{
+    if (stream.type() == type)
+    {
+        stream.advance();
+        return true;
+    }
+    syntaxError(stream.current(), string("expected '") + tokenText(type) + "' but found " + found(stream.current()));
+    return false;
+}
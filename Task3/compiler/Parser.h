@@ -0,0 +1,219 @@
+#ifndef COMPILER_PARSER_H
+#define COMPILER_PARSER_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Token.h"
+#include "Ast.h"
+#include "Diagnostics.h"
+#include "Lexer.h"
+
+// Token source of the parser. Tokens are pulled from the lexer only when the
+// parser reaches them and are kept in a ring of RING slots: the previous
+// token, the current one and a little lookahead. Memory therefore does not
+// grow with the file; only the AST does. The stream can read a TokenBuffer
+// instead, for callers that already have one (the incremental session and
+// the parallel lexer); only that mode can seek, and there type() reads just
+// the kind byte, with no Token put together.
+class TokenStream
+{
+private:
+    static const size_t RING = 4; // A power of two, so the modulo below is a mask
+    Lexer *lexer = nullptr;
+    const TokenBuffer *tokens = nullptr; // Owned by the caller, who may splice it between seeks
+    std::array<Token, RING> ring;
+    size_t pos = 0;    // Index of the current token in the whole stream
+    size_t filled = 0; // Tokens pulled so far; the ring holds the last RING of them
+    bool ended = false;
+    size_t cursor = 0, cursorSymbol = 0; // A token of the buffer and its symbolIndex(), to step from
+
+    Token pull();
+
+    void fill(size_t index)
+    {
+        for (; filled <= index; filled++)
+            ring[filled % RING] = pull();
+    }
+
+    // Token index of the buffer, in its ring slot; past the end it is the T_EOF
+    const Token &load(size_t index);
+
+public:
+    explicit TokenStream(Lexer &lexer) : lexer(&lexer) {}
+    explicit TokenStream(const TokenBuffer &tokens) : tokens(&tokens) {}
+
+    // The token ahead tokens after the current one; ahead must be below RING - 1
+    const Token &peek(size_t ahead = 0);
+    const Token &current() { return peek(0); }
+
+    // The token before the current one; only valid when position() > 0
+    const Token &previous();
+
+    // Kind of peek(ahead) and of previous()
+    TokenType type(size_t ahead = 0)
+    {
+        return tokens ? tokens->type(std::min(pos + ahead, tokens->size() - 1)) : peek(ahead).type;
+    }
+    TokenType previousType() { return tokens ? tokens->type(std::min(pos - 1, tokens->size() - 1)) : previous().type; }
+
+    // A returned reference stays valid for RING - 2 further advances
+    void advance() { pos++; }
+    size_t position() const { return pos; }
+
+    // Moves to token index of the buffer, which may have changed since the last seek
+    void seek(size_t index)
+    {
+        pos = index;
+        cursor = cursorSymbol = 0;
+    }
+};
+
+const uint8_t PREFIX_PRECEDENCE = 7;
+
+class Parser
+{
+private:
+    static const size_t MAX_STATEMENT_DEPTH = 10000; // Statements recurse; as deep as the backends go
+
+    TokenStream &stream;
+    const StringInterner &names;
+    TypeTable &types;
+    Ast &ast;
+    SymbolTable symbolTable;
+    Diagnostics &diagnostics;
+    bool panicking = false; // Set by a syntax error until the next statement boundary
+    std::vector<uint32_t> pendingStatements; // Statements of the blocks being parsed, innermost last
+    size_t statementDepth = 1; // The program counts, as it does in the backends
+    uint32_t statementStart = 0; // Source offset of the top-level statement being parsed
+    std::vector<uint32_t> pendingStarts; // Where the top-level statements parsed so far start
+    bool abandoned = false;    // Set when the nesting limit ends parsing, to silence what follows
+
+    // Operator stack entry of parseExpression: a pending binary or prefix operator, or an open '('
+    struct PendingOperator
+    {
+        TokenType op;
+        uint8_t precedence; // 0 for '('
+        bool prefix;
+        uint32_t offset; // Where the operator is in the source
+    };
+    std::vector<PendingOperator> operatorStack;
+    std::vector<uint32_t> operandStack;
+
+public:
+    Parser(TokenStream &stream, const StringInterner &names, TypeTable &types, Ast &ast, Diagnostics &diagnostics)
+        : stream(stream), names(names), types(types), ast(ast), diagnostics(diagnostics) {}
+
+    // Parses the whole token stream and returns the N_PROGRAM node
+    uint32_t parseProgram(std::ostream &out = std::cout);
+
+    // Where the token starts; a string literal's value starts after its quote
+    uint32_t offsetOf(const Token &token) const
+    {
+        return uint32_t(diagnostics.offsetOf(token.value) - (token.type == T_STRING_LITERAL));
+    }
+
+    // Where the token is, as the nodes made for it keep it: past the start of the top-level statement
+    uint32_t nodeOffset(const Token &token) const { return offsetOf(token) - statementStart; }
+
+    // Reports a syntax error at token and enters panic mode, in which further
+    // errors are suppressed until synchronize() finds a statement boundary
+    void syntaxError(const Token &token, const std::string &message);
+
+    // Type and name errors do not derail parsing, but are not worth reporting
+    // while a syntax error is already being recovered from
+    void semanticError(uint32_t offset, const std::string &message)
+    {
+        if (!panicking)
+            diagnostics.error(offset, message);
+    }
+
+    // Skips to the next statement boundary: just past a ';', or before a '}'
+    void synchronize();
+
+    uint32_t errorNode() { return ast.add(N_ERROR, nodeOffset(stream.current()), TYPE_ERROR); }
+
+    // Describes the token an error was found at
+    std::string found(const Token &token) const
+    {
+        if (token.type == T_STRING_LITERAL)
+            return "\"" + std::string(token.value) + "\"";
+        return token.type == T_EOF ? std::string("end of file") : "'" + std::string(token.value) + "'";
+    }
+
+    // Parses statements up to (not including) the end token into block's statement list
+    void parseStatementList(uint32_t block, TokenType end);
+
+    // Parses one statement of a statement list and recovers from a syntax error in it
+    uint32_t parseListedStatement();
+
+    // Position in the token stream, for callers that parse statement by statement
+    size_t position() const { return stream.position(); }
+    void seek(size_t position) { stream.seek(position); }
+    SymbolTable &symbols() { return symbolTable; }
+
+    // Parses one statement; past MAX_STATEMENT_DEPTH reports an error and abandons the rest of the file
+    uint32_t parseStatement();
+
+    uint32_t parseStatementKind();
+
+    uint32_t parseBlock();
+
+    // Symbols get no line: where the declaration is, its node says
+    bool addToSymbolTable(uint32_t varName, TypeId type, uint32_t declaration)
+    {
+        return symbolTable.declare(varName, type, 0, declaration);
+    }
+
+    uint32_t parseDeclaration();
+
+    void displaySymbolTable(std::ostream &out = std::cout);
+
+    uint32_t parseAssignment()
+    {
+        uint32_t assignment = parseAssignmentExpression();
+        expect(T_SEMICOLON);
+        return assignment;
+    }
+
+    // "name = expression" without the semicolon, shared by statements and for loop headers
+    uint32_t parseAssignmentExpression();
+
+    void checkAssignable(uint32_t varName, TypeId target, TypeId value, uint32_t offset);
+
+    // Builds "left op right" and types it
+    uint32_t makeBinary(TokenType op, uint32_t left, uint32_t right, uint32_t offset);
+
+    // Builds "op operand" for a prefix operator and types it
+    uint32_t makeUnary(TokenType op, uint32_t operand, uint32_t offset);
+
+    uint32_t parseIfStatement();
+
+    uint32_t parseWhileLoop();
+
+    uint32_t parseForLoop();
+
+    uint32_t parseReturnStatement();
+
+    // Operator-precedence parsing driven by binaryPrecedence. Operators and open
+    // parentheses wait on an explicit stack until an operator that binds no
+    // tighter arrives, so neither long operator chains nor deep nesting of
+    // parentheses use any native stack, and no call is made per precedence level.
+    uint32_t parseExpression();
+
+    // Applies the operator on top of the stack to the operands on top of theirs
+    void reduceOperator();
+
+    // A literal or a name; parentheses and prefix operators are handled by parseExpression
+    uint32_t parsePrimary();
+
+    // Consumes a token of the given type, or reports it missing and consumes nothing
+    bool expect(TokenType type);
+};
+
+#endif
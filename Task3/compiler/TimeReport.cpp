@@ -0,0 +1,186 @@
+#include "TimeReport.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <string_view>
+#include <unordered_map>
+
+using namespace std;
+
+#ifndef NO_TIME_REPORT
+
+thread_local uint64_t timeCounters[COUNTER_COUNT];
+
+TimeReport::ThreadLog &TimeReport::log()
+{
+    thread_local ThreadLog *current = nullptr;
+    if (!current)
+    {
+        lock_guard<mutex> lock(registering);
+        threads.push_back(make_unique<ThreadLog>());
+        current = threads.back().get();
+        current->id = uint32_t(threads.size());
+        current->name = this_thread::get_id() == mainThread ? string("main") : "worker " + to_string(current->id - 1);
+    }
+    return *current;
+}
+
+void TimeReport::printCount(ostream &out, int width, uint64_t count)
+{
+    if (count > 0)
+        out << setw(width) << count;
+    else
+        out << setw(width) << "-";
+}
+
+void TimeReport::start()
+{
+    on = true;
+    epoch = chrono::steady_clock::now();
+    mainThread = this_thread::get_id();
+    log();
+}
+
+void TimeReport::printTable(ostream &out) const
+{
+    struct Row
+    {
+        const char *name;
+        uint64_t first, calls = 0, nanoseconds = 0, counters[COUNTER_COUNT] = {}, allocations = 0, bytes = 0;
+        uint32_t depth;
+    };
+    vector<Row> rows;
+    unordered_map<string_view, size_t> rowOf;
+    for (const unique_ptr<ThreadLog> &thread : threads)
+    {
+        for (const Event &event : thread->events)
+        {
+            auto found = rowOf.emplace(event.name, rows.size());
+            if (found.second)
+                rows.push_back(Row{event.name, event.start, 0, 0, {}, 0, 0, event.depth});
+            Row &row = rows[found.first->second];
+            row.first = min(row.first, event.start);
+            row.depth = max(row.depth, event.depth); // Workers started outside any phase start at 0
+            row.calls++;
+            row.nanoseconds += event.duration;
+            for (int i = 0; i < COUNTER_COUNT; i++)
+                row.counters[i] += event.counters[i];
+            row.allocations += event.allocations;
+            row.bytes += event.allocatedBytes;
+        }
+    }
+    stable_sort(rows.begin(), rows.end(), [](const Row &a, const Row &b) { return a.first < b.first; });
+
+    out << left << setw(30) << "Phase" << right << setw(7) << "Calls" << setw(10) << "ms" << setw(11) << "Tokens"
+        << setw(8) << "Mtok/s" << setw(10) << "Interned" << setw(10) << "Declared" << setw(10) << "Lookups"
+        << setw(11) << "Collisions" << setw(10) << "Allocs" << setw(10) << "Alloc KB" << "\n";
+    for (const Row &row : rows)
+    {
+        double milliseconds = row.nanoseconds / 1e6;
+        out << left << setw(30) << (string(2 * min(row.depth, 4u), ' ') + row.name).substr(0, 29) << right
+            << setw(7) << row.calls << fixed << setprecision(2) << setw(10) << milliseconds;
+        printCount(out, 11, row.counters[COUNTER_TOKENS]);
+        if (row.counters[COUNTER_TOKENS] > 0 && row.nanoseconds > 0)
+            out << setprecision(1) << setw(8) << row.counters[COUNTER_TOKENS] * 1e3 / row.nanoseconds;
+        else
+            out << setw(8) << "-";
+        printCount(out, 10, row.counters[COUNTER_INTERNED]);
+        printCount(out, 10, row.counters[COUNTER_DECLARATIONS]);
+        printCount(out, 10, row.counters[COUNTER_LOOKUPS]);
+        printCount(out, 11, row.counters[COUNTER_COLLISIONS]);
+        printCount(out, 10, row.allocations);
+        printCount(out, 10, row.bytes / 1024);
+        out << defaultfloat << setprecision(6) << "\n";
+    }
+    out << "Total " << fixed << setprecision(2) << now() / 1e6 << defaultfloat << setprecision(6) << " ms on "
+        << threads.size() << " thread(s)" << endl;
+}
+
+void TimeReport::writeTrace(ostream &out) const
+{
+    static const char *const counterNames[] = {"tokens", "interned", "declared", "lookups", "collisions"};
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    auto separate = [&]() {
+        if (!first)
+            out << ",\n";
+        first = false;
+    };
+    out << fixed << setprecision(3);
+    for (const unique_ptr<ThreadLog> &thread : threads)
+    {
+        separate();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread->id
+            << ",\"args\":{\"name\":\"" << thread->name << "\"}}";
+        for (const Event &event : thread->events)
+        {
+            separate();
+            out << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread->id
+                << ",\"ts\":" << event.start / 1e3 << ",\"dur\":" << event.duration / 1e3 << ",\"args\":{";
+            for (int i = 0; i < COUNTER_COUNT; i++)
+                out << (i > 0 ? "," : "") << "\"" << counterNames[i] << "\":" << event.counters[i];
+            if (allocationsCounted)
+                out << ",\"allocations\":" << event.allocations << ",\"allocated bytes\":" << event.allocatedBytes;
+            out << "}}";
+        }
+    }
+    out << defaultfloat << setprecision(6) << "\n]}" << endl;
+}
+
+TimeReport timeReport;
+
+ScopedTimer::ScopedTimer(const char *name) : active(timeReport.enabled())
+{
+    if (!active)
+        return;
+    event.name = name;
+    event.depth = depth++;
+    outer = innermost;
+    parent = outer == inherited ? inherited : nullptr;
+    innermost = this;
+    memcpy(event.counters, timeCounters, sizeof event.counters);
+    event.allocations = allocationCount;
+    event.allocatedBytes = allocationBytes;
+    event.start = timeReport.now();
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    if (!active)
+        return;
+    event.duration = timeReport.now() - event.start;
+    for (int i = 0; i < COUNTER_COUNT; i++)
+        event.counters[i] = timeCounters[i] - event.counters[i] + workerCounters[i];
+    event.allocations = allocationCount - event.allocations + workerAllocations;
+    event.allocatedBytes = allocationBytes - event.allocatedBytes + workerBytes;
+    if (parent)
+    {
+        for (int i = 0; i < COUNTER_COUNT; i++)
+            parent->workerCounters[i] += event.counters[i];
+        parent->workerAllocations += event.allocations;
+        parent->workerBytes += event.allocatedBytes;
+    }
+    else if (outer)
+    {
+        // The enclosing phase on this thread sees this thread's counts, but not the workers'
+        for (int i = 0; i < COUNTER_COUNT; i++)
+            outer->workerCounters[i] += workerCounters[i];
+        outer->workerAllocations += workerAllocations;
+        outer->workerBytes += workerBytes;
+    }
+    depth--;
+    innermost = outer;
+    timeReport.record(event);
+}
+
+void ScopedTimer::inherit(ScopedTimer *phase)
+{
+    inherited = innermost = phase;
+    depth = phase ? phase->event.depth + 1 : 0;
+}
+
+thread_local uint32_t ScopedTimer::depth = 0;
+thread_local ScopedTimer *ScopedTimer::innermost = nullptr;
+thread_local ScopedTimer *ScopedTimer::inherited = nullptr;
+#endif
@@ -0,0 +1,145 @@
+#ifndef COMPILER_TIME_REPORT_H
+#define COMPILER_TIME_REPORT_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Heap allocations made by the current thread. They are only counted in
+// builds with -DCOUNT_ALLOCATIONS, which replace the global operator new
+// (see AllocationCounter.cpp); elsewhere both stay 0.
+extern thread_local uint64_t allocationCount;
+extern thread_local uint64_t allocationBytes;
+#ifdef COUNT_ALLOCATIONS
+constexpr bool allocationsCounted = true;
+#else
+constexpr bool allocationsCounted = false;
+#endif
+
+// Phase timing for --time-report. TIME_SCOPE(name) times the rest of the
+// enclosing block as one phase and TIME_COUNT(counter, n) adds to a counter
+// of the calling thread. Every thread logs its own phases, so a parallel
+// compile shows one timeline per worker. A thread started inside a phase
+// first calls TIME_INHERIT with the TIME_CURRENT_PHASE() of the thread that
+// started it; its phases are then nested in that one and add to its counts.
+// Building with -DNO_TIME_REPORT turns the macros into nothing.
+#ifndef NO_TIME_REPORT
+enum TimeCounter : uint8_t
+{
+    COUNTER_TOKENS,
+    COUNTER_INTERNED,     // StringInterner::intern calls
+    COUNTER_DECLARATIONS, // SymbolTable::declare calls
+    COUNTER_LOOKUPS,      // SymbolTable::lookup calls
+    COUNTER_COLLISIONS,   // Probes past an occupied slot, in the interner and the symbol table
+    COUNTER_COUNT
+};
+
+extern thread_local uint64_t timeCounters[COUNTER_COUNT];
+
+class TimeReport
+{
+public:
+    struct Event
+    {
+        const char *name; // A string literal, or a name that outlives the report
+        uint64_t start, duration; // Nanoseconds since start()
+        uint32_t depth;           // Phases open around it on its thread
+        uint64_t counters[COUNTER_COUNT];
+        uint64_t allocations, allocatedBytes;
+    };
+
+private:
+    struct ThreadLog
+    {
+        uint32_t id;
+        std::string name;
+        std::vector<Event> events;
+    };
+
+    bool on = false;
+    std::chrono::steady_clock::time_point epoch;
+    std::thread::id mainThread;
+    std::mutex registering;
+    std::vector<std::unique_ptr<ThreadLog>> threads;
+
+    ThreadLog &log();
+
+    static void printCount(std::ostream &out, int width, uint64_t count);
+
+public:
+    // Starts recording, on the thread that will print the report
+    void start();
+
+    bool enabled() const { return on; }
+
+    uint64_t now() const
+    {
+        auto elapsed = std::chrono::steady_clock::now() - epoch;
+        return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    void record(const Event &event) { log().events.push_back(event); }
+
+    // One row per phase name, summed over calls and threads, in the order
+    // the phases first started. Times and counts include nested phases;
+    // counts also include the phases of workers started inside them.
+    void printTable(std::ostream &out) const;
+
+    // Chrome trace-event JSON, for chrome://tracing or Perfetto: a complete
+    // event per phase, with its counters as arguments, on its thread's track
+    void writeTrace(std::ostream &out) const;
+};
+
+extern TimeReport timeReport;
+
+// Records the phase from its construction to the end of its scope
+class ScopedTimer
+{
+private:
+    static thread_local uint32_t depth;
+    static thread_local ScopedTimer *innermost; // Open phase of this thread, else the inherited one
+    static thread_local ScopedTimer *inherited; // Phase of another thread this one was started in
+
+    TimeReport::Event event;
+    bool active;
+    ScopedTimer *outer = nullptr;  // innermost when this phase began
+    ScopedTimer *parent = nullptr; // inherited, if this phase is one of the outermost of a worker
+    std::atomic<uint64_t> workerCounters[COUNTER_COUNT] = {}; // Added by the phases of workers
+    std::atomic<uint64_t> workerAllocations{0}, workerBytes{0};
+
+public:
+    explicit ScopedTimer(const char *name);
+
+    ScopedTimer(const ScopedTimer &) = delete;
+    ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    ~ScopedTimer();
+
+    static ScopedTimer *current() { return innermost; }
+
+    // Makes the outermost phases of the calling thread part of phase, which
+    // stays open on the thread that started this one until it has ended
+    static void inherit(ScopedTimer *phase);
+};
+
+#define TIME_JOIN(a, b) a##b
+#define TIME_NAME(line) TIME_JOIN(scopedTimer, line)
+#define TIME_SCOPE(name) ScopedTimer TIME_NAME(__LINE__)(name)
+#define TIME_COUNT(counter, n) (timeCounters[counter] += (n))
+#define TIME_CURRENT_PHASE() ScopedTimer::current()
+#define TIME_INHERIT(phase) ScopedTimer::inherit(phase)
+#else
+#define TIME_SCOPE(name)
+#define TIME_COUNT(counter, n)
+#define TIME_CURRENT_PHASE() nullptr
+#define TIME_INHERIT(phase) ((void)(phase))
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef COMPILER_TOKEN_H
+#define COMPILER_TOKEN_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "TimeReport.h"
+#include "../../common/StringInterner.h"
+#include "../../common/Keywords.h"
+#include "../../common/TypeTable.h"
+#include "../../common/SymbolTable.h"
+
+enum TokenType : uint8_t
+{
+    T_INT,
+    T_FLOAT,
+    T_STRING,
+    T_BOOL,
+    T_ID,
+    T_NUM,
+    T_IF,
+    T_ELSE,
+    T_RETURN,
+    T_ASSIGN,
+    T_PLUS,
+    T_MINUS,
+    T_MUL,
+    T_DIV,
+    T_LPAREN,
+    T_RPAREN,
+    T_LBRACE,
+    T_RBRACE,
+    T_SEMICOLON,
+    T_GT,
+    T_LT,
+    T_EQ,
+    T_NEQ,
+    T_LOGICAL_AND,
+    T_LOGICAL_OR,
+    T_WHILE,
+    T_FOR,
+    T_LE,
+    T_GE,
+    T_NOT,
+    T_STRING_LITERAL, // "text"; the string keyword is T_STRING
+    T_EOF
+};
+
+// A token does not own its text: value is a view into the source buffer
+// held by the caller of Lexer, so producing a token never allocates.
+// Its line and column are not kept either; they are looked up from where
+// value starts when needed, see LineIndex.
+struct Token
+{
+    std::string_view value;
+    uint32_t symbol; // Interned name of a T_ID token or text of a string literal, else NO_SYMBOL
+    TokenType type;
+
+    Token() : symbol(NO_SYMBOL), type(T_EOF) {}
+    Token(TokenType type, std::string_view value, uint32_t symbol = NO_SYMBOL)
+        : value(value), symbol(symbol), type(type) {}
+};
+
+// Token type of each shared keyword; the ones this language does not reserve are identifiers
+static constexpr TokenType keywordTokens[NOT_KEYWORD + 1] = {
+    T_INT, T_FLOAT, T_ID /* double */, T_STRING, T_BOOL, T_ID /* char */,
+    T_IF, T_ELSE, T_RETURN, T_WHILE, T_FOR, T_ID};
+
+// Returns the keyword's token type, or T_ID for any other (non-empty) word
+inline TokenType lookupKeyword(std::string_view word) { return keywordTokens[findKeyword(word)]; }
+
+inline const char *operatorText(TokenType op)
+{
+    switch (op)
+    {
+    case T_PLUS: return "+";
+    case T_MINUS: return "-";
+    case T_MUL: return "*";
+    case T_DIV: return "/";
+    case T_GT: return ">";
+    case T_LT: return "<";
+    case T_GE: return ">=";
+    case T_LE: return "<=";
+    case T_NOT: return "!";
+    case T_EQ: return "==";
+    case T_NEQ: return "!=";
+    case T_LOGICAL_AND: return "&&";
+    case T_LOGICAL_OR: return "||";
+    default: return "?";
+    }
+}
+
+// Spelling of any token type, for diagnostics
+inline const char *tokenText(TokenType type)
+{
+    switch (type)
+    {
+    case T_INT: return "int";
+    case T_FLOAT: return "float";
+    case T_STRING: return "string";
+    case T_BOOL: return "bool";
+    case T_ID: return "identifier";
+    case T_NUM: return "number";
+    case T_STRING_LITERAL: return "string literal";
+    case T_IF: return "if";
+    case T_ELSE: return "else";
+    case T_RETURN: return "return";
+    case T_WHILE: return "while";
+    case T_FOR: return "for";
+    case T_ASSIGN: return "=";
+    case T_LPAREN: return "(";
+    case T_RPAREN: return ")";
+    case T_LBRACE: return "{";
+    case T_RBRACE: return "}";
+    case T_SEMICOLON: return ";";
+    case T_EOF: return "end of file";
+    default: return operatorText(type);
+    }
+}
+
+#endif
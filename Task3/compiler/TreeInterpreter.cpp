@@ -0,0 +1,198 @@
+#include "TreeInterpreter.h"
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+using namespace std;
+
+TreeInterpreter::Value TreeInterpreter::convert(Value value, TypeId to)
+{
+    if (to == TYPE_BOOL)
+        value.intValue = truth(value);
+    else if (to == TYPE_FLOAT && bankOf(value.type) == BANK_INT)
+        value.floatValue = double(value.intValue);
+    else if (to == TYPE_INT && bankOf(value.type) == BANK_FLOAT)
+        value.intValue = floatToInt(value.floatValue);
+    value.type = to;
+    return value;
+}
+
+TreeInterpreter::Value TreeInterpreter::evaluate(uint32_t index)
+{
+    const Node &node = ast[index];
+    result.executed++;
+    if (node.kind == N_NUMBER)
+    {
+        Value value = zero(node.type);
+        value.intValue = node.type == TYPE_INT ? node.intValue : 0;
+        value.floatValue = node.type == TYPE_FLOAT ? node.floatValue : 0;
+        return value;
+    }
+    if (node.kind == N_STRING)
+    {
+        Value value = zero(TYPE_STRING);
+        value.stringValue = string(names.name(node.symbol));
+        return value;
+    }
+    if (node.kind == N_NAME)
+    {
+        assert(node.a != NO_NODE); // An undeclared name stops the compile before any engine runs
+        return slots[node.a];
+    }
+    if (depth >= MAX_EXPRESSION_DEPTH)
+    {
+        fail("Error: an expression is nested too deeply to run");
+        return zero(node.type);
+    }
+
+    depth++;
+    Value value = zero(node.type);
+    if (node.kind == N_UNARY && node.op == T_NOT)
+        value.intValue = !truth(evaluate(node.a));
+    else if (node.kind == N_UNARY)
+    {
+        Value operand = convert(evaluate(node.a), node.type);
+        value.intValue = int64_t(0 - uint64_t(operand.intValue));
+        value.floatValue = -operand.floatValue;
+    }
+    else if (node.op == T_LOGICAL_AND || node.op == T_LOGICAL_OR)
+    {
+        bool left = truth(evaluate(node.a)); // The right operand only runs if this does not decide
+        if (node.op == T_LOGICAL_AND)
+            value.intValue = left && truth(evaluate(node.b));
+        else
+            value.intValue = left || truth(evaluate(node.b));
+    }
+    else if (node.type == TYPE_BOOL) // Comparison
+    {
+        TypeId left = ast[node.a].type, right = ast[node.b].type;
+        TypeId common = left == TYPE_STRING ? TYPE_STRING : max(TYPE_INT, max(left, right));
+        Value a = convert(evaluate(node.a), common), b = convert(evaluate(node.b), common);
+        if (common == TYPE_STRING)
+            value.intValue = compare(node.op, a.stringValue, b.stringValue);
+        else if (common == TYPE_FLOAT)
+            value.intValue = compare(node.op, a.floatValue, b.floatValue);
+        else
+            value.intValue = compare(node.op, a.intValue, b.intValue);
+    }
+    else if (node.type == TYPE_STRING)
+        value.stringValue = evaluate(node.a).stringValue + evaluate(node.b).stringValue;
+    else
+    {
+        Value a = convert(evaluate(node.a), node.type), b = convert(evaluate(node.b), node.type);
+        uint64_t x = uint64_t(a.intValue), y = uint64_t(b.intValue);
+        switch (node.op)
+        {
+        case T_PLUS:
+            value.intValue = int64_t(x + y);
+            value.floatValue = a.floatValue + b.floatValue;
+            break;
+        case T_MINUS:
+            value.intValue = int64_t(x - y);
+            value.floatValue = a.floatValue - b.floatValue;
+            break;
+        case T_MUL:
+            value.intValue = int64_t(x * y);
+            value.floatValue = a.floatValue * b.floatValue;
+            break;
+        default: // T_DIV
+            value.floatValue = a.floatValue / b.floatValue;
+            if (node.type != TYPE_INT)
+                break;
+            if (b.intValue == 0)
+                fail("Runtime error: division by zero on line " + to_string(lines.line(base + node.offset)));
+            else
+                value.intValue = b.intValue == -1 ? int64_t(0 - x) : a.intValue / b.intValue;
+        }
+    }
+    depth--;
+    return value;
+}
+
+void TreeInterpreter::execute(uint32_t index)
+{
+    const Node &node = ast[index];
+    result.executed++;
+    if (statementDepth >= MAX_STATEMENT_DEPTH)
+    {
+        fail("Error: statements are nested too deeply to run");
+        return;
+    }
+    statementDepth++;
+    switch (node.kind)
+    {
+    case N_PROGRAM:
+        for (uint32_t i = 0; i < node.b && !stopped; i++)
+        {
+            base = ast.statementStarts(node)[i];
+            execute(ast.statements(node)[i]);
+        }
+        break;
+    case N_BLOCK:
+        for (uint32_t i = 0; i < node.b && !stopped; i++)
+            execute(ast.statements(node)[i]);
+        break;
+    case N_DECL:
+        slots[index] = zero(node.type); // What the initializer sees of the name
+        if (node.a != NO_NODE)
+        {
+            Value value = convert(evaluate(node.a), node.type);
+            slots[index] = move(value);
+        }
+        break;
+    case N_ASSIGN:
+        assert(node.b != NO_NODE);
+        slots[node.b] = convert(evaluate(node.a), node.type);
+        break;
+    case N_IF:
+    {
+        bool taken = truth(evaluate(node.a));
+        if (stopped)
+            break;
+        if (taken)
+            execute(node.b);
+        else if (node.c != NO_NODE)
+            execute(node.c);
+        break;
+    }
+    case N_WHILE:
+        while (!stopped && truth(evaluate(node.a)) && !stopped)
+            execute(node.b);
+        break;
+    case N_FOR:
+        execute(node.a);
+        while (!stopped && truth(evaluate(node.b)) && !stopped)
+        {
+            execute(node.body);
+            if (!stopped)
+                execute(node.c);
+        }
+        break;
+    case N_RETURN:
+    {
+        Value value = evaluate(node.a);
+        if (stopped)
+            break;
+        result.returned = true;
+        result.type = ast[node.a].type;
+        result.intValue = value.intValue;
+        result.floatValue = value.floatValue;
+        result.stringValue = move(value.stringValue);
+        stopped = true;
+        break;
+    }
+    default:
+        break; // N_ERROR cannot occur in a tree without errors
+    }
+    statementDepth--;
+}
+
+RunResult TreeInterpreter::run(uint32_t root)
+{
+    slots.assign(ast.size(), Value());
+    result = RunResult();
+    stopped = false;
+    execute(root);
+    return result;
+}
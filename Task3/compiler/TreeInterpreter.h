@@ -0,0 +1,90 @@
+#ifndef COMPILER_TREE_INTERPRETER_H
+#define COMPILER_TREE_INTERPRETER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Token.h"
+#include "Ast.h"
+#include "Bytecode.h"
+
+// Executes the AST directly, as the baseline the bytecode VM is measured
+// against. Every value is a tagged Value and every variable a slot indexed
+// by the node that declared it, and expressions are evaluated by recursion
+// on the tree. The results are exactly the VM's, down to wrapping int math.
+class TreeInterpreter
+{
+private:
+    static const size_t MAX_EXPRESSION_DEPTH = 10000; // As in BytecodeCompiler
+    static const size_t MAX_STATEMENT_DEPTH = 10000;
+
+    struct Value
+    {
+        TypeId type = TYPE_INT;
+        int64_t intValue = 0; // int and bool
+        double floatValue = 0;
+        std::string stringValue;
+    };
+
+    const Ast &ast;
+    const StringInterner &names;
+    LineIndex &lines; // Only looked in when a runtime error is reported
+    std::vector<Value> slots; // Indexed by declaration node
+    RunResult result;
+    bool stopped = false; // Set by return and by runtime errors
+    size_t depth = 0;
+    size_t statementDepth = 0;
+    uint32_t base = 0; // Start of the top-level statement being run, which node offsets count from
+
+    void fail(const std::string &message)
+    {
+        if (!stopped)
+            result.error = message;
+        stopped = true;
+    }
+
+    static Value zero(TypeId type)
+    {
+        Value value;
+        value.type = type;
+        return value;
+    }
+
+    static bool truth(const Value &value)
+    {
+        if (bankOf(value.type) == BANK_FLOAT)
+            return value.floatValue != 0;
+        return bankOf(value.type) == BANK_STRING ? !value.stringValue.empty() : value.intValue != 0;
+    }
+
+    // Converts between scalars the way assignment does
+    static Value convert(Value value, TypeId to);
+
+    template <typename T>
+    static bool compare(TokenType op, const T &a, const T &b)
+    {
+        switch (op)
+        {
+        case T_EQ: return a == b;
+        case T_NEQ: return a != b;
+        case T_LT: return a < b;
+        case T_LE: return a <= b;
+        case T_GT: return a > b;
+        default: return a >= b; // T_GE
+        }
+    }
+
+    Value evaluate(uint32_t index);
+
+    void execute(uint32_t index);
+
+public:
+    TreeInterpreter(const Ast &ast, const StringInterner &names, LineIndex &lines)
+        : ast(ast), names(names), lines(lines) {}
+
+    // Runs the N_PROGRAM node; executed counts the tree nodes visited
+    RunResult run(uint32_t root);
+};
+
+#endif
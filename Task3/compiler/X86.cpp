@@ -0,0 +1,952 @@
+#include "X86.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <string>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "TimeReport.h"
+
+using namespace std;
+
+// What the code X86Emitter generates returns, in rax and rdx as the SysV
+// ABI returns a struct of two integers
+enum NativeStatus : int64_t
+{
+    NATIVE_FINISHED,          // Ran off its end
+    NATIVE_RETURNED_INT,      // value is the int
+    NATIVE_RETURNED_BOOL,
+    NATIVE_RETURNED_FLOAT,    // value holds the bits of the double
+    NATIVE_DIVISION_BY_ZERO   // value is the line of the division
+};
+
+struct NativeResult
+{
+    int64_t status;
+    int64_t value;
+};
+
+void X86Emitter::allocateRegisters()
+{
+    vector<uint32_t> blockStart(ir.blocks.size(), 0), blockEnd(ir.blocks.size(), 0), at(ir.values.size(), 0);
+    uint32_t next = 0;
+    for (uint32_t block : ranges.order)
+    {
+        blockStart[block] = next;
+        for (uint32_t id : ir.blocks[block].instructions)
+        {
+            at[id] = next;
+            next += 2;
+        }
+        blockEnd[block] = next - 1;
+    }
+
+    unordered_map<uint32_t, Interval> intervals; // Group root -> interval
+    auto extend = [&](uint32_t value, uint32_t point) {
+        uint32_t group = ranges.group(value);
+        auto inserted = intervals.emplace(group, Interval{group, point, point});
+        inserted.first->second.start = min(inserted.first->second.start, point);
+        inserted.first->second.end = max(inserted.first->second.end, point);
+    };
+    for (uint32_t block : ranges.order)
+    {
+        for (uint32_t value : ranges.liveIn[block])
+            extend(value, blockStart[block]);
+        for (uint32_t value : ranges.liveOut[block])
+            extend(value, blockEnd[block]);
+        for (uint32_t id : ir.blocks[block].instructions)
+        {
+            const IrValue &value = ir.values[id];
+            if (value.type != TYPE_VOID)
+                extend(id, at[id]);
+            if (value.op == IR_PHI)
+            {
+                // Written by the copies at the end of each predecessor
+                for (uint32_t predecessor : ir.blocks[block].predecessors)
+                    extend(id, blockEnd[predecessor]);
+            }
+            Ir::forEachOperand(value, [&](uint32_t operand) {
+                if (!ir.isConstant(operand) && value.op != IR_PHI)
+                    extend(operand, at[id]);
+                uses[operand]++;
+            });
+        }
+    }
+
+    vector<Interval> sorted;
+    for (const auto &entry : intervals)
+        sorted.push_back(entry.second);
+    sort(sorted.begin(), sorted.end(), [](const Interval &a, const Interval &b) {
+        return a.start != b.start ? a.start < b.start : a.group < b.group;
+    });
+    locations.assign(ir.values.size(), NO_VALUE);
+    static const uint32_t gprs[] = {3, 12, 13, 14, 15, 1, 6, 7, 8, 9, 10}; // rbx, r12-r15 first
+    array<vector<uint32_t>, 2> free;
+    for (int i = int(size(gprs)) - 1; i >= 0; i--)
+        free[0].push_back(gprs[i]);
+    for (uint32_t xmm = 15; xmm >= 2; xmm--)
+        free[1].push_back(xmm);
+    array<vector<Interval>, 2> active;
+    for (const Interval &interval : sorted)
+    {
+        int bank = bankOf(ir.values[interval.group].type) == BANK_FLOAT;
+        for (array<vector<Interval>, 2>::size_type b = 0; b < 2; b++)
+        {
+            vector<Interval> &list = active[b];
+            for (size_t i = 0; i < list.size();)
+            {
+                if (list[i].end < interval.start)
+                {
+                    free[b].push_back(locations[list[i].group]);
+                    list.erase(list.begin() + i);
+                }
+                else
+                    i++;
+            }
+        }
+        if (!free[bank].empty())
+        {
+            locations[interval.group] = free[bank].back();
+            free[bank].pop_back();
+            active[bank].push_back(interval);
+            continue;
+        }
+        auto last = max_element(active[bank].begin(), active[bank].end(),
+                                [](const Interval &a, const Interval &b) { return a.end < b.end; });
+        if (last != active[bank].end() && last->end > interval.end)
+        {
+            locations[interval.group] = locations[last->group];
+            locations[last->group] = STACK_SLOT + stackSlots++;
+            *last = interval;
+        }
+        else
+            locations[interval.group] = STACK_SLOT + stackSlots++;
+    }
+}
+
+X86Operand X86Emitter::place(Bank bank, uint32_t location)
+{
+    if (location >= CONSTANT)
+    {
+        const IrValue &constant = ir.values[location - CONSTANT];
+        if (bank != BANK_FLOAT)
+            return immediate(constant.intValue);
+        auto inserted = pooled.emplace(location - CONSTANT, int64_t(pool.size()));
+        if (inserted.second)
+        {
+            uint64_t bits;
+            memcpy(&bits, &constant.floatValue, sizeof bits);
+            pool.push_back(bits);
+        }
+        return {X86_POOL, inserted.first->second};
+    }
+    if (location >= STACK_SLOT)
+        return {X86_FRAME, -48 - 8 * int64_t(location - STACK_SLOT)};
+    return reg(bank, location);
+}
+
+X86Operand X86Emitter::intSource(uint32_t value, uint32_t scratch)
+{
+    if (ir.isConstant(value) && !fitsImmediate(ir.values[value].intValue))
+    {
+        emit(X86_MOVABS, gpr(scratch), immediate(ir.values[value].intValue));
+        return gpr(scratch);
+    }
+    return operand(value);
+}
+
+void X86Emitter::move(Bank bank, uint32_t to, uint32_t from)
+{
+    if (to == from)
+        return;
+    if (bank == BANK_FLOAT)
+    {
+        if (isRegister(to) && isRegister(from))
+            emit(X86_MOVAPD, place(bank, to), place(bank, from));
+        else if (isRegister(to) || isRegister(from))
+            emit(X86_MOVSD, place(bank, to), place(bank, from));
+        else
+        {
+            emit(X86_MOVSD, xmm(XMM1), place(bank, from));
+            emit(X86_MOVSD, place(bank, to), xmm(XMM1));
+        }
+        return;
+    }
+    if (from >= CONSTANT && !fitsImmediate(ir.values[from - CONSTANT].intValue))
+    {
+        // Wider than an immediate: only movabs to a register can load it
+        uint32_t reg = isRegister(to) ? to : R11;
+        emit(X86_MOVABS, gpr(reg), place(bank, from));
+        from = reg;
+    }
+    else if (!isRegister(to) && !isRegister(from) && from < CONSTANT)
+    {
+        emit(X86_MOV, gpr(R11), place(bank, from));
+        from = R11;
+    }
+    if (to != from)
+        emit(X86_MOV, place(bank, to), place(bank, from));
+}
+
+bool X86Emitter::fusedWithBranch(uint32_t id, const vector<uint32_t> &instructions, size_t index) const
+{
+    const IrValue &value = ir.values[id];
+    const IrValue &last = ir.values[instructions.back()];
+    return value.op >= IR_EQ && value.op <= IR_LE && bankOf(ir.values[value.a].type) == BANK_INT &&
+           index + 2 == instructions.size() && last.op == IR_BRANCH && last.a == id && uses[id] == 1;
+}
+
+void X86Emitter::compareInts(const IrValue &comparison)
+{
+    X86Operand b = intSource(comparison.b, R11);
+    uint32_t a = location(comparison.a);
+    if (!isRegister(a))
+    {
+        load(RAX, comparison.a);
+        a = RAX;
+    }
+    emit(X86_CMP, gpr(a), b);
+}
+
+void X86Emitter::emitInstruction(uint32_t id)
+{
+    const IrValue &value = ir.values[id];
+    uint32_t dest = location(id);
+    switch (value.op)
+    {
+    case IR_COPY:
+        move(bankOf(value.type), dest, location(value.a));
+        break;
+    case IR_ADD:
+    case IR_SUB:
+    case IR_MUL:
+        if (value.type == TYPE_FLOAT)
+        {
+            static const X86Op ops[] = {X86_ADDSD, X86_SUBSD, X86_MULSD};
+            emitFloatArithmetic(id, ops[value.op - IR_ADD]);
+        }
+        else
+        {
+            static const X86Op ops[] = {X86_ADD, X86_SUB, X86_IMUL};
+            X86Operand b = intSource(value.b, R11);
+            uint32_t target = isRegister(dest) && dest != location(value.b) ? dest : RAX;
+            load(target, value.a);
+            emit(ops[value.op - IR_ADD], gpr(target), b);
+            store(id, target);
+        }
+        break;
+    case IR_DIV:
+        if (value.type == TYPE_FLOAT)
+            emitFloatArithmetic(id, X86_DIVSD);
+        else
+            emitDivision(id);
+        break;
+    case IR_NEG:
+        if (value.type == TYPE_FLOAT)
+        {
+            load(XMM0, value.a);
+            emit(X86_XORPD, xmm(XMM0), {X86_POOL, POOL_SIGN});
+            store(id, XMM0);
+        }
+        else
+        {
+            load(RAX, value.a);
+            emit(X86_NEG, gpr(RAX));
+            store(id, RAX);
+        }
+        break;
+    case IR_NOT:
+        load(RAX, value.a);
+        emit(X86_XOR, gpr(RAX), immediate(1));
+        store(id, RAX);
+        break;
+    case IR_CONVERT:
+        emitConversion(id);
+        break;
+    case IR_EQ:
+    case IR_NE:
+    case IR_LT:
+    case IR_LE:
+    {
+        static const X86Condition conditions[] = {CC_E, CC_NE, CC_L, CC_LE};
+        if (bankOf(ir.values[value.a].type) == BANK_INT)
+        {
+            compareInts(value);
+            storeFlag(id, conditions[value.op - IR_EQ]);
+            break;
+        }
+        // ucomisd leaves all of ZF, PF and CF set for NaN: < and <= are
+        // tested as b > a and b >= a, which are false then
+        if (value.op == IR_LT || value.op == IR_LE)
+        {
+            load(XMM0, value.b);
+            emit(X86_UCOMISD, xmm(XMM0), operand(value.a));
+            storeFlag(id, value.op == IR_LT ? CC_A : CC_AE);
+            break;
+        }
+        load(XMM0, value.a);
+        emit(X86_UCOMISD, xmm(XMM0), operand(value.b));
+        emit(X86_SETCC, gpr(RAX), {}, value.op == IR_EQ ? CC_E : CC_NE);
+        emit(X86_SETCC, gpr(RDX), {}, value.op == IR_EQ ? CC_NP : CC_P);
+        emit(value.op == IR_EQ ? X86_AND_BYTE : X86_OR_BYTE, gpr(RAX), gpr(RDX));
+        emit(X86_MOVZB, gpr(RAX), gpr(RAX));
+        store(id, RAX);
+        break;
+    }
+    default:
+        break; // Phis are made by edge copies
+    }
+}
+
+void X86Emitter::emitFloatArithmetic(uint32_t id, X86Op op)
+{
+    const IrValue &value = ir.values[id];
+    uint32_t dest = location(id);
+    uint32_t target = isRegister(dest) && dest != location(value.b) ? dest : XMM0;
+    load(target, value.a);
+    emit(op, xmm(target), operand(value.b));
+    store(id, target);
+}
+
+void X86Emitter::emitDivision(uint32_t id)
+{
+    const IrValue &value = ir.values[id];
+    load(RAX, value.a);
+    if (ir.isConstant(value.b) && ir.values[value.b].intValue == -1)
+        emit(X86_NEG, gpr(RAX));
+    else if (ir.isConstant(value.b) && ir.values[value.b].intValue != 0)
+    {
+        load(R11, value.b);
+        emit(X86_CQTO);
+        emit(X86_IDIV, gpr(R11));
+    }
+    else
+    {
+        uint32_t failed = newLabel(), divide = newLabel(), done = newLabel();
+        divisionChecks.push_back({failed, value.line});
+        load(R11, value.b);
+        emit(X86_TEST, gpr(R11), gpr(R11));
+        emit(X86_JCC, target(failed), {}, CC_E);
+        emit(X86_CMP, gpr(R11), immediate(-1));
+        emit(X86_JCC, target(divide), {}, CC_NE);
+        emit(X86_NEG, gpr(RAX));
+        emit(X86_JMP, target(done));
+        mark(divide);
+        emit(X86_CQTO);
+        emit(X86_IDIV, gpr(R11));
+        mark(done);
+    }
+    store(id, RAX);
+}
+
+void X86Emitter::emitConversion(uint32_t id)
+{
+    const IrValue &value = ir.values[id];
+    Bank from = bankOf(ir.values[value.a].type);
+    if (value.type == TYPE_FLOAT)
+    {
+        load(RAX, value.a);
+        emit(X86_PXOR, xmm(XMM0), xmm(XMM0));
+        emit(X86_CVTSI2SD, xmm(XMM0), gpr(RAX));
+        store(id, XMM0);
+    }
+    else if (value.type == TYPE_INT)
+    {
+        // Saturates like floatToInt: NaN is 0, and cvttsd2si already gives INT64_MIN below the range
+        uint32_t nan = newLabel(), done = newLabel();
+        load(XMM0, value.a);
+        emit(X86_CVTTSD2SI, gpr(RAX), xmm(XMM0));
+        emit(X86_UCOMISD, xmm(XMM0), {X86_POOL, POOL_TWO_63});
+        emit(X86_JCC, target(nan), {}, CC_P);
+        emit(X86_JCC, target(done), {}, CC_B);
+        emit(X86_MOVABS, gpr(RAX), immediate(INT64_MAX));
+        emit(X86_JMP, target(done));
+        mark(nan);
+        emit(X86_MOV, gpr(RAX), immediate(0));
+        mark(done);
+        store(id, RAX);
+    }
+    else if (from == BANK_FLOAT) // NaN is true, as it is not equal to 0
+    {
+        load(XMM0, value.a);
+        emit(X86_PXOR, xmm(XMM1), xmm(XMM1));
+        emit(X86_UCOMISD, xmm(XMM0), xmm(XMM1));
+        emit(X86_SETCC, gpr(RAX), {}, CC_NE);
+        emit(X86_SETCC, gpr(RDX), {}, CC_P);
+        emit(X86_OR_BYTE, gpr(RAX), gpr(RDX));
+        emit(X86_MOVZB, gpr(RAX), gpr(RAX));
+        store(id, RAX);
+    }
+    else
+    {
+        load(RAX, value.a);
+        emit(X86_TEST, gpr(RAX), gpr(RAX));
+        storeFlag(id, CC_NE);
+    }
+}
+
+vector<Copy> X86Emitter::edgeCopies(uint32_t from, uint32_t to)
+{
+    vector<Copy> copies;
+    const IrBlock &target = ir.blocks[to];
+    size_t k = find(target.predecessors.begin(), target.predecessors.end(), from) - target.predecessors.begin();
+    for (uint32_t id : target.instructions)
+    {
+        const IrValue &phi = ir.values[id];
+        if (phi.op != IR_PHI)
+            break;
+        if (location(phi.phi[k]) != location(id))
+            copies.push_back({bankOf(phi.type), location(id), location(phi.phi[k])});
+    }
+    return copies;
+}
+
+void X86Emitter::emitReturn(const IrValue &value)
+{
+    if (bankOf(value.b) == BANK_FLOAT)
+    {
+        load(XMM0, value.a);
+        emit(X86_MOVQ_FROM_XMM, gpr(RDX), xmm(XMM0));
+    }
+    else
+        load(RDX, value.a);
+    NativeStatus status = value.b == TYPE_BOOL            ? NATIVE_RETURNED_BOOL
+                          : bankOf(value.b) == BANK_FLOAT ? NATIVE_RETURNED_FLOAT
+                                                          : NATIVE_RETURNED_INT;
+    emit(X86_MOV, gpr(RAX), immediate(status));
+    emit(X86_JMP, target(exitLabel));
+}
+
+void X86Emitter::emitFunction()
+{
+    uint32_t blocks = uint32_t(ir.blocks.size());
+    labels = blocks; // Block b is label b
+    exitLabel = newLabel();
+    emit(X86_PUSH, gpr(RBP));
+    emit(X86_MOV, gpr(RBP), gpr(RSP));
+    for (uint32_t saved : CALLEE_SAVED)
+        emit(X86_PUSH, gpr(saved));
+    size_t frame = code.size();
+    emit(X86_SUB, gpr(RSP), immediate(0)); // Sized once the slots are known
+
+    // Edges from a branch that need copies go through trampolines after the code
+    struct Trampoline
+    {
+        uint32_t from, to, label;
+    };
+    vector<Trampoline> trampolines;
+    auto edge = [&](uint32_t from, uint32_t to) {
+        if (edgeCopies(from, to).empty())
+            return to;
+        trampolines.push_back({from, to, newLabel()});
+        return trampolines.back().label;
+    };
+    const vector<uint32_t> &order = ranges.order;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        uint32_t block = order[i], next = i + 1 < order.size() ? order[i + 1] : NO_BLOCK;
+        const vector<uint32_t> &instructions = ir.blocks[block].instructions;
+        mark(block);
+        bool fused = false;
+        for (size_t k = 0; k + 1 < instructions.size(); k++)
+        {
+            fused = fusedWithBranch(instructions[k], instructions, k);
+            if (fused)
+                compareInts(ir.values[instructions[k]]);
+            else
+                emitInstruction(instructions[k]);
+        }
+
+        const IrValue &last = ir.values[instructions.back()];
+        if (last.op == IR_JUMP)
+        {
+            emitCopies(edgeCopies(block, last.a));
+            if (last.a != next)
+                emit(X86_JMP, target(last.a));
+        }
+        else if (last.op == IR_BRANCH)
+        {
+            static const X86Condition taken[] = {CC_E, CC_NE, CC_L, CC_LE}, notTaken[] = {CC_NE, CC_E, CC_GE, CC_G};
+            X86Condition ifTrue = CC_NE, ifFalse = CC_E;
+            if (fused)
+            {
+                ifTrue = taken[ir.values[last.a].op - IR_EQ];
+                ifFalse = notTaken[ir.values[last.a].op - IR_EQ];
+            }
+            else
+            {
+                uint32_t condition = location(last.a);
+                if (!isRegister(condition))
+                {
+                    load(RAX, last.a);
+                    condition = RAX;
+                }
+                emit(X86_TEST, gpr(condition), gpr(condition));
+            }
+            uint32_t onTrue = edge(block, last.b), onFalse = edge(block, last.c);
+            if (onFalse == next)
+                emit(X86_JCC, target(onTrue), {}, ifTrue);
+            else
+            {
+                emit(X86_JCC, target(onFalse), {}, ifFalse);
+                if (onTrue != next)
+                    emit(X86_JMP, target(onTrue));
+            }
+        }
+        else if (last.op == IR_RETURN)
+            emitReturn(last);
+        else
+        {
+            emit(X86_MOV, gpr(RAX), immediate(NATIVE_FINISHED));
+            emit(X86_JMP, target(exitLabel));
+        }
+    }
+    for (const Trampoline &trampoline : trampolines)
+    {
+        mark(trampoline.label);
+        emitCopies(edgeCopies(trampoline.from, trampoline.to));
+        emit(X86_JMP, target(trampoline.to));
+    }
+    for (const pair<uint32_t, uint32_t> &check : divisionChecks)
+    {
+        mark(check.first);
+        emit(X86_MOV, gpr(RAX), immediate(NATIVE_DIVISION_BY_ZERO));
+        emit(X86_MOV, gpr(RDX), immediate(check.second));
+        emit(X86_JMP, target(exitLabel));
+    }
+
+    // With rbp and the registers pushed after it, the frame keeps rsp
+    // 16-byte aligned, as the ABI wants it around calls
+    code[frame].from = immediate((stackSlots * 8 + 15) / 16 * 16 + 8);
+    mark(exitLabel);
+    emit(X86_LEA, gpr(RSP), {X86_FRAME, -8 * int64_t(size(CALLEE_SAVED))});
+    for (size_t i = size(CALLEE_SAVED); i-- > 0;)
+        emit(X86_POP, gpr(CALLEE_SAVED[i]));
+    emit(X86_POP, gpr(RBP));
+    emit(X86_RET);
+}
+
+bool X86Emitter::compile()
+{
+    for (uint32_t block : ranges.order)
+    {
+        for (uint32_t id : ir.blocks[block].instructions)
+        {
+            bool strings = bankOf(ir.values[id].type) == BANK_STRING;
+            Ir::forEachOperand(ir.values[id], [&](uint32_t operand) {
+                strings |= bankOf(ir.values[operand].type) == BANK_STRING;
+            });
+            if (strings)
+                return false;
+        }
+    }
+    uses.assign(ir.values.size(), 0);
+    allocateRegisters();
+    emitFunction();
+    return true;
+}
+
+void X86Emitter::writeAssembly(ostream &out) const
+{
+    static const char *const gprs[] = {"%rax", "%rcx", "%rdx", "%rbx", "%rsp", "%rbp", "%rsi", "%rdi",
+                                       "%r8",  "%r9",  "%r10", "%r11", "%r12", "%r13", "%r14", "%r15"};
+    static const char *const bytes[] = {"%al", "%cl", "%dl", "%bl"}, *const dwords[] = {"%eax", "%ecx", "%edx", "%ebx"};
+    static const char *const conditions[] = {"o", "no", "b", "ae", "e", "ne", "be", "a",
+                                             "s", "ns", "p", "np", "l", "ge", "le", "g"};
+    static const char *const mnemonics[] = {
+        "",      "movq",   "movabsq", "leaq",   "addq",  "subq",  "imulq",     "xorq",       "cmpq",
+        "testq", "negq",   "cqto",    "idivq",  "set",   "movzbl", "andb",     "orb",        "movsd",
+        "movapd", "addsd", "subsd",   "mulsd",  "divsd", "xorpd", "pxor",      "ucomisd",    "cvtsi2sdq",
+        "cvttsd2siq", "movq", "jmp",  "j",      "pushq", "popq",  "ret"};
+    auto print = [&](const X86Operand &operand, const char *const *registers) {
+        switch (operand.kind)
+        {
+        case X86_GPR:
+            out << registers[operand.value];
+            break;
+        case X86_XMM:
+            out << "%xmm" << operand.value;
+            break;
+        case X86_FRAME:
+            out << operand.value << "(%rbp)";
+            break;
+        case X86_POOL:
+            out << ".Lpool+" << operand.value * 8 << "(%rip)";
+            break;
+        case X86_IMMEDIATE:
+            out << "$" << operand.value;
+            break;
+        case X86_TARGET:
+            out << ".L" << operand.value;
+            break;
+        default:
+            break;
+        }
+    };
+
+    out << "\t.text\n.Lprogram:\n";
+    for (const X86Instruction &instruction : code)
+    {
+        if (instruction.op == X86_LABEL)
+        {
+            out << ".L" << instruction.to.value << ":\n";
+            continue;
+        }
+        out << "\t" << mnemonics[instruction.op];
+        if (instruction.op == X86_SETCC || instruction.op == X86_JCC)
+            out << conditions[instruction.condition];
+        bool byte = instruction.op == X86_SETCC || instruction.op == X86_AND_BYTE || instruction.op == X86_OR_BYTE;
+        if (instruction.from.kind != X86_NONE)
+        {
+            out << " ";
+            print(instruction.from, byte || instruction.op == X86_MOVZB ? bytes : gprs);
+            out << ",";
+        }
+        if (instruction.to.kind != X86_NONE)
+        {
+            out << " ";
+            print(instruction.to, byte ? bytes : instruction.op == X86_MOVZB ? dwords : gprs);
+        }
+        out << "\n";
+    }
+
+    // main keeps rbx for the value, which also aligns rsp for the calls
+    out << "\n\t.globl main\n\t.type main, @function\nmain:\n\tpushq %rbx\n\tcall .Lprogram\n\tmovq %rdx, %rbx\n"
+        << "\tcmpq $" << NATIVE_RETURNED_INT << ", %rax\n\tje .Lint\n"
+        << "\tcmpq $" << NATIVE_RETURNED_BOOL << ", %rax\n\tje .Lbool\n"
+        << "\tcmpq $" << NATIVE_RETURNED_FLOAT << ", %rax\n\tje .Lfloat\n"
+        << "\tcmpq $" << NATIVE_DIVISION_BY_ZERO << ", %rax\n\tje .Ldivision\n"
+        << "\tleaq .Lfinished(%rip), %rdi\n\txorl %eax, %eax\n\tcall printf@PLT\n\txorl %eax, %eax\n"
+        << "\tpopq %rbx\n\tret\n"
+        << ".Lint:\n\tmovq %rbx, %rsi\n\tleaq .Lreturned_int(%rip), %rdi\n\txorl %eax, %eax\n\tcall printf@PLT\n"
+        << "\tmovl %ebx, %eax\n\tpopq %rbx\n\tret\n"
+        << ".Lbool:\n\tleaq .Lfalse(%rip), %rsi\n\tleaq .Ltrue(%rip), %rax\n\ttestq %rbx, %rbx\n"
+        << "\tcmovneq %rax, %rsi\n\tleaq .Lreturned_text(%rip), %rdi\n\txorl %eax, %eax\n\tcall printf@PLT\n"
+        << "\tmovl %ebx, %eax\n\tpopq %rbx\n\tret\n"
+        << ".Lfloat:\n\tmovq %rbx, %xmm0\n\tleaq .Lreturned_float(%rip), %rdi\n\tmovl $1, %eax\n"
+        << "\tcall printf@PLT\n\txorl %eax, %eax\n\tpopq %rbx\n\tret\n"
+        << ".Ldivision:\n\tmovl %ebx, %esi\n\tleaq .Ldivision_message(%rip), %rdi\n\txorl %eax, %eax\n"
+        << "\tcall printf@PLT\n\tmovl $1, %eax\n\tpopq %rbx\n\tret\n\t.size main, .-main\n\n"
+        << "\t.section .rodata\n\t.align 16\n.Lpool:\n";
+    for (uint64_t entry : pool)
+        out << "\t.quad " << entry << "\n";
+    out << ".Lreturned_int:\n\t.string \"Program returned %ld\\n\"\n"
+        << ".Lreturned_float:\n\t.string \"Program returned %g\\n\"\n"
+        << ".Lreturned_text:\n\t.string \"Program returned %s\\n\"\n"
+        << ".Ltrue:\n\t.string \"true\"\n.Lfalse:\n\t.string \"false\"\n"
+        << ".Lfinished:\n\t.string \"Program finished without returning a value\\n\"\n"
+        << ".Ldivision_message:\n\t.string \"Runtime error: division by zero on line %d\\n\"\n"
+        << "\t.section .note.GNU-stack,\"\",@progbits\n";
+}
+
+// Encodes X86Instructions into machine code, followed by the constant pool
+// at the next 16-byte boundary. Jumps and pool references are rel32, filled
+// in once every label has its offset.
+class X86Encoder
+{
+private:
+    vector<uint8_t> bytes;
+    vector<size_t> labelOffsets;
+    vector<pair<size_t, uint32_t>> jumps;      // (offset of rel32, label)
+    vector<pair<size_t, int64_t>> poolUses;    // (offset of rel32, pool entry)
+
+    void byte(uint8_t value) { bytes.push_back(value); }
+
+    void word(uint32_t value)
+    {
+        for (int shift = 0; shift < 32; shift += 8)
+            byte(uint8_t(value >> shift));
+    }
+
+    static bool isRegister(const X86Operand &operand) { return operand.kind == X86_GPR || operand.kind == X86_XMM; }
+
+    // A REX prefix when it is needed: 64-bit operand size, or registers r8-r15
+    void rex(bool wide, uint32_t reg, const X86Operand &rm)
+    {
+        uint8_t prefix = uint8_t(0x40 | wide << 3 | (reg >> 3) << 2 | (isRegister(rm) ? rm.value >> 3 : 0));
+        if (prefix != 0x40)
+            byte(prefix);
+    }
+
+    void modRm(uint32_t reg, const X86Operand &rm)
+    {
+        reg &= 7;
+        if (isRegister(rm))
+            byte(uint8_t(0xC0 | reg << 3 | (rm.value & 7)));
+        else if (rm.kind == X86_FRAME && rm.value >= -128 && rm.value <= 127)
+        {
+            byte(uint8_t(0x45 | reg << 3)); // [rbp + disp8]
+            byte(uint8_t(rm.value));
+        }
+        else if (rm.kind == X86_FRAME)
+        {
+            byte(uint8_t(0x85 | reg << 3)); // [rbp + disp32]
+            word(uint32_t(rm.value));
+        }
+        else
+        {
+            byte(uint8_t(0x05 | reg << 3)); // [rip + disp32]
+            poolUses.push_back({bytes.size(), rm.value});
+            word(0);
+        }
+    }
+
+    // prefix (0x66, 0xF2 or none), REX, opcode bytes, ModRM and displacement
+    void instruction(uint8_t prefix, bool wide, initializer_list<uint8_t> opcode, uint32_t reg, const X86Operand &rm)
+    {
+        if (prefix)
+            byte(prefix);
+        rex(wide, reg, rm);
+        for (uint8_t part : opcode)
+            byte(part);
+        modRm(reg, rm);
+    }
+
+    void jump(initializer_list<uint8_t> opcode, uint32_t label)
+    {
+        for (uint8_t part : opcode)
+            byte(part);
+        jumps.push_back({bytes.size(), label});
+        word(0);
+    }
+
+    // add, or, and, sub, xor and cmp: the /digit of the immediate form, and
+    // the opcode of the reg <- r/m form
+    void arithmetic(uint32_t digit, uint8_t opcode, const X86Instruction &in)
+    {
+        if (in.from.kind == X86_IMMEDIATE && in.from.value >= -128 && in.from.value <= 127)
+        {
+            instruction(0, true, {0x83}, digit, in.to);
+            byte(uint8_t(in.from.value));
+        }
+        else if (in.from.kind == X86_IMMEDIATE)
+        {
+            instruction(0, true, {0x81}, digit, in.to);
+            word(uint32_t(in.from.value));
+        }
+        else
+            instruction(0, true, {opcode}, uint32_t(in.to.value), in.from);
+    }
+
+    void encode(const X86Instruction &in)
+    {
+        uint32_t to = uint32_t(in.to.value), from = uint32_t(in.from.value);
+        switch (in.op)
+        {
+        case X86_LABEL:
+            labelOffsets[to] = bytes.size();
+            break;
+        case X86_MOV:
+            if (in.from.kind == X86_IMMEDIATE)
+            {
+                instruction(0, true, {0xC7}, 0, in.to);
+                word(uint32_t(in.from.value));
+            }
+            else if (in.from.kind == X86_GPR)
+                instruction(0, true, {0x89}, from, in.to);
+            else
+                instruction(0, true, {0x8B}, to, in.from);
+            break;
+        case X86_MOVABS:
+            byte(uint8_t(0x48 | to >> 3));
+            byte(uint8_t(0xB8 | (to & 7)));
+            for (int shift = 0; shift < 64; shift += 8)
+                byte(uint8_t(uint64_t(in.from.value) >> shift));
+            break;
+        case X86_LEA:
+            instruction(0, true, {0x8D}, to, in.from);
+            break;
+        case X86_ADD:
+            arithmetic(0, 0x03, in);
+            break;
+        case X86_SUB:
+            arithmetic(5, 0x2B, in);
+            break;
+        case X86_XOR:
+            arithmetic(6, 0x33, in);
+            break;
+        case X86_CMP:
+            arithmetic(7, 0x3B, in);
+            break;
+        case X86_IMUL:
+            if (in.from.kind == X86_IMMEDIATE)
+            {
+                instruction(0, true, {0x69}, to, in.to);
+                word(uint32_t(in.from.value));
+            }
+            else
+                instruction(0, true, {0x0F, 0xAF}, to, in.from);
+            break;
+        case X86_TEST:
+            instruction(0, true, {0x85}, from, in.to);
+            break;
+        case X86_NEG:
+            instruction(0, true, {0xF7}, 3, in.to);
+            break;
+        case X86_CQTO:
+            byte(0x48);
+            byte(0x99);
+            break;
+        case X86_IDIV:
+            instruction(0, true, {0xF7}, 7, in.to);
+            break;
+        case X86_SETCC:
+            instruction(0, false, {0x0F, uint8_t(0x90 | in.condition)}, 0, in.to);
+            break;
+        case X86_MOVZB:
+            instruction(0, false, {0x0F, 0xB6}, to, in.from);
+            break;
+        case X86_AND_BYTE:
+            instruction(0, false, {0x20}, from, in.to);
+            break;
+        case X86_OR_BYTE:
+            instruction(0, false, {0x08}, from, in.to);
+            break;
+        case X86_MOVSD:
+            if (in.to.kind == X86_XMM)
+                instruction(0xF2, false, {0x0F, 0x10}, to, in.from);
+            else
+                instruction(0xF2, false, {0x0F, 0x11}, from, in.to);
+            break;
+        case X86_MOVAPD:
+            instruction(0x66, false, {0x0F, 0x28}, to, in.from);
+            break;
+        case X86_ADDSD:
+            instruction(0xF2, false, {0x0F, 0x58}, to, in.from);
+            break;
+        case X86_MULSD:
+            instruction(0xF2, false, {0x0F, 0x59}, to, in.from);
+            break;
+        case X86_SUBSD:
+            instruction(0xF2, false, {0x0F, 0x5C}, to, in.from);
+            break;
+        case X86_DIVSD:
+            instruction(0xF2, false, {0x0F, 0x5E}, to, in.from);
+            break;
+        case X86_XORPD:
+            instruction(0x66, false, {0x0F, 0x57}, to, in.from);
+            break;
+        case X86_PXOR:
+            instruction(0x66, false, {0x0F, 0xEF}, to, in.from);
+            break;
+        case X86_UCOMISD:
+            instruction(0x66, false, {0x0F, 0x2E}, to, in.from);
+            break;
+        case X86_CVTSI2SD:
+            instruction(0xF2, true, {0x0F, 0x2A}, to, in.from);
+            break;
+        case X86_CVTTSD2SI:
+            instruction(0xF2, true, {0x0F, 0x2C}, to, in.from);
+            break;
+        case X86_MOVQ_FROM_XMM:
+            instruction(0x66, true, {0x0F, 0x7E}, from, in.to);
+            break;
+        case X86_JMP:
+            jump({0xE9}, to);
+            break;
+        case X86_JCC:
+            jump({0x0F, uint8_t(0x80 | in.condition)}, to);
+            break;
+        case X86_PUSH:
+        case X86_POP:
+            if (to >= 8)
+                byte(0x41);
+            byte(uint8_t((in.op == X86_PUSH ? 0x50 : 0x58) | (to & 7)));
+            break;
+        case X86_RET:
+            byte(0xC3);
+            break;
+        }
+    }
+
+public:
+    // The code of emitter, its entry point at offset 0
+    vector<uint8_t> encode(const X86Emitter &emitter)
+    {
+        bytes.clear();
+        jumps.clear();
+        poolUses.clear();
+        labelOffsets.assign(emitter.labelCount(), 0);
+        for (const X86Instruction &instruction : emitter.instructions())
+            encode(instruction);
+        while (bytes.size() % 16 != 0)
+            byte(0xCC); // int3
+        size_t pool = bytes.size();
+        for (uint64_t entry : emitter.constants())
+        {
+            for (int shift = 0; shift < 64; shift += 8)
+                byte(uint8_t(entry >> shift));
+        }
+
+        // Displacements count from the end of the instruction, which both end in theirs
+        auto patch = [&](size_t at, size_t destination) {
+            uint32_t displacement = uint32_t(int64_t(destination) - int64_t(at + 4));
+            memcpy(&bytes[at], &displacement, sizeof displacement);
+        };
+        for (const pair<size_t, uint32_t> &use : jumps)
+            patch(use.first, labelOffsets[use.second]);
+        for (const pair<size_t, int64_t> &use : poolUses)
+            patch(use.first, pool + 8 * size_t(use.second));
+        return bytes;
+    }
+};
+
+JitCode::~JitCode()
+{
+#if defined(__x86_64__) && !defined(_WIN32)
+    if (memory)
+        munmap(memory, length);
+#endif
+}
+
+bool JitCode::compile(const Ir &ir)
+{
+    TIME_SCOPE("jit compile");
+#if defined(__x86_64__) && !defined(_WIN32)
+    X86Emitter emitter(ir);
+    if (!emitter.compile())
+        return false;
+    vector<uint8_t> code = X86Encoder().encode(emitter);
+    length = code.size();
+    void *pages = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pages == MAP_FAILED)
+        return false;
+    memory = pages;
+    memcpy(memory, code.data(), length);
+    return mprotect(memory, length, PROT_READ | PROT_EXEC) == 0;
+#else
+    (void)ir;
+    return false;
+#endif
+}
+
+RunResult JitCode::run() const
+{
+    NativeResult native = reinterpret_cast<NativeResult (*)()>(memory)();
+    RunResult result;
+    switch (native.status)
+    {
+    case NATIVE_DIVISION_BY_ZERO:
+        result.error = "Runtime error: division by zero on line " + to_string(native.value);
+        break;
+    case NATIVE_RETURNED_FLOAT:
+        result.returned = true;
+        result.type = TYPE_FLOAT;
+        memcpy(&result.floatValue, &native.value, sizeof result.floatValue);
+        break;
+    case NATIVE_RETURNED_INT:
+    case NATIVE_RETURNED_BOOL:
+        result.returned = true;
+        result.type = native.status == NATIVE_RETURNED_BOOL ? TYPE_BOOL : TYPE_INT;
+        result.intValue = native.value;
+        break;
+    default:
+        break;
+    }
+    return result;
+}
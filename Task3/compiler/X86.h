@@ -0,0 +1,254 @@
+#ifndef COMPILER_X86_H
+#define COMPILER_X86_H
+
+#include <cstdint>
+#include <ostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Bytecode.h"
+#include "Ir.h"
+#include "IrLowering.h"
+
+// x86-64 machine instructions, as X86Emitter selects them. Each one is
+// either printed as GNU assembly or encoded into machine code for the JIT.
+enum X86Op : uint8_t
+{
+    X86_LABEL, // Marks the position of label to
+    X86_MOV,
+    X86_MOVABS, // A 64-bit immediate into a register
+    X86_LEA,
+    X86_ADD,
+    X86_SUB,
+    X86_IMUL,
+    X86_XOR,
+    X86_CMP,
+    X86_TEST,
+    X86_NEG,
+    X86_CQTO,
+    X86_IDIV,
+    X86_SETCC,   // Sets the low byte of to
+    X86_MOVZB,   // Widens the low byte of from into to
+    X86_AND_BYTE,
+    X86_OR_BYTE,
+    X86_MOVSD,
+    X86_MOVAPD,
+    X86_ADDSD,
+    X86_SUBSD,
+    X86_MULSD,
+    X86_DIVSD,
+    X86_XORPD,
+    X86_PXOR,
+    X86_UCOMISD,
+    X86_CVTSI2SD,
+    X86_CVTTSD2SI,
+    X86_MOVQ_FROM_XMM, // The bits of a float into a general-purpose register
+    X86_JMP,
+    X86_JCC,
+    X86_PUSH,
+    X86_POP,
+    X86_RET
+};
+
+// Condition codes, numbered as the hardware encodes them in jcc and setcc
+enum X86Condition : uint8_t
+{
+    CC_B = 0x2,
+    CC_AE = 0x3,
+    CC_E = 0x4,
+    CC_NE = 0x5,
+    CC_A = 0x7,
+    CC_P = 0xA,
+    CC_NP = 0xB,
+    CC_L = 0xC,
+    CC_GE = 0xD,
+    CC_LE = 0xE,
+    CC_G = 0xF
+};
+
+enum X86OperandKind : uint8_t
+{
+    X86_NONE,
+    X86_GPR,       // value is the register number
+    X86_XMM,
+    X86_FRAME,     // The stack at rbp + value
+    X86_POOL,      // Entry value of the constant pool, addressed relative to rip
+    X86_IMMEDIATE,
+    X86_TARGET     // Label value
+};
+
+struct X86Operand
+{
+    X86OperandKind kind = X86_NONE;
+    int64_t value = 0;
+};
+
+// Operands are in AT&T order: the instruction reads from and writes to
+struct X86Instruction
+{
+    X86Op op;
+    X86Condition condition; // Of X86_SETCC and X86_JCC
+    X86Operand to, from;
+};
+
+// Compiles an Ir to x86-64 instructions: one function that takes no
+// arguments and returns a NativeResult. Each group of LiveRanges is one
+// live interval, from its first to its last live point in the block
+// layout; the intervals get registers by linear scan (Poletto and Sarkar):
+// in order of start each takes a free register of its class, and when none
+// is left, the interval that ends last goes to a stack slot instead. rax,
+// rdx, r11, xmm0 and xmm1 stay free as scratch. Strings are not supported.
+class X86Emitter
+{
+private:
+    // A location is a register number (the hardware encoding), a stack slot
+    // at STACK_SLOT + n, or for a phi operand a constant at CONSTANT + value
+    static constexpr uint32_t STACK_SLOT = 16;
+    static constexpr uint32_t CONSTANT = 0x80000000;
+    static constexpr uint32_t RAX = 0, RDX = 2, RSP = 4, RBP = 5, R11 = 11, XMM0 = 0, XMM1 = 1;
+    static constexpr uint32_t CALLEE_SAVED[] = {3, 12, 13, 14, 15}; // rbx and r12-r15, pushed after rbp
+
+    // The constant pool starts with the sign mask xorpd negates with, which
+    // must be 16-byte aligned, and 2^63, the first double too big for an int
+    static constexpr int64_t POOL_SIGN = 0, POOL_TWO_63 = 2;
+
+    struct Interval
+    {
+        uint32_t group;
+        uint32_t start, end; // Positions in the layout, two per instruction
+    };
+
+    const Ir &ir;
+    LiveRanges ranges;
+    std::vector<uint32_t> locations; // Of each group root
+    uint32_t stackSlots = 0;
+    std::vector<uint32_t> uses;      // How many instructions read each value
+    std::vector<X86Instruction> code;
+    std::vector<uint64_t> pool = {0x8000000000000000ull, 0, 0x43e0000000000000ull};
+    std::unordered_map<uint32_t, int64_t> pooled; // Constant value -> its entry in pool
+    uint32_t labels = 0;
+    uint32_t exitLabel = 0;
+    std::vector<std::pair<uint32_t, uint32_t>> divisionChecks; // (label, line) of each division by zero exit
+
+    static X86Operand gpr(uint32_t reg) { return {X86_GPR, reg}; }
+    static X86Operand xmm(uint32_t reg) { return {X86_XMM, reg}; }
+    static X86Operand immediate(int64_t value) { return {X86_IMMEDIATE, value}; }
+    static X86Operand target(uint32_t label) { return {X86_TARGET, label}; }
+    static X86Operand reg(Bank bank, uint32_t reg) { return bank == BANK_FLOAT ? xmm(reg) : gpr(reg); }
+
+    void emit(X86Op op, X86Operand to = {}, X86Operand from = {}, X86Condition condition = CC_E)
+    {
+        code.push_back({op, condition, to, from});
+    }
+
+    void mark(uint32_t label) { emit(X86_LABEL, target(label)); }
+
+    uint32_t newLabel() { return labels++; }
+
+    // Positions of the layout: two per instruction, blocks back to back
+    void allocateRegisters();
+
+    uint32_t location(uint32_t value) { return ir.isConstant(value) ? CONSTANT + value : locations[ranges.group(value)]; }
+
+    X86Operand place(Bank bank, uint32_t location);
+
+    X86Operand operand(uint32_t value) { return place(bankOf(ir.values[value].type), location(value)); }
+
+    static bool fitsImmediate(int64_t value) { return value >= INT32_MIN && value <= INT32_MAX; }
+
+    bool isRegister(uint32_t location) const { return location < STACK_SLOT; }
+
+    // An operand an instruction can read an int from: a register, a slot or
+    // a 32-bit immediate; a wider constant is first loaded into scratch
+    X86Operand intSource(uint32_t value, uint32_t scratch);
+
+    // Emits one move between two locations of a bank
+    void move(Bank bank, uint32_t to, uint32_t from);
+
+    void load(uint32_t reg, uint32_t value) { move(bankOf(ir.values[value].type), reg, location(value)); }
+    void store(uint32_t value, uint32_t reg) { move(bankOf(ir.values[value].type), location(value), reg); }
+
+    // Sets al from the flags, then widens it into the value's location
+    void storeFlag(uint32_t id, X86Condition condition)
+    {
+        emit(X86_SETCC, gpr(RAX), {}, condition);
+        emit(X86_MOVZB, gpr(RAX), gpr(RAX));
+        store(id, RAX);
+    }
+
+    // An int comparison that only a branch right after it reads is not
+    // materialized: the branch tests the flags it leaves instead
+    bool fusedWithBranch(uint32_t id, const std::vector<uint32_t> &instructions, size_t index) const;
+
+    // Compares the operands of an int comparison, leaving the flags of a - b
+    void compareInts(const IrValue &comparison);
+
+    void emitInstruction(uint32_t id);
+
+    void emitFloatArithmetic(uint32_t id, X86Op op);
+
+    // idiv faults on a zero divisor and on INT64_MIN / -1, which must wrap
+    // instead, so both are tested unless the divisor is a known constant
+    void emitDivision(uint32_t id);
+
+    void emitConversion(uint32_t id);
+
+    // The moves that give the phis of to the values they receive from from
+    std::vector<Copy> edgeCopies(uint32_t from, uint32_t to);
+
+    void emitCopies(const std::vector<Copy> &copies)
+    {
+        sequenceCopies(
+            copies, [](Bank bank) { return bank == BANK_FLOAT ? XMM0 : RAX; },
+            [&](Bank bank, uint32_t to, uint32_t from) { move(bank, to, from); });
+    }
+
+    // Puts the NativeResult in rax and rdx and leaves
+    void emitReturn(const IrValue &value);
+
+    // The body of the function, then the paths out of it, between a
+    // prologue and an epilogue that keep the callee-saved registers
+    void emitFunction();
+
+public:
+    explicit X86Emitter(const Ir &ir) : ir(ir), ranges(ir) {}
+
+    // Selects the instructions of the function; false if the program uses strings
+    bool compile();
+
+    const std::vector<X86Instruction> &instructions() const { return code; }
+    const std::vector<uint64_t> &constants() const { return pool; }
+    uint32_t labelCount() const { return labels; }
+
+    // Writes the function as GNU assembly, with a main that calls it, prints
+    // how the program ended the way --run does, and exits with the returned
+    // int or bool (mod 256), 1 after a runtime error, or 0. The file links
+    // with the system C compiler.
+    void writeAssembly(std::ostream &out) const;
+};
+
+// Runs an Ir as machine code in this process: the code X86Emitter selects
+// is encoded, copied into fresh pages, and only then made executable (and
+// no longer writable). compile fails for what the code generator does not
+// support and wherever there is no x86-64 JIT, and the caller interprets
+// the program instead.
+class JitCode
+{
+private:
+    void *memory = nullptr;
+    size_t length = 0;
+
+public:
+    JitCode() = default;
+    JitCode(const JitCode &) = delete;
+    JitCode &operator=(const JitCode &) = delete;
+
+    ~JitCode();
+
+    bool compile(const Ir &ir);
+
+    RunResult run() const;
+};
+
+#endif
@@ -1,13 +1,28 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <cstdint>
 #include <cctype>
 #include <unordered_map>
+#include <memory>
+#include <cstring>
 #include <iomanip>
+#include <map>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+
+#include "../common/SourceFile.h"
+#include "../common/CharScan.h"
+#include "../common/StringInterner.h"
+#include "../common/Keywords.h"
+#include "../common/TypeTable.h"
+#include "../common/SymbolTable.h"
 
 using namespace std;
 
-enum TokenType {
+enum TokenType : uint8_t {
     T_INT,
     T_FLOAT,
     T_DOUBLE,
@@ -30,23 +45,40 @@ enum TokenType {
     T_RBRACE,
     T_SEMICOLON,
     T_GT,
-    T_EOF
+    T_EOF,
+    T_STRING_LITERAL // "text"; the string keyword is T_STRING. Added last, so the other kinds keep their numbers
 };
 
+// A token does not own its text: value is a view into the source buffer
+// held by the caller of Lexer, so producing a token never allocates.
 struct Token {
+    string_view value;
+    uint32_t line;
+    uint32_t symbol; // Interned name of a T_ID token, NO_SYMBOL for every other kind
     TokenType type;
-    string value;
-    int line;
+
+    Token() : line(0), symbol(NO_SYMBOL), type(T_EOF) {}
+    Token(TokenType type, string_view value, uint32_t line, uint32_t symbol = NO_SYMBOL)
+        : value(value), line(line), symbol(symbol), type(type) {}
 };
 
+// Token type of each shared keyword; the ones this language does not reserve are identifiers
+static constexpr TokenType keywordTokens[NOT_KEYWORD + 1] = {
+    T_INT, T_FLOAT, T_DOUBLE, T_STRING, T_BOOL, T_CHAR, T_IF, T_ELSE, T_RETURN, T_ID /* while */, T_ID /* for */, T_ID};
+
+// Returns the keyword's token type, or T_ID for any other (non-empty) word
+inline TokenType lookupKeyword(string_view word) { return keywordTokens[findKeyword(word)]; }
+
 class Parser {
 private:
     vector<Token> tokens;
     size_t pos;
-    unordered_map<string, string> symbolTable;
+    const StringInterner &names;
+    TypeTable &types;
+    SymbolTable symbolTable;
 
 public:
-    Parser(const vector<Token>& tokens) {
+    Parser(const vector<Token>& tokens, const StringInterner& names, TypeTable& types) : names(names), types(types) {
         this->tokens = tokens;
         this->pos = 0;
     }
@@ -79,37 +111,36 @@ public:
 
     void parseBlock() {
         expect(T_LBRACE);
+        symbolTable.enterScope(); // Names declared in the block go away at its '}'
         while (tokens[pos].type != T_RBRACE && tokens[pos].type != T_EOF)
             parseStatement();
+        symbolTable.exitScope();
         expect(T_RBRACE);
     }
 
-    void addToSymbolTable(string varName, string type) {
-        symbolTable[varName] = type;
+    bool addToSymbolTable(uint32_t varName, TypeId type, uint32_t line) {
+        return symbolTable.declare(varName, type, line);
     }
 
     void parseDeclaration() {
-        string dataType = tokens[pos].value; // Get the data type
+        TypeId dataType = TypeTable::primitive(tokens[pos].value); // Get the data type
         pos++; // Move to the next token
 
         if (tokens[pos].type == T_ID) {
-            string varName = tokens[pos].value;
+            uint32_t varName = tokens[pos].symbol;
             pos++; // Move to the next token
 
-            // Check for duplicate declaration
-            if (symbolTable.find(varName) != symbolTable.end()) {
-                cout << "Error: Variable '" << varName
+            // Add the variable to the symbol table, rejecting a duplicate in the same scope
+            if (!addToSymbolTable(varName, dataType, tokens[pos - 1].line)) {
+                cout << "Error: Variable '" << names.name(varName)
                      << "' is already declared on line " << tokens[pos].line << endl;
                 exit(1);
             }
 
-            // Add the variable to the symbol table
-            addToSymbolTable(varName, dataType);
-
             // Check if there's an assignment during declaration
             if (tokens[pos].type == T_ASSIGN) {
                 pos++;
-                parseExpression(); // Handle assignment
+                checkAssignable(varName, dataType, parseExpression()); // Handle assignment
             }
 
             expect(T_SEMICOLON); // Ensure semicolon is present
@@ -124,9 +155,9 @@ public:
     cout << "-----------------------------------\n";
     cout << "| Variable Name |    Data Type   |\n";
     cout << "-----------------------------------\n";
-    for (const auto& entry : symbolTable) {
-        cout << "| " << setw(14) << left << entry.first 
-             << "| " << setw(15) << left << entry.second << "|\n";
+    for (const Symbol& symbol : symbolTable.live()) {
+        cout << "| " << setw(14) << left << names.name(symbol.name) 
+             << "| " << setw(15) << left << types.name(symbol.type) << "|\n";
     }
     cout << "-----------------------------------\n";
 }
@@ -140,23 +171,43 @@ public:
     // }
 
     void parseAssignment() {
-        string varName = tokens[pos].value;
+        uint32_t varName = tokens[pos].symbol;
         pos++;
 
-        if (symbolTable.find(varName) == symbolTable.end()) {
-            cout << "Error: Variable '" << varName
+        const Symbol *symbol = symbolTable.lookup(varName);
+        if (!symbol) {
+            cout << "Error: Variable '" << names.name(varName)
                  << "' is not declared on line " << tokens[pos].line << endl;
             exit(1);
         }
 
-        string expectedType = symbolTable[varName];
+        TypeId expectedType = symbol->type;
         expect(T_ASSIGN);
-        parseExpression(); // Parse the right-hand side of the assignment
+        TypeId valueType = parseExpression(); // Parse the right-hand side of the assignment
 
-        // Type-check if necessary (this is a placeholder; further development needed)
+        checkAssignable(varName, expectedType, valueType);
         expect(T_SEMICOLON);
     }
 
+    void checkAssignable(uint32_t varName, TypeId target, TypeId value) {
+        if (!TypeTable::assignable(target, value)) {
+            cout << "Type error: cannot assign " << types.name(value) << " to " << types.name(target)
+                 << " variable '" << names.name(varName) << "' on line " << tokens[pos].line << endl;
+            exit(1);
+        }
+    }
+
+    // Types "left op right", where op is the operator token at opPos
+    TypeId checkBinary(TypeId left, TypeId right, size_t opPos) {
+        TypeId result = TypeTable::binaryResult(tokens[opPos].value, left, right);
+        if (result == TYPE_ERROR && left != TYPE_ERROR && right != TYPE_ERROR) {
+            cout << "Type error: operator " << tokens[opPos].value << " cannot be applied to "
+                 << types.name(left) << " and " << types.name(right) << " on line " << tokens[opPos].line << endl;
+            exit(1);
+        }
+        return result;
+    }
+
     void parseIfStatement() {
         expect(T_IF);
         expect(T_LPAREN);
@@ -175,34 +226,51 @@ public:
         expect(T_SEMICOLON);
     }
 
-    void parseExpression() {
+    TypeId parseExpression() {
         // For now, only parsing the first term
-        parseTerm();
+        TypeId type = parseTerm();
         while (tokens[pos].type == T_PLUS || tokens[pos].type == T_MINUS) {
-            pos++;
-            parseTerm();
+            size_t op = pos++;
+            type = checkBinary(type, parseTerm(), op);
         }
         if (tokens[pos].type == T_GT) {
-            pos++;
-            parseExpression();
+            size_t op = pos++;
+            type = checkBinary(type, parseExpression(), op);
         }
+        return type;
     }
 
-    void parseTerm() {
-        parseFactor();
+    TypeId parseTerm() {
+        TypeId type = parseFactor();
         while (tokens[pos].type == T_MUL || tokens[pos].type == T_DIV) {
-            pos++;
-            parseFactor();
+            size_t op = pos++;
+            type = checkBinary(type, parseFactor(), op);
         }
+        return type;
     }
 
-    void parseFactor() {
-        if (tokens[pos].type == T_NUM || tokens[pos].type == T_ID) {
+    TypeId parseFactor() {
+        if (tokens[pos].type == T_NUM) {
+            bool isFloat = tokens[pos].value.find('.') != string_view::npos;
+            pos++;
+            return isFloat ? TYPE_FLOAT : TYPE_INT;
+        } else if (tokens[pos].type == T_ID) {
+            const Symbol *symbol = symbolTable.lookup(tokens[pos].symbol);
+            if (!symbol) {
+                cout << "Error: Variable '" << tokens[pos].value
+                     << "' is not declared on line " << tokens[pos].line << endl;
+                exit(1);
+            }
+            pos++;
+            return symbol->type;
+        } else if (tokens[pos].type == T_STRING_LITERAL) {
             pos++;
+            return TYPE_STRING;
         } else if (tokens[pos].type == T_LPAREN) {
             expect(T_LPAREN);
-            parseExpression();
+            TypeId type = parseExpression();
             expect(T_RPAREN);
+            return type;
         } else {
             cout << "Syntax error: unexpected token " << tokens[pos].value
                  << " on line " << tokens[pos].line << endl;
@@ -214,7 +282,7 @@ public:
         if (tokens[pos].type == type) {
             pos++;
         } else {
-            cout << "Syntax error: expected " << type << " but found "
+            cout << "Syntax error: expected " << int(type) << " but found "
                  << tokens[pos].value << " on line " << tokens[pos].line << endl;
             exit(1);
         }
@@ -223,13 +291,138 @@ public:
 
 class Lexer {
 private:
-    string src;
+    string_view src; // Not a copy: the caller keeps the source alive while tokens are in use
+    size_t pos;
+    StringInterner &names;
+
+public:
+    Lexer(string_view src, StringInterner &names) : src(src), pos(0), names(names) {}
+
+    string_view consumeNumber() {
+        const char *begin = src.data(), *end = begin + src.size();
+        size_t start = pos;
+
+        // Digits, then at most one decimal point followed by more digits
+        pos = scanDigits(begin + pos, end) - begin;
+        if (pos < src.size() && src[pos] == '.')
+            pos = scanDigits(begin + pos + 1, end) - begin;
+
+        return src.substr(start, pos - start);
+    }
+
+    string_view consumeWord() {
+        const char *begin = src.data();
+        size_t start = pos;
+        pos = scanIdentifier(begin + pos, begin + src.size()) - begin;
+        return src.substr(start, pos - start);
+    }
+
+    string_view consumeString() {
+        size_t start = ++pos; // Skip the opening quote (")
+        while (pos < src.size() && src[pos] != '"') {
+            if (src[pos] == '\\' && pos + 1 < src.size()) { // Handle escape sequences
+                pos += 2; // Skip the escape character and the next character
+                continue;
+            }
+            pos++; // Consume characters inside quotes
+        }
+
+        if (pos >= src.size() || src[pos] != '"') {
+            cout << "Syntax error: Unterminated string literal" << endl;
+            exit(1);
+        }
+
+        pos++; // Skip the closing quote (")
+        return src.substr(start, pos - start - 1); // Return the string without quotes
+    }
+
+    vector<Token> tokenize() {
+        vector<Token> tokens;
+        uint32_t line = 1; // Start with line number 1
+        const char *begin = src.data(), *end = begin + src.size();
+
+        while (pos < src.size()) {
+            char current = src[pos];
+            uint8_t cls = classOf(current);
+            if (cls & CC_SPACE) {
+                pos = skipSpaces<true>(begin + pos, end, line) - begin; // Counts the newlines it skips
+                continue;
+            }
+            if (cls & CC_DIGIT) {
+                tokens.push_back(Token{T_NUM, consumeNumber(), line});
+                continue;
+            } else if (cls & CC_IDENT_START) {
+                string_view word = consumeWord();
+                TokenType type = lookupKeyword(word); // T_ID when not a keyword
+                uint32_t symbol = type == T_ID ? names.intern(word) : NO_SYMBOL;
+
+                tokens.push_back(Token{type, word, line, symbol});
+                continue;
+            }
+
+            // Handle string literals
+            if (current == '"') {
+                tokens.push_back(Token{T_STRING_LITERAL, consumeString(), line});
+                continue;
+            }
+
+            // Handle other single-character tokens
+            switch (current) {
+            case '=':
+                tokens.push_back(Token{T_ASSIGN, "=", line});
+                break;
+            case '+':
+                tokens.push_back(Token{T_PLUS, "+", line});
+                break;
+            case '-':
+                tokens.push_back(Token{T_MINUS, "-", line});
+                break;
+            case '*':
+                tokens.push_back(Token{T_MUL, "*", line});
+                break;
+            case '/':
+                tokens.push_back(Token{T_DIV, "/", line});
+                break;
+            case '(':
+                tokens.push_back(Token{T_LPAREN, "(", line});
+                break;
+            case ')':
+                tokens.push_back(Token{T_RPAREN, ")", line});
+                break;
+            case '{':
+                tokens.push_back(Token{T_LBRACE, "{", line});
+                break;
+            case '}':
+                tokens.push_back(Token{T_RBRACE, "}", line});
+                break;
+            case ';':
+                tokens.push_back(Token{T_SEMICOLON, ";", line});
+                break;
+            case '>':
+                tokens.push_back(Token{T_GT, ">", line});
+                break;
+            default:
+                cout << "Unexpected character: " << current << " on line " << line << endl;
+                exit(1);
+            }
+            pos++;
+        }
+        tokens.push_back(Token{T_EOF, "", line}); // Add EOF token
+        return tokens;
+    }
+};
+
+// The byte-at-a-time lexer this file used before the table-driven core.
+// Kept only as the baseline and cross-check for --bench-lexer.
+class ReferenceLexer {
+private:
+    string_view src; // Not a copy: the caller keeps the source alive while tokens are in use
     size_t pos;
 
 public:
-    Lexer(const string &src) : src(src), pos(0) {}
+    ReferenceLexer(string_view src) : src(src), pos(0) {}
 
-    string consumeNumber() {
+    string_view consumeNumber() {
         size_t start = pos;
         bool hasDecimal = false;
 
@@ -245,7 +438,7 @@ public:
         return src.substr(start, pos - start);
     }
 
-    string consumeWord() {
+    string_view consumeWord() {
         size_t start = pos;
 
         while (pos < src.size() && (isalnum(src[pos]) || src[pos] == '_'))
@@ -254,7 +447,7 @@ public:
         return src.substr(start, pos - start);
     }
 
-    string consumeString() {
+    string_view consumeString() {
         size_t start = ++pos; // Skip the opening quote (")
         while (pos < src.size() && src[pos] != '"') {
             if (src[pos] == '\\' && pos + 1 < src.size()) { // Handle escape sequences
@@ -275,7 +468,7 @@ public:
 
     vector<Token> tokenize() {
         vector<Token> tokens;
-        int line = 1; // Start with line number 1
+        uint32_t line = 1; // Start with line number 1
 
         while (pos < src.size()) {
             char current = src[pos];
@@ -289,7 +482,7 @@ public:
                 tokens.push_back(Token{T_NUM, consumeNumber(), line});
                 continue;
             } else if (isalpha(current) || current == '_') {
-                string word = consumeWord();
+                string_view word = consumeWord();
                 TokenType type;
 
                 if (word == "int") type = T_INT;
@@ -309,7 +502,7 @@ public:
 
             // Handle string literals
             if (current == '"') {
-                tokens.push_back(Token{T_STRING, consumeString(), line});
+                tokens.push_back(Token{T_STRING_LITERAL, consumeString(), line});
                 continue;
             }
 
@@ -359,8 +552,66 @@ public:
     }
 };
 
-void displaySymbolTable(const vector<Token>& tokens) {
-    unordered_map<string, TokenType> symbolTable;
+// Lexer throughput benchmark: --bench-lexer [megabytes]
+// Lexes the same generated source with ReferenceLexer and Lexer, checks that
+// both produce the same tokens and prints the best of several runs in MB/s.
+static string makeLexerBenchmarkSource(size_t bytes) {
+    string text;
+    text.reserve(bytes + 256);
+    for (size_t i = 0; text.size() < bytes; i++) {
+        string n = to_string(i);
+        text += "int counter_" + n + ";\n";
+        text += "float average_" + n + " = 3.25;\n";
+        text += "string label_" + n + " = \"item number " + n + "\";\n";
+        text += "if (counter_" + n + " > 100) {\n";
+        text += "        counter_" + n + " = (counter_" + n + " + 12345) * 2 / average_" + n + ";\n";
+        text += "} else {\n        return 0;\n}\n\n";
+    }
+    return text;
+}
+
+template <typename Tokenize>
+static double bestLexingSeconds(Tokenize tokenize, vector<Token> &tokens, int runs) {
+    double best = 1e30;
+    for (int i = 0; i < runs; i++) {
+        auto start = chrono::steady_clock::now();
+        tokens = tokenize();
+        chrono::duration<double> elapsed = chrono::steady_clock::now() - start;
+        best = min(best, elapsed.count());
+    }
+    return best;
+}
+
+static int benchmarkLexer(size_t megabytes) {
+    string text = makeLexerBenchmarkSource(megabytes << 20);
+    vector<Token> reference, table;
+    double referenceTime = bestLexingSeconds([&] { return ReferenceLexer(text).tokenize(); }, reference, 5);
+    double tableTime = bestLexingSeconds([&] {
+        StringInterner names;
+        return Lexer(text, names).tokenize();
+    }, table, 5);
+
+    bool same = reference.size() == table.size();
+    for (size_t i = 0; same && i < table.size(); i++)
+        same = reference[i].type == table[i].type && reference[i].value == table[i].value &&
+               reference[i].line == table[i].line;
+    if (!same) {
+        cout << "Error: table-driven lexer disagrees with the reference lexer" << endl;
+        return 1;
+    }
+
+    double mb = text.size() / double(1 << 20);
+    const char *core = charScanCore();
+    cout << fixed << setprecision(1);
+    cout << "Input: " << mb << " MB, " << table.size() << " tokens\n";
+    cout << "Reference lexer:          " << setw(8) << mb / referenceTime << " MB/s\n";
+    cout << "Table-driven lexer (" << core << "): " << setw(8) << mb / tableTime << " MB/s\n";
+    cout << "Speedup: " << setprecision(2) << referenceTime / tableTime << "x" << endl;
+    return 0;
+}
+
+void displaySymbolTable(const vector<Token>& tokens, const StringInterner& names, const TypeTable& types) {
+    unordered_map<uint32_t, TypeId> symbolTable; // Keyed by interned name
 
     for (size_t i = 0; i < tokens.size(); i++) {
         const auto& token = tokens[i];
@@ -371,8 +622,8 @@ void displaySymbolTable(const vector<Token>& tokens) {
             if (token.value == "int" || token.value == "float" || token.value == "string" || token.value == "bool") {
                 // Make sure there is a next token and it is an identifier
                 if (i + 1 < tokens.size() && tokens[i + 1].type == T_ID) {
-                    string varName = tokens[i + 1].value; // Get the variable name
-                    symbolTable[varName] = token.type; // Store the variable name and its type
+                    uint32_t varName = tokens[i + 1].symbol; // Get the variable name
+                    symbolTable[varName] = TypeTable::primitive(token.value); // Store the variable name and its type
                     i++; // Skip the next token as it's the variable name
                 }
             }
@@ -383,15 +634,32 @@ void displaySymbolTable(const vector<Token>& tokens) {
     cout << "\nSymbol Table:\n";
     cout << "Variable Name\tData Type\n";
     for (const auto& entry : symbolTable) {
-        cout << entry.first << "\t\t" << (entry.second == T_INT ? "int" :
-                                              entry.second == T_FLOAT ? "float" :
-                                              entry.second == T_STRING ? "string" :
-                                              entry.second == T_BOOL ? "bool" : "unknown") << endl;
+        cout << names.name(entry.first) << "\t\t" << types.name(entry.second) << endl;
     }
 }
 
 
-int main() {
+int main(int argc, char *argv[]) {
+    if (argc > 1 && string(argv[1]) == "--bench-lexer") {
+        size_t megabytes = 64;
+        if (argc > 2) {
+            const char *last = argv[2] + strlen(argv[2]);
+            from_chars_result parsed = from_chars(argv[2], last, megabytes);
+            if (parsed.ec != errc() || parsed.ptr != last || megabytes == 0 || megabytes > 4096) {
+                cerr << "Error: --bench-lexer takes a size in MB from 1 to 4096, not " << argv[2] << endl;
+                return 1;
+            }
+        }
+        return benchmarkLexer(megabytes);
+    }
+
+    // A file named on the command line ("-" for stdin) replaces the built-in sample
+    SourceFile file;
+    if (argc > 1 && !file.open(argv[1])) {
+        cerr << "Error: Could not open file " << argv[1] << endl;
+        return 1;
+    }
+
     string sourceCode = R"(
         int a;
         a = 5;
@@ -408,16 +676,18 @@ int main() {
         }
     )";
 
-    Lexer lexer(sourceCode);
+    StringInterner names;
+    TypeTable types;
+    Lexer lexer(argc > 1 ? file.text() : string_view(sourceCode), names);
     vector<Token> tokens = lexer.tokenize();
 
     cout << "Tokens:\n";
     for (const auto &token : tokens) {
-        cout << "Type: " << token.type << ", Value: " << token.value << ", Line: " << token.line << endl;
+        cout << "Type: " << int(token.type) << ", Value: " << token.value << ", Line: " << token.line << endl;
     }
 
     // Display the symbol table
-    displaySymbolTable(tokens);
+    displaySymbolTable(tokens, names, types);
 
     return 0;
 }
@@ -448,10 +718,12 @@ int main() {
 //     //     }
 //     // )";
 
-//     Lexer lexer(sourceCode);
+//     StringInterner names;
+//     TypeTable types;
+//     Lexer lexer(sourceCode, names);
 //     vector<Token> tokens = lexer.tokenize();
 
-//     Parser parser(tokens);
+//     Parser parser(tokens, names, types);
 //     parser.parseProgram();
 
 //     return 0;
@@ -0,0 +1,26 @@
+#!/bin/sh
+# Regression programs for the compiler. Each NAME.src is compiled and run with
+# every engine; what the compiler prints must match NAME.expected. Then the
+# compiler's own consistency checks run on generated programs.
+#   Task3/tests/run_tests.sh ./compiler
+compiler=$(cd "$(dirname "${1:-./compiler}")" && pwd)/$(basename "${1:-./compiler}")
+cd "$(dirname "$0")" || exit 1
+failed=0
+for source in *.src; do
+    for engine in tree vm jit; do
+        if ! "$compiler" --run --engine $engine "$source" 2>&1 | diff -u "${source%.src}.expected" -; then
+            echo "FAILED: $source with --engine $engine"
+            failed=1
+        fi
+    done
+done
+for check in "--check-edits 200" "--check-lex-threads 20" "--check-tokens 100"; do
+    if ! "$compiler" $check > check.out; then
+        cat check.out
+        echo "FAILED: $check"
+        failed=1
+    fi
+    rm -f check.out
+done
+[ $failed = 0 ] && echo "All tests passed."
+exit $failed
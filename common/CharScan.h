@@ -0,0 +1,221 @@
+#ifndef COMMON_CHAR_SCAN_H
+#define COMMON_CHAR_SCAN_H
+
+#include <array>
+#include <cstdint>
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Character classes for the lexers. One table lookup per byte replaces the
+// isspace/isdigit/isalpha calls; bytes outside ASCII have no class.
+enum CharClass : uint8_t
+{
+    CC_SPACE = 1,
+    CC_DIGIT = 2,
+    CC_IDENT_START = 4, // Letters and '_'
+    CC_IDENT = 8        // Letters, digits and '_'
+};
+
+constexpr std::array<uint8_t, 256> makeCharClassTable()
+{
+    std::array<uint8_t, 256> table{};
+    for (int c = 0; c < 256; c++)
+    {
+        bool letter = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        bool digit = c >= '0' && c <= '9';
+        uint8_t cls = 0;
+        if (c == ' ' || (c >= '\t' && c <= '\r'))
+            cls |= CC_SPACE;
+        if (digit)
+            cls |= CC_DIGIT | CC_IDENT;
+        if (letter)
+            cls |= CC_IDENT_START | CC_IDENT;
+        table[c] = cls;
+    }
+    return table;
+}
+
+static constexpr std::array<uint8_t, 256> charClass = makeCharClassTable();
+
+inline uint8_t classOf(char c) { return charClass[static_cast<unsigned char>(c)]; }
+
+// Run scanners. Each returns the end of the run of bytes of one class that
+// starts at p. On x86-64 they test 16 (SSE2) or 32 (AVX2, when the CPU has
+// it) bytes per step and finish the last partial block with the table.
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CHAR_SCAN_SIMD 1
+
+// Unsigned "x <= limit" per byte; SSE2 has no unsigned compare, but min does.
+inline __m128i bytesAtMost(__m128i x, char limit)
+{
+    return _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(limit)), x);
+}
+
+inline uint32_t spaceMask(__m128i v)
+{
+    __m128i blank = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    __m128i control = bytesAtMost(_mm_sub_epi8(v, _mm_set1_epi8('\t')), '\r' - '\t');
+    return _mm_movemask_epi8(_mm_or_si128(blank, control));
+}
+
+inline uint32_t digitMask(__m128i v)
+{
+    return _mm_movemask_epi8(bytesAtMost(_mm_sub_epi8(v, _mm_set1_epi8('0')), 9));
+}
+
+inline uint32_t identMask(__m128i v)
+{
+    __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20)); // 'A'..'Z' -> 'a'..'z'
+    __m128i letter = bytesAtMost(_mm_sub_epi8(folded, _mm_set1_epi8('a')), 'z' - 'a');
+    __m128i digit = bytesAtMost(_mm_sub_epi8(v, _mm_set1_epi8('0')), 9);
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(letter, digit), underscore));
+}
+
+inline uint32_t newlineMask(__m128i v)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+}
+
+__attribute__((target("avx2"))) inline __m256i bytesAtMost(__m256i x, char limit)
+{
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(limit)), x);
+}
+
+__attribute__((target("avx2"))) inline uint32_t spaceMask(__m256i v)
+{
+    __m256i blank = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    __m256i control = bytesAtMost(_mm256_sub_epi8(v, _mm256_set1_epi8('\t')), '\r' - '\t');
+    return _mm256_movemask_epi8(_mm256_or_si256(blank, control));
+}
+
+__attribute__((target("avx2"))) inline uint32_t digitMask(__m256i v)
+{
+    return _mm256_movemask_epi8(bytesAtMost(_mm256_sub_epi8(v, _mm256_set1_epi8('0')), 9));
+}
+
+__attribute__((target("avx2"))) inline uint32_t identMask(__m256i v)
+{
+    __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    __m256i letter = bytesAtMost(_mm256_sub_epi8(folded, _mm256_set1_epi8('a')), 'z' - 'a');
+    __m256i digit = bytesAtMost(_mm256_sub_epi8(v, _mm256_set1_epi8('0')), 9);
+    __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(letter, digit), underscore));
+}
+
+__attribute__((target("avx2"))) inline uint32_t newlineMask(__m256i v)
+{
+    return _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+}
+
+inline const bool cpuHasAvx2 = [] {
+    __builtin_cpu_init(); // May run before the constructor that would otherwise do it
+    return __builtin_cpu_supports("avx2") != 0;
+}();
+
+// Skips whole blocks whose bytes all have the class tested by Mask and stops
+// at the first byte that doesn't, or at the last block that doesn't fit.
+// When countLines is set the newlines skipped are added to lines.
+template <uint32_t (*Mask)(__m128i), bool countLines>
+const char *scanRunSse2(const char *p, const char *end, uint32_t &lines)
+{
+    while (end - p >= 16)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        uint32_t stop = ~Mask(v) & 0xFFFFu;
+        uint32_t taken = stop ? (1u << __builtin_ctz(stop)) - 1 : 0xFFFFu;
+        if (countLines)
+            lines += __builtin_popcount(newlineMask(v) & taken);
+        if (stop)
+            return p + __builtin_ctz(stop);
+        p += 16;
+    }
+    return p;
+}
+
+template <uint32_t (*Mask)(__m256i), bool countLines>
+__attribute__((target("avx2"))) const char *scanRunAvx2(const char *p, const char *end, uint32_t &lines)
+{
+    while (end - p >= 32)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        uint32_t stop = ~Mask(v);
+        uint32_t taken = stop ? (1u << __builtin_ctz(stop)) - 1 : 0xFFFFFFFFu;
+        if (countLines)
+            lines += __builtin_popcount(newlineMask(v) & taken);
+        if (stop)
+            return p + __builtin_ctz(stop);
+        p += 32;
+    }
+    return p;
+}
+#endif
+
+template <uint8_t cls, bool countLines>
+const char *scanRunScalar(const char *p, const char *end, uint32_t &lines)
+{
+    while (p < end && (classOf(*p) & cls))
+    {
+        if (countLines && *p == '\n')
+            lines++;
+        p++;
+    }
+    return p;
+}
+
+// Skips whitespace from p, adding the newlines skipped to lines when
+// countLines is set
+template <bool countLines>
+const char *skipSpaces(const char *p, const char *end, uint32_t &lines)
+{
+    // Most gaps between tokens are a single blank; don't pay for a vector load there
+    if (p + 1 < end && !(classOf(p[1]) & CC_SPACE))
+        return scanRunScalar<CC_SPACE, countLines>(p, p + 1, lines);
+#ifdef CHAR_SCAN_SIMD
+    if (cpuHasAvx2)
+        p = scanRunAvx2<spaceMask, countLines>(p, end, lines);
+    p = scanRunSse2<spaceMask, countLines>(p, end, lines);
+#endif
+    return scanRunScalar<CC_SPACE, countLines>(p, end, lines);
+}
+
+inline const char *skipSpaces(const char *p, const char *end)
+{
+    uint32_t unused = 0;
+    return skipSpaces<false>(p, end, unused);
+}
+
+inline const char *scanIdentifier(const char *p, const char *end)
+{
+    uint32_t unused = 0;
+#ifdef CHAR_SCAN_SIMD
+    if (cpuHasAvx2)
+        p = scanRunAvx2<identMask, false>(p, end, unused);
+    p = scanRunSse2<identMask, false>(p, end, unused);
+#endif
+    return scanRunScalar<CC_IDENT, false>(p, end, unused);
+}
+
+inline const char *scanDigits(const char *p, const char *end)
+{
+    uint32_t unused = 0;
+#ifdef CHAR_SCAN_SIMD
+    if (cpuHasAvx2)
+        p = scanRunAvx2<digitMask, false>(p, end, unused);
+    p = scanRunSse2<digitMask, false>(p, end, unused);
+#endif
+    return scanRunScalar<CC_DIGIT, false>(p, end, unused);
+}
+
+// Scanner the run scanners use on this machine, for benchmark reports
+inline const char *charScanCore()
+{
+#ifdef CHAR_SCAN_SIMD
+    return cpuHasAvx2 ? "AVX2" : "SSE2";
+#else
+    return "scalar";
+#endif
+}
+
+#endif
@@ -0,0 +1,101 @@
+#ifndef COMMON_KEYWORDS_H
+#define COMMON_KEYWORDS_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+// Every reserved word of the language family. Each program maps these to its
+// own token kinds and leaves out the ones it does not reserve, so for example
+// "while" is a keyword to the compiler but an identifier to Task2's parser.
+enum Keyword : uint8_t
+{
+    KEYWORD_INT,
+    KEYWORD_FLOAT,
+    KEYWORD_DOUBLE,
+    KEYWORD_STRING,
+    KEYWORD_BOOL,
+    KEYWORD_CHAR,
+    KEYWORD_IF,
+    KEYWORD_ELSE,
+    KEYWORD_RETURN,
+    KEYWORD_WHILE,
+    KEYWORD_FOR,
+    NOT_KEYWORD // Also the number of keywords
+};
+
+struct KeywordSpelling
+{
+    std::string_view text;
+    Keyword keyword;
+};
+
+static constexpr KeywordSpelling keywordSpellings[] = {
+    {"int", KEYWORD_INT},
+    {"float", KEYWORD_FLOAT},
+    {"double", KEYWORD_DOUBLE},
+    {"string", KEYWORD_STRING},
+    {"bool", KEYWORD_BOOL},
+    {"char", KEYWORD_CHAR},
+    {"if", KEYWORD_IF},
+    {"else", KEYWORD_ELSE},
+    {"return", KEYWORD_RETURN},
+    {"while", KEYWORD_WHILE},
+    {"for", KEYWORD_FOR},
+    {"Agar", KEYWORD_IF}, // Localized keyword (see README)
+};
+
+// Keyword recognition with a perfect hash built at compile time. A word is
+// hashed from its length and its first and last characters; findKeywordSeed
+// searches for a multiplier under which no two keywords share a slot, so a
+// lookup costs one hash, one table load and one string compare.
+constexpr uint32_t KEYWORD_SLOT_BITS = 5;
+
+constexpr uint32_t keywordHash(std::string_view word, uint32_t seed)
+{
+    uint32_t key = uint32_t(uint8_t(word[0])) << 16 | uint32_t(uint8_t(word[word.size() - 1])) << 8 |
+                   uint32_t(word.size() & 0xFF);
+    return (key * seed) >> (32 - KEYWORD_SLOT_BITS);
+}
+
+constexpr uint32_t findKeywordSeed()
+{
+    for (uint32_t seed = 0x9E3779B1u; seed != 0x9E3779B1u + 2 * 4096; seed += 2)
+    {
+        bool used[1 << KEYWORD_SLOT_BITS] = {};
+        bool collides = false;
+        for (const KeywordSpelling &spelling : keywordSpellings)
+        {
+            uint32_t slot = keywordHash(spelling.text, seed);
+            collides = collides || used[slot];
+            used[slot] = true;
+        }
+        if (!collides)
+            return seed;
+    }
+    return 0;
+}
+
+constexpr uint32_t keywordSeed = findKeywordSeed();
+static_assert(keywordSeed != 0, "No collision-free keyword hash; widen KEYWORD_SLOT_BITS");
+
+constexpr std::array<int8_t, 1 << KEYWORD_SLOT_BITS> makeKeywordSlots()
+{
+    std::array<int8_t, 1 << KEYWORD_SLOT_BITS> slots{};
+    for (auto &slot : slots)
+        slot = -1;
+    for (size_t i = 0; i < sizeof(keywordSpellings) / sizeof(keywordSpellings[0]); i++)
+        slots[keywordHash(keywordSpellings[i].text, keywordSeed)] = int8_t(i);
+    return slots;
+}
+
+static constexpr std::array<int8_t, 1 << KEYWORD_SLOT_BITS> keywordSlots = makeKeywordSlots();
+
+// Returns the keyword spelled by word, or NOT_KEYWORD for any other (non-empty) word
+inline Keyword findKeyword(std::string_view word)
+{
+    int8_t index = keywordSlots[keywordHash(word, keywordSeed)];
+    return index >= 0 && keywordSpellings[index].text == word ? keywordSpellings[index].keyword : NOT_KEYWORD;
+}
+
+#endif
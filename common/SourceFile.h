@@ -0,0 +1,86 @@
+#ifndef COMMON_SOURCE_FILE_H
+#define COMMON_SOURCE_FILE_H
+
+#include <cstdio>
+#include <string>
+#include <string_view>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Owns the bytes of one source file. Regular files are mapped read-only so
+// the rest of the compiler works directly on the page cache without copying;
+// pipes and stdin ("-"), which cannot be mapped, are read in large chunks
+// into a single buffer instead of line by line.
+class SourceFile
+{
+private:
+    const char *data;
+    size_t size;
+    bool mapped;
+    std::string buffer; // Only used by the streaming fallback
+
+    void readChunks(FILE *file)
+    {
+        const size_t chunkSize = 1 << 16;
+        size_t used = 0;
+        while (true)
+        {
+            buffer.resize(used + chunkSize);
+            size_t got = fread(&buffer[used], 1, chunkSize, file);
+            used += got;
+            if (got < chunkSize)
+                break;
+        }
+        buffer.resize(used);
+        data = buffer.data();
+        size = buffer.size();
+    }
+
+public:
+    SourceFile() : data(nullptr), size(0), mapped(false) {}
+    SourceFile(const SourceFile &) = delete;
+    SourceFile &operator=(const SourceFile &) = delete;
+
+    ~SourceFile()
+    {
+#ifndef _WIN32
+        if (mapped)
+            munmap(const_cast<char *>(data), size);
+#endif
+    }
+
+    bool open(const std::string &filename)
+    {
+        FILE *file = filename == "-" ? stdin : fopen(filename.c_str(), "rb");
+        if (!file)
+            return false;
+
+#ifndef _WIN32
+        struct stat info;
+        if (fstat(fileno(file), &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+        {
+            void *view = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+            if (view != MAP_FAILED)
+            {
+                madvise(view, info.st_size, MADV_SEQUENTIAL); // The lexer reads front to back once
+                data = static_cast<const char *>(view);
+                size = info.st_size;
+                mapped = true;
+            }
+        }
+#endif
+        if (!mapped)
+            readChunks(file);
+
+        bool ok = !ferror(file);
+        if (file != stdin)
+            fclose(file);
+        return ok;
+    }
+
+    std::string_view text() const { return std::string_view(data, size); }
+};
+
+#endif
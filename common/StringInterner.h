@@ -0,0 +1,152 @@
+#ifndef COMMON_STRING_INTERNER_H
+#define COMMON_STRING_INTERNER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// The compiler counts interned names and probe collisions for its time
+// report; it defines TIME_COUNT before including this header
+#ifndef TIME_COUNT
+#define TIME_COUNT(counter, n)
+#endif
+
+// Identifier interning. Each distinct name is copied once into an arena of
+// large blocks and given a dense 32-bit id (0, 1, 2, ... in first-seen
+// order). The lexer interns every identifier, so the parser and symbol table
+// compare and index names by id instead of hashing the same text again.
+const uint32_t NO_SYMBOL = 0xFFFFFFFF;
+
+class StringInterner
+{
+private:
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char *block = nullptr;             // Block new names are appended to
+    size_t blockUsed = BLOCK_SIZE;     // Forces a block on the first insert
+    std::vector<std::string_view> names; // Indexed by id; views into blocks
+    std::vector<uint32_t> hashes;      // Indexed by id; kept so growing never rehashes text
+    std::vector<uint32_t> slots;       // Open addressing over ids; NO_SYMBOL marks a free slot
+
+    // Mixes eight bytes per step; names are short, so this is usually one or two steps
+    static uint32_t hashName(std::string_view text)
+    {
+        uint64_t hash = text.size() * 0x9E3779B97F4A7C15ull;
+        size_t i = 0;
+        for (; i + 8 <= text.size(); i += 8)
+        {
+            uint64_t chunk;
+            memcpy(&chunk, text.data() + i, 8);
+            hash = (hash ^ chunk) * 0xFF51AFD7ED558CCDull;
+            hash ^= hash >> 32;
+        }
+        uint64_t tail = 0;
+        memcpy(&tail, text.data() + i, text.size() - i);
+        hash = (hash ^ tail) * 0xFF51AFD7ED558CCDull;
+        return uint32_t(hash >> 32);
+    }
+
+    std::string_view store(std::string_view text)
+    {
+        char *dest;
+        if (text.size() > BLOCK_SIZE / 4) // Long names get a block of their own
+        {
+            blocks.emplace_back(new char[text.size()]);
+            dest = blocks.back().get();
+        }
+        else
+        {
+            if (BLOCK_SIZE - blockUsed < text.size())
+            {
+                blocks.emplace_back(new char[BLOCK_SIZE]);
+                block = blocks.back().get();
+                blockUsed = 0;
+            }
+            dest = block + blockUsed;
+            blockUsed += text.size();
+        }
+        memcpy(dest, text.data(), text.size());
+        return std::string_view(dest, text.size());
+    }
+
+    void grow()
+    {
+        std::vector<uint32_t> bigger(slots.empty() ? 1024 : slots.size() * 2, NO_SYMBOL);
+        size_t mask = bigger.size() - 1;
+        for (uint32_t id = 0; id < names.size(); id++)
+        {
+            size_t i = hashes[id] & mask;
+            while (bigger[i] != NO_SYMBOL)
+                i = (i + 1) & mask;
+            bigger[i] = id;
+        }
+        slots.swap(bigger);
+    }
+
+public:
+    StringInterner() = default;
+    StringInterner(const StringInterner &) = delete;
+    StringInterner &operator=(const StringInterner &) = delete;
+
+    // Returns the id of text, adding it if this is the first time it is seen
+    uint32_t intern(std::string_view text)
+    {
+        TIME_COUNT(COUNTER_INTERNED, 1);
+        if ((names.size() + 1) * 2 > slots.size()) // Keep the load factor under 1/2
+            grow();
+
+        uint32_t hash = hashName(text);
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            uint32_t id = slots[i];
+            if (id == NO_SYMBOL)
+            {
+                id = uint32_t(names.size());
+                names.push_back(store(text));
+                hashes.push_back(hash);
+                slots[i] = id;
+                return id;
+            }
+            if (hashes[id] == hash && names[id] == text)
+                return id;
+            TIME_COUNT(COUNTER_COLLISIONS, 1);
+        }
+    }
+
+    std::string_view name(uint32_t id) const { return names[id]; }
+    size_t size() const { return names.size(); }
+
+    // Bytes held by the blocks and tables, about: a long name's own block
+    // counts as a full one
+    size_t memoryUsed() const
+    {
+        return blocks.size() * BLOCK_SIZE + names.capacity() * sizeof(std::string_view) +
+               (hashes.capacity() + slots.capacity()) * sizeof(uint32_t);
+    }
+
+    // Forgets every name but keeps the current block and the slot table, so
+    // one interner can be reused file after file without reallocating
+    void clear()
+    {
+        names.clear();
+        hashes.clear();
+        std::fill(slots.begin(), slots.end(), NO_SYMBOL);
+        for (std::unique_ptr<char[]> &owned : blocks)
+        {
+            if (owned.get() == block)
+            {
+                owned.swap(blocks.front());
+                break;
+            }
+        }
+        blocks.resize(block ? 1 : 0);
+        blockUsed = block ? 0 : BLOCK_SIZE;
+    }
+};
+
+#endif
@@ -0,0 +1,168 @@
+#ifndef COMMON_SYMBOL_TABLE_H
+#define COMMON_SYMBOL_TABLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "StringInterner.h"
+#include "TypeTable.h"
+
+// The compiler counts declarations, lookups and probe collisions for its
+// time report; it defines TIME_COUNT before including this header
+#ifndef TIME_COUNT
+#define TIME_COUNT(counter, n)
+#endif
+
+// Index of no AST node, for declarations made without a syntax tree
+const uint32_t NO_NODE = 0xFFFFFFFF;
+
+// Scoped symbol table over interned names. Live declarations are kept in one
+// vector in declaration order, and a flat open-addressing table maps each
+// name to its innermost live declaration. Every declaration remembers the
+// one it shadows, so leaving a scope just pops its declarations and puts the
+// shadowed ones back: entering and leaving a block is O(names declared in it).
+// A run of declarations can also be hidden without popping it, so code before
+// it can be checked again while the declarations after it are kept.
+struct Symbol
+{
+    uint32_t name;        // Interned name
+    uint32_t line;        // Line of the declaration, or 0 if its declaration node says where it is
+    uint32_t depth;       // Scope depth, 0 for the outermost scope
+    uint32_t shadowed;    // Declaration of the same name in an enclosing scope, or NO_SYMBOL
+    uint32_t declaration; // AST node that declared it, or NO_NODE
+    TypeId type;
+};
+
+class SymbolTable
+{
+private:
+    struct Slot
+    {
+        uint32_t name;
+        uint32_t symbol; // Index into symbols; NO_SYMBOL marks a free slot
+    };
+
+    std::vector<Symbol> symbols;       // Live declarations, innermost scope last
+    std::vector<Slot> slots;           // Power-of-two sized
+    std::vector<uint32_t> scopeStarts; // symbols.size() when each open scope was entered
+    size_t usedSlots = 0;
+    uint32_t hiddenFrom = 0, hiddenTo = 0; // Declarations lookups pass over, see hide()
+
+    // The first declaration from symbol down its shadowed chain that is not hidden
+    uint32_t visible(uint32_t symbol) const
+    {
+        while (symbol != NO_SYMBOL && symbol >= hiddenFrom && symbol < hiddenTo)
+            symbol = symbols[symbol].shadowed;
+        return symbol;
+    }
+
+    size_t findSlot(uint32_t name) const
+    {
+        size_t mask = slots.size() - 1;
+        size_t i = (name * 0x9E3779B1u) & mask;
+        while (slots[i].symbol != NO_SYMBOL && slots[i].name != name)
+        {
+            TIME_COUNT(COUNTER_COLLISIONS, 1);
+            i = (i + 1) & mask;
+        }
+        return i;
+    }
+
+    // Slots are removed without tombstones, which is only safe while they are
+    // released in the reverse of the order they were taken. Reinserting in
+    // declaration order keeps that true after growing.
+    void grow()
+    {
+        slots.assign(slots.size() * 2, Slot{0, NO_SYMBOL});
+        usedSlots = 0;
+        for (uint32_t i = 0; i < symbols.size(); i++)
+        {
+            Slot &slot = slots[findSlot(symbols[i].name)];
+            if (slot.symbol == NO_SYMBOL)
+                usedSlots++;
+            slot = Slot{symbols[i].name, i};
+        }
+    }
+
+public:
+    SymbolTable() : slots(64, Slot{0, NO_SYMBOL}) {}
+
+    void enterScope() { scopeStarts.push_back(uint32_t(symbols.size())); }
+
+    void exitScope()
+    {
+        size_t start = scopeStarts.back();
+        scopeStarts.pop_back();
+        popTo(start);
+    }
+
+    // Removes the newest declarations until count are left, putting back the ones they shadowed
+    void popTo(size_t count)
+    {
+        while (symbols.size() > count)
+        {
+            const Symbol &symbol = symbols.back();
+            Slot &slot = slots[findSlot(symbol.name)];
+            slot.symbol = symbol.shadowed;
+            if (symbol.shadowed == NO_SYMBOL)
+                usedSlots--;
+            symbols.pop_back();
+        }
+        hiddenTo = uint32_t(std::min(size_t(hiddenTo), count));
+        hiddenFrom = std::min(hiddenFrom, hiddenTo);
+    }
+
+    // Hides the declarations from first on until show(). Lookups and the
+    // redeclaration check pass over them, and the ones made meanwhile go
+    // after them. Scopes must not be left past first while they are hidden.
+    void hide(size_t first)
+    {
+        hiddenFrom = uint32_t(first);
+        hiddenTo = uint32_t(symbols.size());
+    }
+
+    void show() { hiddenFrom = hiddenTo = 0; }
+
+    // How many declarations are live and not hidden
+    size_t visibleCount() const { return symbols.size() - (hiddenTo - hiddenFrom); }
+
+    uint32_t depth() const { return uint32_t(scopeStarts.size()); }
+
+    // Declares name in the current scope. Returns false if it is already
+    // declared in this scope; a declaration in an enclosing scope is shadowed.
+    bool declare(uint32_t name, TypeId type, uint32_t line, uint32_t declaration = NO_NODE)
+    {
+        TIME_COUNT(COUNTER_DECLARATIONS, 1);
+        if ((usedSlots + 1) * 2 > slots.size())
+            grow();
+
+        Slot &slot = slots[findSlot(name)];
+        uint32_t current = visible(slot.symbol);
+        if (current != NO_SYMBOL && symbols[current].depth == depth())
+            return false;
+        if (slot.symbol == NO_SYMBOL)
+        {
+            slot.name = name;
+            usedSlots++;
+        }
+        symbols.push_back(Symbol{name, line, depth(), slot.symbol, declaration, type});
+        slot.symbol = uint32_t(symbols.size() - 1);
+        return true;
+    }
+
+    // Innermost visible declaration of name, or nullptr. The pointer is only
+    // valid until the next declare() or exitScope().
+    const Symbol *lookup(uint32_t name) const
+    {
+        TIME_COUNT(COUNTER_LOOKUPS, 1);
+        uint32_t symbol = visible(slots[findSlot(name)].symbol);
+        return symbol == NO_SYMBOL ? nullptr : &symbols[symbol];
+    }
+
+    // Declarations visible in the current scope or an enclosing one, outermost
+    // first, and any hidden ones among them
+    const std::vector<Symbol> &live() const { return symbols; }
+};
+
+#endif
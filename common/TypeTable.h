@@ -0,0 +1,152 @@
+#ifndef COMMON_TYPE_TABLE_H
+#define COMMON_TYPE_TABLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Types are small integer handles, so checking two types against each other
+// is an integer compare. The primitive types are fixed constants; array and
+// function types are built on demand by TypeTable and interned, so
+// structurally equal types always get the same handle.
+typedef uint32_t TypeId;
+
+const TypeId TYPE_ERROR = 0; // Type of an expression that could not be typed; never reported twice
+const TypeId TYPE_VOID = 1;
+const TypeId TYPE_BOOL = 2;
+const TypeId TYPE_CHAR = 3; // The numeric types run from TYPE_CHAR to TYPE_DOUBLE, narrowest first
+const TypeId TYPE_INT = 4;
+const TypeId TYPE_FLOAT = 5;
+const TypeId TYPE_DOUBLE = 6;
+const TypeId TYPE_STRING = 7;
+
+enum TypeKind : uint8_t
+{
+    TYPE_KIND_PRIMITIVE,
+    TYPE_KIND_ARRAY,
+    TYPE_KIND_FUNCTION
+};
+
+// Operators and type keywords are passed by spelling ("+", "int"), since
+// every program that shares this table numbers its tokens differently.
+class TypeTable
+{
+private:
+    struct TypeInfo
+    {
+        TypeKind kind;
+        TypeId base;         // Element type of an array, result type of a function
+        uint32_t count;      // Length of an array, parameter count of a function
+        uint32_t firstParam; // Index into params of a function's first parameter type
+    };
+
+    std::vector<TypeInfo> types;                        // Indexed by TypeId
+    std::vector<TypeId> params;                         // Parameter lists of all function types
+    std::map<std::vector<uint32_t>, TypeId> composites; // Structure of each array/function type -> handle
+
+    static const char *const *primitiveNames()
+    {
+        static const char *const names[] = {"<error>", "void", "bool", "char", "int", "float", "double", "string"};
+        return names;
+    }
+
+    TypeId intern(TypeKind kind, TypeId base, uint32_t count, const std::vector<TypeId> &parameters)
+    {
+        std::vector<uint32_t> key = {kind, base, count};
+        key.insert(key.end(), parameters.begin(), parameters.end());
+        auto found = composites.find(key);
+        if (found != composites.end())
+            return found->second;
+
+        TypeId id = TypeId(types.size());
+        types.push_back(TypeInfo{kind, base, count, uint32_t(params.size())});
+        params.insert(params.end(), parameters.begin(), parameters.end());
+        composites.emplace(std::move(key), id);
+        return id;
+    }
+
+public:
+    TypeTable()
+    {
+        for (TypeId id = TYPE_ERROR; id <= TYPE_STRING; id++)
+            types.push_back(TypeInfo{TYPE_KIND_PRIMITIVE, id, 0, 0});
+    }
+
+    TypeId arrayOf(TypeId element, uint32_t length) { return intern(TYPE_KIND_ARRAY, element, length, {}); }
+
+    TypeId functionOf(TypeId result, const std::vector<TypeId> &parameters)
+    {
+        return intern(TYPE_KIND_FUNCTION, result, uint32_t(parameters.size()), parameters);
+    }
+
+    TypeKind kind(TypeId type) const { return types[type].kind; }
+    TypeId baseType(TypeId type) const { return types[type].base; } // Element or result type
+    uint32_t count(TypeId type) const { return types[type].count; } // Array length or parameter count
+    TypeId parameter(TypeId function, uint32_t i) const { return params[types[function].firstParam + i]; }
+
+    std::string name(TypeId type) const
+    {
+        const TypeInfo &info = types[type];
+        if (info.kind == TYPE_KIND_ARRAY)
+            return name(info.base) + "[" + std::to_string(info.count) + "]";
+        if (info.kind == TYPE_KIND_FUNCTION)
+        {
+            std::string text = name(info.base) + "(";
+            for (uint32_t i = 0; i < info.count; i++)
+                text += (i ? ", " : "") + name(parameter(type, i));
+            return text + ")";
+        }
+        return primitiveNames()[type];
+    }
+
+    static bool isNumeric(TypeId type) { return type >= TYPE_CHAR && type <= TYPE_DOUBLE; }
+    static bool isScalar(TypeId type) { return type == TYPE_BOOL || isNumeric(type); }
+
+    // Scalars convert to one another implicitly; everything else must match exactly
+    static bool assignable(TypeId target, TypeId value)
+    {
+        return target == value || target == TYPE_ERROR || value == TYPE_ERROR ||
+               (isScalar(target) && isScalar(value));
+    }
+
+    // Type of "left op right", or TYPE_ERROR if op does not apply to those operand types
+    static TypeId binaryResult(std::string_view op, TypeId left, TypeId right)
+    {
+        if (left == TYPE_ERROR || right == TYPE_ERROR)
+            return TYPE_ERROR;
+        if (op == "+" && left == TYPE_STRING && right == TYPE_STRING)
+            return TYPE_STRING; // Concatenation
+        if (op == "+" || op == "-" || op == "*" || op == "/")
+        {
+            if (!isScalar(left) || !isScalar(right))
+                return TYPE_ERROR;
+            return std::max(TYPE_INT, std::max(left, right)); // bool and char promote to int
+        }
+        // Comparisons and logical operators
+        if (isScalar(left) && isScalar(right))
+            return TYPE_BOOL;
+        return left == right && left == TYPE_STRING ? TYPE_BOOL : TYPE_ERROR;
+    }
+
+    // Type of "op operand" for the prefix operators - and !
+    static TypeId unaryResult(std::string_view op, TypeId operand)
+    {
+        if (!isScalar(operand))
+            return TYPE_ERROR;
+        return op == "!" ? TYPE_BOOL : std::max(TYPE_INT, operand);
+    }
+
+    // Type named by a type keyword, or TYPE_ERROR for any other word
+    static TypeId primitive(std::string_view keyword)
+    {
+        for (TypeId type = TYPE_BOOL; type <= TYPE_STRING; type++)
+            if (keyword == primitiveNames()[type])
+                return type;
+        return TYPE_ERROR;
+    }
+};
+
+#endif